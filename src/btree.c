@@ -0,0 +1,376 @@
+#if defined(RBTREE_KEY_TYPE) || defined(RBTREE_KEY_BYTES) || defined(RBTREE_KEY_LESS) || defined(RBTREE_KEY_COMPARE)
+#define BTREE_SCALAR   // int이 아닌 key나 사용자 비교 함수는 SIMD로 비교할 수 없다
+#endif
+
+#include "btree.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(BTREE_SCALAR) && (defined(__SSE2__) || defined(__AVX2__))
+#include <immintrin.h>
+#endif
+
+/**
+ * root가 아닌 node가 가져야 하는 최소 key 수.
+*/
+#define BTREE_MIN (BTREE_ORDER / 2)
+
+/**
+ * 탐색 경로의 최대 길이. root가 아닌 node는 자식이 BTREE_MIN + 1개 이상이므로 충분히 크다.
+*/
+#define BTREE_MAX_HEIGHT 64
+
+_Static_assert(BTREE_ORDER >= 3, "BTREE_ORDER must be at least 3");
+
+static bnode *alloc_bnode(const int leaf) {
+  size_t size = sizeof(bnode) + (leaf ? 0 : (BTREE_ORDER + 2) * sizeof(bnode *));
+  size = (size + 63) / 64 * 64;   // aligned_alloc은 size가 alignment의 배수여야 한다
+  bnode *n = (bnode *)aligned_alloc(64, size);
+  if(n == NULL) return NULL;
+  n->count = 0;
+  n->next = NULL;
+  return n;
+}
+
+btree *new_btree(void) {
+  btree *t = (btree *)calloc(1, sizeof(btree));
+  if(t == NULL) return NULL;
+  t->root = alloc_bnode(1);
+  if(t->root == NULL) {
+    free(t);
+    return NULL;
+  }
+  return t;
+}
+
+static void free_bnode(bnode *n, const size_t height) {
+  if(height > 0) {
+    for(uint32_t i = 0; i <= n->count; i++) {
+      free_bnode(n->children[i], height - 1);
+    }
+  }
+  free(n);
+}
+
+void delete_btree(btree *t) {
+  free_bnode(t->root, t->height);
+  free(t);
+}
+
+/**
+ * 정렬된 KEYS[0..N) 중 KEY보다 작은 key의 수를 return하는 함수. (KEY의 lower bound 위치)
+ *
+ * int key이면 SIMD로 4개(SSE2) 또는 8개(AVX2)씩 비교하고, 모두 작지 않은 묶음에서 멈춘다.
+ * N을 넘는 칸도 읽지만 BTREE_KEY_SLOTS 안이며 결과에서는 mask로 버린다.
+*/
+static inline uint32_t count_less(const key_t *keys, const uint32_t n, const key_t key) {
+#if !defined(BTREE_SCALAR) && defined(__AVX2__)
+  const __m256i k = _mm256_set1_epi32(key);
+  uint32_t result = 0;
+  for(uint32_t i = 0; i < n; i += 8) {
+    __m256i v = _mm256_load_si256((const __m256i *)(keys + i));
+    unsigned int mask = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, v)));
+    if(n - i < 8) mask &= (1u << (n - i)) - 1;
+    result += (uint32_t)__builtin_popcount(mask);
+    if(mask != 0xff) break;
+  }
+  return result;
+#elif !defined(BTREE_SCALAR) && defined(__SSE2__)
+  const __m128i k = _mm_set1_epi32(key);
+  uint32_t result = 0;
+  for(uint32_t i = 0; i < n; i += 4) {
+    __m128i v = _mm_load_si128((const __m128i *)(keys + i));
+    unsigned int mask = (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, k)));
+    if(n - i < 4) mask &= (1u << (n - i)) - 1;
+    result += (uint32_t)__builtin_popcount(mask);
+    if(mask != 0xf) break;
+  }
+  return result;
+#else
+  uint32_t lo = 0, hi = n;
+  while(lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if(RBTREE_KEY_LESS(keys[mid], key)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+#endif
+}
+
+/**
+ * 탐색 경로. LEVEL번째 node는 NODES[LEVEL]이고 그 안에서 INDEX[LEVEL]번째 자식으로 내려갔다.
+*/
+typedef struct {
+  bnode *nodes[BTREE_MAX_HEIGHT];
+  uint32_t index[BTREE_MAX_HEIGHT];
+} bpath;
+
+/**
+ * KEY의 lower bound가 있을 수 있는 leaf까지 내려가는 함수. PATH가 NULL이 아니면 경로를 기록한다.
+ *
+ * internal node의 i번째 key(separator)는 왼쪽 subtree의 모든 key 이상, 오른쪽 subtree의 모든 key 이하이다.
+ * KEY보다 작은 separator의 수로 내려가므로 도착한 leaf에 KEY 이상인 key가 없으면 다음 leaf의 첫 key가 lower bound이다.
+*/
+static bnode *descend(const btree *t, const key_t key, bpath *path) {
+  bnode *n = t->root;
+  for(size_t level = 0; level < t->height; level++) {
+    uint32_t i = count_less(n->keys, n->count, key);
+    if(path != NULL) {
+      path->nodes[level] = n;
+      path->index[level] = i;
+    }
+    n = n->children[i];
+  }
+  return n;
+}
+
+/**
+ * PATH를 다음 leaf로 옮기고 그 leaf를 return하는 함수. 마지막 leaf이면 NULL을 return.
+*/
+static bnode *next_leaf(const btree *t, bpath *path) {
+  size_t level = t->height;
+  while(level > 0 && path->index[level - 1] == path->nodes[level - 1]->count) level--;
+  if(level == 0) return NULL;
+  bnode *n = path->nodes[level - 1]->children[++path->index[level - 1]];
+  for(; level < t->height; level++) {
+    path->nodes[level] = n;
+    path->index[level] = 0;
+    n = n->children[0];
+  }
+  return n;
+}
+
+/**
+ * T에서 KEY와 같은 key 하나의 pointer를 찾는 함수. 없으면 NULL을 return.
+ * pointer는 다음 insert/erase 전까지만 유효하다.
+*/
+const key_t *btree_find(const btree *t, const key_t key) {
+  const bnode *n = descend(t, key, NULL);
+  uint32_t pos = count_less(n->keys, n->count, key);
+  if(pos == n->count) {
+    n = n->next;
+    pos = 0;
+    if(n == NULL) return NULL;
+  }
+  return RBTREE_KEY_LESS(key, n->keys[pos]) ? NULL : &n->keys[pos];
+}
+
+/**
+ * 한 칸 넘친 N(BTREE_ORDER + 1개의 key)을 반으로 나누어 오른쪽 절반을 RIGHT로 옮기는 함수.
+ * 부모에 넣을 separator를 SEP에 담는다.
+*/
+static void split_bnode(bnode *n, bnode *right, const int leaf, key_t *sep) {
+  const uint32_t left_count = (BTREE_ORDER + 1) / 2;
+  if(leaf) {
+    // leaf는 key를 모두 남기고, 오른쪽 leaf의 첫 key를 separator로 복사한다
+    right->count = n->count - left_count;
+    memcpy(right->keys, n->keys + left_count, right->count * sizeof(key_t));
+    right->next = n->next;
+    n->next = right;
+    *sep = right->keys[0];
+  } else {
+    // internal node는 가운데 key를 부모로 올린다
+    right->count = n->count - left_count - 1;
+    memcpy(right->keys, n->keys + left_count + 1, right->count * sizeof(key_t));
+    memcpy(right->children, n->children + left_count + 1, (right->count + 1) * sizeof(bnode *));
+    *sep = n->keys[left_count];
+  }
+  n->count = left_count;
+}
+
+/**
+ * T에 KEY를 삽입하는 함수. 메모리가 부족하면 tree를 바꾸지 않고 -1을 return.
+*/
+int btree_insert(btree *t, const key_t key) {
+  bpath path;
+  bnode *leaf = descend(t, key, &path);
+
+  // 넘칠 node를 split할 새 node를 미리 할당한다. (leaf부터 위로 가득 찬 node마다 하나, root까지 차 있으면 새 root)
+  bnode *spare[BTREE_MAX_HEIGHT + 1];
+  size_t splits = 0;
+  if(leaf->count == BTREE_ORDER) {
+    splits = 1;
+    while(splits <= t->height && path.nodes[t->height - splits]->count == BTREE_ORDER) splits++;
+  }
+  for(size_t i = 0; i < splits + (splits > t->height); i++) {
+    spare[i] = alloc_bnode(i == 0);
+    if(spare[i] == NULL) {
+      while(i > 0) free(spare[--i]);
+      return -1;
+    }
+  }
+
+  uint32_t pos = count_less(leaf->keys, leaf->count, key);
+  memmove(leaf->keys + pos + 1, leaf->keys + pos, (leaf->count - pos) * sizeof(key_t));
+  leaf->keys[pos] = key;
+  leaf->count++;
+  t->count++;
+
+  // 넘친 node를 나누고 separator를 부모에 넣는다
+  bnode *n = leaf;
+  size_t level = t->height;
+  for(size_t i = 0; i < splits; i++, level--) {
+    key_t sep;
+    bnode *right = spare[i];
+    split_bnode(n, right, i == 0, &sep);
+    if(level == 0) {
+      bnode *root = spare[splits];
+      root->count = 1;
+      root->keys[0] = sep;
+      root->children[0] = n;
+      root->children[1] = right;
+      t->root = root;
+      t->height++;
+      break;
+    }
+    bnode *parent = path.nodes[level - 1];
+    uint32_t at = path.index[level - 1];
+    memmove(parent->keys + at + 1, parent->keys + at, (parent->count - at) * sizeof(key_t));
+    memmove(parent->children + at + 2, parent->children + at + 1, (parent->count - at) * sizeof(bnode *));
+    parent->keys[at] = sep;
+    parent->children[at + 1] = right;
+    parent->count++;
+    n = parent;
+  }
+  return 0;
+}
+
+/**
+ * PARENT의 I번째 자식이 BTREE_MIN개보다 적은 key를 가질 때 형제에게서 key를 빌리거나 형제와 합치는 함수.
+ * LEAF는 자식이 leaf인지를 나타낸다.
+*/
+static void rebalance(bnode *parent, const uint32_t i, const int leaf) {
+  bnode *c = parent->children[i];
+  bnode *left = i > 0 ? parent->children[i - 1] : NULL;
+  bnode *right = i < parent->count ? parent->children[i + 1] : NULL;
+
+  if(left != NULL && left->count > BTREE_MIN) {
+    // 왼쪽 형제의 마지막 key를 가져온다
+    memmove(c->keys + 1, c->keys, c->count * sizeof(key_t));
+    if(leaf) {
+      c->keys[0] = left->keys[left->count - 1];
+      parent->keys[i - 1] = c->keys[0];
+    } else {
+      memmove(c->children + 1, c->children, (c->count + 1) * sizeof(bnode *));
+      c->keys[0] = parent->keys[i - 1];
+      c->children[0] = left->children[left->count];
+      parent->keys[i - 1] = left->keys[left->count - 1];
+    }
+    left->count--;
+    c->count++;
+    return;
+  }
+
+  if(right != NULL && right->count > BTREE_MIN) {
+    // 오른쪽 형제의 첫 key를 가져온다
+    if(leaf) {
+      c->keys[c->count] = right->keys[0];
+      memmove(right->keys, right->keys + 1, (right->count - 1) * sizeof(key_t));
+      parent->keys[i] = right->keys[0];
+    } else {
+      c->keys[c->count] = parent->keys[i];
+      c->children[c->count + 1] = right->children[0];
+      parent->keys[i] = right->keys[0];
+      memmove(right->keys, right->keys + 1, (right->count - 1) * sizeof(key_t));
+      memmove(right->children, right->children + 1, right->count * sizeof(bnode *));
+    }
+    right->count--;
+    c->count++;
+    return;
+  }
+
+  // 빌릴 수 없으면 j번째와 j + 1번째 자식을 합친다
+  const uint32_t j = left != NULL ? i - 1 : i;
+  bnode *l = parent->children[j];
+  bnode *r = parent->children[j + 1];
+  if(leaf) {
+    memcpy(l->keys + l->count, r->keys, r->count * sizeof(key_t));
+    l->count += r->count;
+    l->next = r->next;
+  } else {
+    l->keys[l->count] = parent->keys[j];
+    memcpy(l->keys + l->count + 1, r->keys, r->count * sizeof(key_t));
+    memcpy(l->children + l->count + 1, r->children, (r->count + 1) * sizeof(bnode *));
+    l->count += r->count + 1;
+  }
+  free(r);
+  memmove(parent->keys + j, parent->keys + j + 1, (parent->count - j - 1) * sizeof(key_t));
+  memmove(parent->children + j + 1, parent->children + j + 2, (parent->count - j - 1) * sizeof(bnode *));
+  parent->count--;
+}
+
+/**
+ * T에서 KEY를 하나 삭제하는 함수. KEY가 없으면 -1을 return.
+*/
+int btree_erase(btree *t, const key_t key) {
+  bpath path;
+  bnode *n = descend(t, key, &path);
+  uint32_t pos = count_less(n->keys, n->count, key);
+  if(pos == n->count) {
+    n = next_leaf(t, &path);
+    pos = 0;
+    if(n == NULL) return -1;
+  }
+  if(RBTREE_KEY_LESS(key, n->keys[pos])) return -1;
+
+  memmove(n->keys + pos, n->keys + pos + 1, (n->count - pos - 1) * sizeof(key_t));
+  n->count--;
+  t->count--;
+
+  // 모자란 node를 아래에서부터 채운다
+  for(size_t level = t->height; level > 0 && n->count < BTREE_MIN; level--) {
+    rebalance(path.nodes[level - 1], path.index[level - 1], level == t->height);
+    n = path.nodes[level - 1];
+  }
+  if(t->height > 0 && t->root->count == 0) {
+    bnode *old = t->root;
+    t->root = old->children[0];
+    t->height--;
+    free(old);
+  }
+  return 0;
+}
+
+static const bnode *first_leaf(const btree *t) {
+  const bnode *n = t->root;
+  for(size_t level = 0; level < t->height; level++) n = n->children[0];
+  return n;
+}
+
+/**
+ * T의 가장 작은 key의 pointer를 return하는 함수. T가 비어 있으면 NULL을 return.
+*/
+const key_t *btree_min(const btree *t) {
+  const bnode *n = first_leaf(t);
+  return n->count == 0 ? NULL : &n->keys[0];
+}
+
+/**
+ * T의 가장 큰 key의 pointer를 return하는 함수. T가 비어 있으면 NULL을 return.
+*/
+const key_t *btree_max(const btree *t) {
+  const bnode *n = t->root;
+  for(size_t level = 0; level < t->height; level++) n = n->children[n->count];
+  return n->count == 0 ? NULL : &n->keys[n->count - 1];
+}
+
+size_t btree_size(const btree *t) {
+  return t->count;
+}
+
+/**
+ * T의 key를 오름차순으로 ARR에 최대 N개 담는 함수.
+*/
+int btree_to_array(const btree *t, key_t *arr, const size_t n) {
+  size_t index = 0;
+  for(const bnode *leaf = first_leaf(t); leaf != NULL && index < n; leaf = leaf->next) {
+    size_t take = leaf->count < n - index ? leaf->count : n - index;
+    memcpy(arr + index, leaf->keys, take * sizeof(key_t));
+    index += take;
+  }
+  return 0;
+}
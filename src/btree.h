@@ -0,0 +1,51 @@
+#ifndef _BTREE_H_
+#define _BTREE_H_
+
+#include "rbtree.h"
+
+/**
+ * rbtree와 같은 key를 담는 B+tree backend.
+ *
+ * node 하나에 정렬된 key를 BTREE_ORDER개까지 cache line 경계에 맞춰 저장하고,
+ * node 안의 탐색은 SIMD 비교(SSE2, AVX2)로 한 번에 여러 key를 본다.
+ * 높이가 rbtree의 약 1/4이므로 큰 tree에서 find의 cache miss가 줄어든다.
+ *
+ * key는 leaf에만 있고 leaf들은 key 순서대로 NEXT로 연결된다.
+ * rbtree처럼 같은 key를 여러 번 저장할 수 있으며(multiset) btree_to_array의 순서도 같다.
+ * node의 위치가 split/merge로 바뀌므로 node_t 대신 key로 다루는 API만 제공한다.
+*/
+#ifndef BTREE_ORDER
+#define BTREE_ORDER 32
+#endif
+
+/**
+ * key 배열의 칸 수. insert 중 한 칸이 넘칠 수 있고, SIMD load가 배열 밖을 읽지 않도록 8의 배수로 맞춘다.
+*/
+#define BTREE_KEY_SLOTS ((BTREE_ORDER + 1 + 7) / 8 * 8)
+
+typedef struct bnode {
+  _Alignas(64) key_t keys[BTREE_KEY_SLOTS];
+  uint32_t count;
+  struct bnode *next;         // leaf: key 순서상 다음 leaf
+  struct bnode *children[];   // internal node: COUNT + 1개의 자식
+} bnode;
+
+typedef struct {
+  bnode *root;
+  size_t height;  // root에서 leaf까지의 간선 수 (root가 leaf이면 0)
+  size_t count;
+} btree;
+
+btree *new_btree(void);
+void delete_btree(btree *);
+
+int btree_insert(btree *, const key_t);
+const key_t *btree_find(const btree *, const key_t);
+int btree_erase(btree *, const key_t);
+const key_t *btree_min(const btree *);
+const key_t *btree_max(const btree *);
+size_t btree_size(const btree *);
+
+int btree_to_array(const btree *, key_t *, const size_t);
+
+#endif  // _BTREE_H_
@@ -1,5 +1,1378 @@
 #include "rbtree.h"
+#include "btree.h"
+#include "rbtree_frozen.h"
+#include "rbtree_io.h"
+#include "rbtree_persist.h"
+#include "rbtree_sync.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * link 단계에서 -Wl,--wrap으로 가로챈 allocator 호출 횟수.
+ * rbtree.c가 op마다 몇 번 allocator를 부르는지 측정하는 데 사용한다.
+ * sync, parallel benchmark에서는 여러 thread가 부르므로 atomic으로 센다.
+*/
+static atomic_size_t alloc_calls;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  atomic_fetch_add_explicit(&alloc_calls, 1, memory_order_relaxed);
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  atomic_fetch_add_explicit(&alloc_calls, 1, memory_order_relaxed);
+  return __real_calloc(count, size);
+}
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/**
+ * BENCH의 buffer 할당에 실패했음을 알리고 1을 return하는 함수.
+*/
+static int out_of_memory(const char *bench) {
+  fprintf(stderr, "%s: out of memory\n", bench);
+  return 1;
+}
+
+/**
+ * insert/erase churn benchmark.
+ * SIZE개의 key로 tree를 채운 뒤, 임의의 node 하나를 erase하고 새 key를 insert하는 것을 OPS번 반복한다.
+*/
+static int bench_churn(size_t size, size_t ops) {
+  srand(1);
+  node_t **live = (node_t **)calloc(size, sizeof(node_t *));
+  if(live == NULL) return out_of_memory("churn");
+  rbtree *t = new_rbtree();
+  for(size_t i = 0; i < size; i++) {
+    live[i] = rbtree_insert(t, rand());
+  }
+
+  size_t calls_before = alloc_calls;
+  double start = now_ns();
+  for(size_t i = 0; i < ops; i++) {
+    size_t victim = (size_t)rand() % size;
+    rbtree_erase(t, live[victim]);
+    live[victim] = rbtree_insert(t, rand());
+  }
+  double elapsed = now_ns() - start;
+  size_t calls = alloc_calls - calls_before;
+
+  // erase 1회 + insert 1회를 op 하나로 센다
+  printf("churn size=%zu ops=%zu  %.1f ns/op  %.4f allocs/op\n",
+         size, ops, elapsed / ops, (double)calls / ops);
+
+  free(live);
+  delete_rbtree(t);
+  return 0;
+}
+
+/**
+ * 같은 크기의 tree를 CYCLES번 다시 만드는 benchmark.
+ * 매번 새 tree를 만들고 delete_rbtree하는 경우와 하나의 tree를 rbtree_clear로 비워 다시 쓰는 경우를 비교한다.
+*/
+static int bench_rebuild(size_t n, size_t cycles) {
+  srand(1);
+  key_t *keys = (key_t *)malloc(n * sizeof(key_t));
+  if(keys == NULL) return out_of_memory("rebuild");
+  for(size_t i = 0; i < n; i++) {
+    keys[i] = rand();
+  }
+
+  size_t calls_before = alloc_calls;
+  double start = now_ns();
+  for(size_t c = 0; c < cycles; c++) {
+    rbtree *t = new_rbtree();
+    for(size_t i = 0; i < n; i++) {
+      rbtree_insert(t, keys[i]);
+    }
+    delete_rbtree(t);
+  }
+  double delete_ns = now_ns() - start;
+  size_t delete_calls = alloc_calls - calls_before;
+
+  rbtree *t = new_rbtree();
+  calls_before = alloc_calls;
+  start = now_ns();
+  for(size_t c = 0; c < cycles; c++) {
+    for(size_t i = 0; i < n; i++) {
+      rbtree_insert(t, keys[i]);
+    }
+    rbtree_clear(t);
+  }
+  double clear_ns = now_ns() - start;
+  size_t clear_calls = alloc_calls - calls_before;
+  delete_rbtree(t);
+
+  printf("rebuild n=%zu cycles=%zu  new+delete %.2f ms/cycle %.1f allocs/cycle  clear %.2f ms/cycle %.1f allocs/cycle\n",
+         n, cycles, delete_ns / cycles / 1e6, (double)delete_calls / cycles,
+         clear_ns / cycles / 1e6, (double)clear_calls / cycles);
+  free(keys);
+  return 0;
+}
+
+/**
+ * 재시작 benchmark.
+ * N개의 random key를 가진 tree를 file로 저장한 뒤, 처음 find에 응답할 수 있을 때까지의 시간을
+ * insert로 다시 만드는 경우, rbtree_load, rbtree_map으로 비교한다. file은 page cache에 있는 상태이다.
+*/
+static int bench_restart(size_t n) {
+  srand(1);
+  key_t *keys = (key_t *)malloc(n * sizeof(key_t));
+  if(keys == NULL) return out_of_memory("restart");
+  for(size_t i = 0; i < n; i++) {
+    keys[i] = rand();
+  }
+  rbtree *t = new_rbtree();
+  for(size_t i = 0; i < n; i++) {
+    rbtree_insert(t, keys[i]);
+  }
+  char path[] = "/tmp/rbtree-restart-XXXXXX";
+  int fd = mkstemp(path);
+  if(fd < 0 || rbtree_save(t, fd) != 0) {
+    fprintf(stderr, "restart: cannot write %s\n", path);
+    exit(1);
+  }
+  delete_rbtree(t);
+
+  double start = now_ns();
+  t = new_rbtree();
+  for(size_t i = 0; i < n; i++) {
+    rbtree_insert(t, keys[i]);
+  }
+  int found = rbtree_find(t, keys[0]) != NULL;
+  double insert_ns = now_ns() - start;
+  delete_rbtree(t);
+
+  start = now_ns();
+  t = rbtree_load(fd);
+  found += t != NULL && rbtree_find(t, keys[0]) != NULL;
+  double load_ns = now_ns() - start;
+  delete_rbtree(t);
+
+  start = now_ns();
+  rbtree_image *image = rbtree_map(fd);
+  found += image != NULL && rbtree_image_find(image, keys[0]) != NULL;
+  double map_ns = now_ns() - start;
+  rbtree_unmap(image);
+
+  printf("restart n=%zu  insert %.2f ms  load %.2f ms  map %.3f ms  found=%d/3\n",
+         n, insert_ns / 1e6, load_ns / 1e6, map_ns / 1e6, found);
+  close(fd);
+  unlink(path);
+  free(keys);
+  return 0;
+}
+
+/**
+ * node layout benchmark.
+ * N개의 random key를 insert한 뒤 같은 key들을 find하여 throughput과 최대 RSS를 출력한다.
+*/
+static int bench_layout(size_t n) {
+  srand(1);
+  key_t *keys = (key_t *)malloc(n * sizeof(key_t));
+  if(keys == NULL) return out_of_memory("layout");
+  for(size_t i = 0; i < n; i++) {
+    keys[i] = rand();
+  }
+
+  rbtree *t = new_rbtree();
+  double start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    rbtree_insert(t, keys[i]);
+  }
+  double insert_ns = now_ns() - start;
+
+  size_t found = 0;
+  start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    found += rbtree_find(t, keys[i]) != NULL;
+  }
+  double find_ns = now_ns() - start;
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("layout node=%zuB n=%zu  insert %.2f Mops/s  find %.2f Mops/s  maxrss %ld MiB\n",
+         sizeof(node_t), n, n / insert_ns * 1e3, found / find_ns * 1e3, usage.ru_maxrss / 1024);
+
+  delete_rbtree(t);
+  free(keys);
+  return 0;
+}
+
+/**
+ * 정렬된 key N개로 tree를 만드는 시간을 rbtree_insert 반복과 rbtree_from_sorted로 비교한다.
+*/
+static int bench_load(size_t n) {
+  key_t *keys = (key_t *)malloc(n * sizeof(key_t));
+  if(keys == NULL) return out_of_memory("load");
+  for(size_t i = 0; i < n; i++) {
+    keys[i] = (key_t)i;
+  }
+
+  double start = now_ns();
+  rbtree *t = new_rbtree();
+  for(size_t i = 0; i < n; i++) {
+    rbtree_insert(t, keys[i]);
+  }
+  double insert_ns = now_ns() - start;
+  delete_rbtree(t);
+
+  start = now_ns();
+  t = rbtree_from_sorted(keys, n);
+  double build_ns = now_ns() - start;
+  delete_rbtree(t);
+
+  printf("load n=%zu  insert loop %.1f ms  from_sorted %.1f ms\n", n, insert_ns / 1e6, build_ns / 1e6);
+  free(keys);
+  return 0;
+}
+
+static int compare_key(const void *a, const void *b) {
+  const key_t x = *(const key_t *)a, y = *(const key_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+/**
+ * SIZE개의 random key를 가진 tree에 BATCH개의 random key를 넣는 시간을
+ * rbtree_insert 반복과 rbtree_insert_batch로 비교한다. 미리 정렬해 둔 batch의 insert_batch도 잰다.
+*/
+static int bench_batch(size_t size, size_t batch) {
+  srand(1);
+  key_t *keys = (key_t *)malloc((size + 2 * batch) * sizeof(key_t));
+  if(keys == NULL) return out_of_memory("batch");
+  for(size_t i = 0; i < size + batch; i++) {
+    keys[i] = rand();
+  }
+  key_t *sorted = keys + size + batch;
+  memcpy(sorted, keys + size, batch * sizeof(key_t));
+  qsort(sorted, batch, sizeof(key_t), compare_key);
+
+  rbtree *t = new_rbtree();
+  rbtree_insert_batch(t, keys, size);
+  double start = now_ns();
+  for(size_t i = size; i < size + batch; i++) {
+    rbtree_insert(t, keys[i]);
+  }
+  double loop_ns = now_ns() - start;
+  delete_rbtree(t);
+
+  t = new_rbtree();
+  rbtree_insert_batch(t, keys, size);
+  start = now_ns();
+  rbtree_insert_batch(t, keys + size, batch);
+  double batch_ns = now_ns() - start;
+  delete_rbtree(t);
+
+  t = new_rbtree();
+  rbtree_insert_batch(t, keys, size);
+  start = now_ns();
+  rbtree_insert_batch(t, sorted, batch);
+  double sorted_ns = now_ns() - start;
+  delete_rbtree(t);
+
+  printf("batch size=%zu batch=%zu  insert loop %.1f ns/key  insert_batch %.1f ns/key  (sorted %.1f ns/key)\n",
+         size, batch, loop_ns / batch, batch_ns / batch, sorted_ns / batch);
+  free(keys);
+  return 0;
+}
+
+/**
+ * 집합 연산 benchmark.
+ * 서로 절반쯤 겹치는 N개짜리 정렬된 key 두 벌로 tree를 만들고 union/intersection/difference 시간을 잰다.
+ * RBTREE_PARALLEL로 빌드하면 THREADS개의 thread로 수행한다.
+*/
+static int bench_setops(size_t n, size_t threads) {
+#ifdef RBTREE_PARALLEL
+  rbtree_set_parallelism(threads);
+#else
+  threads = 1;
+#endif
+  key_t *a = (key_t *)malloc(n * sizeof(key_t));
+  key_t *b = (key_t *)malloc(n * sizeof(key_t));
+  if(a == NULL || b == NULL) {
+    free(b);
+    free(a);
+    return out_of_memory("setops");
+  }
+  srand(1);
+  key_t ka = 0, kb = 0;
+  for(size_t i = 0; i < n; i++) {
+    ka += 1 + rand() % 3;
+    kb += 1 + rand() % 3;
+    a[i] = ka;
+    b[i] = kb;
+  }
+
+  const char *names[] = {"union", "intersection", "difference"};
+  for(int op = 0; op < 3; op++) {
+    rbtree *t1 = rbtree_from_sorted(a, n);
+    rbtree *t2 = rbtree_from_sorted(b, n);
+    double start = now_ns();
+    if(op == 0) rbtree_union(t1, t2);
+    if(op == 1) rbtree_intersection(t1, t2);
+    if(op == 2) rbtree_difference(t1, t2);
+    double elapsed = now_ns() - start;
+    printf("setops %s n=%zu threads=%zu  %.1f ms  result=%zu\n",
+           names[op], n, threads, elapsed / 1e6, rbtree_size(t1));
+    delete_rbtree(t2);
+    delete_rbtree(t1);
+  }
+  free(b);
+  free(a);
+  return 0;
+}
+
+/**
+ * batch 탐색 benchmark.
+ * N개의 random key를 가진 tree에서 N번의 random 탐색을 BATCH개씩 묶어
+ * rbtree_find 반복과 rbtree_find_many로 수행하고 key당 시간을 비교한다.
+*/
+static int bench_find_many(size_t n, size_t batch) {
+  srand(1);
+  key_t *keys = (key_t *)malloc(n * sizeof(key_t));
+  key_t *probes = (key_t *)malloc(n * sizeof(key_t));
+  node_t **out = (node_t **)malloc(batch * sizeof(node_t *));
+  if(keys == NULL || probes == NULL || out == NULL) {
+    free(out);
+    free(probes);
+    free(keys);
+    return out_of_memory("findmany");
+  }
+  for(size_t i = 0; i < n; i++) {
+    keys[i] = rand();
+  }
+  for(size_t i = 0; i < n; i++) {
+    probes[i] = keys[(size_t)rand() % n];
+  }
+  rbtree *t = new_rbtree();
+  for(size_t i = 0; i < n; i++) {
+    rbtree_insert(t, keys[i]);
+  }
+
+  size_t found = 0;
+  double start = now_ns();
+  for(size_t i = 0; i < n; i += batch) {
+    size_t m = n - i < batch ? n - i : batch;
+    for(size_t j = 0; j < m; j++) {
+      out[j] = rbtree_find(t, probes[i + j]);
+    }
+    for(size_t j = 0; j < m; j++) {
+      found += out[j] != NULL;
+    }
+  }
+  double loop_ns = now_ns() - start;
+
+  size_t found_many = 0;
+  start = now_ns();
+  for(size_t i = 0; i < n; i += batch) {
+    size_t m = n - i < batch ? n - i : batch;
+    rbtree_find_many(t, probes + i, m, out);
+    for(size_t j = 0; j < m; j++) {
+      found_many += out[j] != NULL;
+    }
+  }
+  double many_ns = now_ns() - start;
+
+  printf("findmany n=%zu batch=%zu  find loop %.1f ns/key  find_many %.1f ns/key  (%.2fx)  found=%zu/%zu\n",
+         n, batch, loop_ns / n, many_ns / n, loop_ns / many_ns, found, found_many);
+  delete_rbtree(t);
+  free(out);
+  free(probes);
+  free(keys);
+  return 0;
+}
+
+/**
+ * 읽기 전용 tree benchmark.
+ * N개의 random key를 가진 tree를 얼리는 시간과, 절반은 있는 key인 N개의 find를
+ * rbtree_find, rbtree_find_many, 정렬된 배열의 이진 탐색, rbtree_frozen_find로 비교한다.
+*/
+static int bench_frozen(size_t n) {
+  srand(1);
+  key_t *keys = (key_t *)malloc(n * sizeof(key_t));
+  key_t *probes = (key_t *)malloc(n * sizeof(key_t));
+  node_t **out = (node_t **)malloc(n * sizeof(node_t *));
+  key_t *sorted = (key_t *)malloc(n * sizeof(key_t));
+  if(keys == NULL || probes == NULL || out == NULL || sorted == NULL) {
+    free(sorted);
+    free(out);
+    free(probes);
+    free(keys);
+    return out_of_memory("frozen");
+  }
+  for(size_t i = 0; i < n; i++) {
+    keys[i] = rand();
+  }
+  for(size_t i = 0; i < n; i++) {
+    probes[i] = i % 2 ? keys[(size_t)rand() % n] : rand();
+  }
+  rbtree *t = new_rbtree();
+  for(size_t i = 0; i < n; i++) {
+    rbtree_insert(t, keys[i]);
+  }
+  size_t found[4] = {0, 0, 0, 0};
+
+  double start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    found[0] += rbtree_find(t, probes[i]) != NULL;
+  }
+  double find_ns = now_ns() - start;
+
+  start = now_ns();
+  rbtree_find_many(t, probes, n, out);
+  for(size_t i = 0; i < n; i++) {
+    found[1] += out[i] != NULL;
+  }
+  double many_ns = now_ns() - start;
+
+  rbtree_to_array(t, sorted, n);
+  start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    size_t lo = 0, hi = n;
+    while(lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if(sorted[mid] < probes[i]) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    found[2] += lo < n && sorted[lo] == probes[i];
+  }
+  double bsearch_ns = now_ns() - start;
+  free(sorted);
+
+  start = now_ns();
+  rbtree_frozen *f = rbtree_freeze(t);
+  double freeze_ns = now_ns() - start;
+  if(f == NULL) {
+    delete_rbtree(t);
+    free(out);
+    free(probes);
+    free(keys);
+    return out_of_memory("frozen");
+  }
+  start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    found[3] += rbtree_frozen_find(f, probes[i]) != NULL;
+  }
+  double frozen_ns = now_ns() - start;
+
+  printf("frozen n=%zu  freeze %.1f ms  find %.1f ns  find_many %.1f ns  sorted array %.1f ns  frozen %.1f ns  "
+         "bytes/key %zu -> %zu  %s\n",
+         n, freeze_ns / 1e6, find_ns / n, many_ns / n, bsearch_ns / n, frozen_ns / n, sizeof(node_t), sizeof(key_t),
+         found[0] == found[1] && found[1] == found[2] && found[2] == found[3] ? "same" : "MISMATCH");
+  delete_rbtree_frozen(f);
+  delete_rbtree(t);
+  free(out);
+  free(probes);
+  free(keys);
+  return 0;
+}
+
+/**
+ * 거의 정렬된 key의 삽입 benchmark.
+ * timestamp처럼 대부분 직전 key 바로 뒤에 오고 LATE_PERCENT %만 조금 늦게 도착하는 N개의 key를
+ * rbtree_insert와 직전 node를 hint로 준 rbtree_insert_hint로 삽입하고,
+ * 비교를 위해 같은 key를 섞은 순서로도 삽입한다. 두 tree는 섞은 순서로 find 후 erase, rbtree_erase_key로 비운다.
+*/
+static int bench_hint(size_t n, size_t late_percent) {
+  srand(1);
+  key_t *keys = (key_t *)malloc(n * sizeof(key_t));
+  key_t *shuffled = (key_t *)malloc(n * sizeof(key_t));
+  if(keys == NULL || shuffled == NULL) {
+    free(shuffled);
+    free(keys);
+    return out_of_memory("hint");
+  }
+  for(size_t i = 0; i < n; i++) {
+    keys[i] = (key_t)(i * 8);
+    if((size_t)rand() % 100 < late_percent) keys[i] -= rand() % 8000;
+    shuffled[i] = keys[i];
+  }
+  for(size_t i = n; i > 1; i--) {
+    size_t j = (size_t)rand() % i;
+    key_t tmp = shuffled[i - 1];
+    shuffled[i - 1] = shuffled[j];
+    shuffled[j] = tmp;
+  }
+
+  rbtree *t = new_rbtree();
+  double start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    rbtree_insert(t, shuffled[i]);
+  }
+  double random_ns = now_ns() - start;
+  delete_rbtree(t);
+
+  t = new_rbtree();
+  start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    rbtree_insert(t, keys[i]);
+  }
+  double insert_ns = now_ns() - start;
+  start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    rbtree_erase(t, rbtree_find(t, shuffled[i]));
+  }
+  double find_erase_ns = now_ns() - start;
+  delete_rbtree(t);
+
+  t = new_rbtree();
+  node_t *hint = NULL;
+  start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    hint = rbtree_insert_hint(t, hint, keys[i]);
+  }
+  double hint_ns = now_ns() - start;
+  start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    rbtree_erase_key(t, shuffled[i]);
+  }
+  double erase_key_ns = now_ns() - start;
+  delete_rbtree(t);
+
+  printf("hint n=%zu late=%zu%%  shuffled insert %.1f ns  insert %.1f ns  insert_hint %.1f ns  "
+         "find+erase %.1f ns  erase_key %.1f ns\n",
+         n, late_percent, random_ns / n, insert_ns / n, hint_ns / n,
+         find_erase_ns / n, erase_key_ns / n);
+  free(shuffled);
+  free(keys);
+  return 0;
+}
+
+/**
+ * benchmark 비교용 binary min-heap.
+*/
+typedef struct {
+  key_t *keys;
+  size_t count;
+} key_heap;
+
+static void heap_push(key_heap *h, key_t key) {
+  size_t i = h->count++;
+  while(i > 0 && key < h->keys[(i - 1) / 2]) {
+    h->keys[i] = h->keys[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  h->keys[i] = key;
+}
+
+static key_t heap_pop(key_heap *h) {
+  key_t top = h->keys[0];
+  key_t last = h->keys[--h->count];
+  size_t i = 0;
+  for(;;) {
+    size_t child = 2 * i + 1;
+    if(child >= h->count) break;
+    if(child + 1 < h->count && h->keys[child + 1] < h->keys[child]) child++;
+    if(!(h->keys[child] < last)) break;
+    h->keys[i] = h->keys[child];
+    i = child;
+  }
+  h->keys[i] = last;
+  return top;
+}
+
+/**
+ * priority queue benchmark. (hold model)
+ * N개의 key를 넣은 뒤 가장 작은 key를 꺼내고 그보다 조금 큰 key를 넣는 연산을 OPS번 반복한다.
+ * rbtree_min 후 rbtree_erase, rbtree_pop_min, binary heap의 연산당 시간을 비교한다.
+*/
+static int bench_pq(size_t n, size_t ops) {
+  srand(1);
+  key_t *keys = (key_t *)malloc(n * sizeof(key_t));
+  key_t *steps = (key_t *)malloc(ops * sizeof(key_t));
+  key_heap h = {(key_t *)malloc(n * sizeof(key_t)), 0};
+  if(keys == NULL || steps == NULL || h.keys == NULL) {
+    free(h.keys);
+    free(steps);
+    free(keys);
+    return out_of_memory("pq");
+  }
+  for(size_t i = 0; i < n; i++) {
+    keys[i] = rand() % (int)(n * 4);
+  }
+  for(size_t i = 0; i < ops; i++) {
+    steps[i] = 1 + rand() % (int)(n * 4);
+  }
+
+  key_t check[3] = {0, 0, 0};
+  rbtree *t = new_rbtree();
+  for(size_t i = 0; i < n; i++) {
+    rbtree_insert(t, keys[i]);
+  }
+  double start = now_ns();
+  for(size_t i = 0; i < ops; i++) {
+    node_t *min = rbtree_min(t);
+    key_t key = min->key;
+    rbtree_erase(t, min);
+    rbtree_insert(t, key + steps[i]);
+    check[0] += key;
+  }
+  double erase_ns = now_ns() - start;
+  delete_rbtree(t);
+
+  t = new_rbtree();
+  for(size_t i = 0; i < n; i++) {
+    rbtree_insert(t, keys[i]);
+  }
+  start = now_ns();
+  for(size_t i = 0; i < ops; i++) {
+    key_t key;
+    rbtree_pop_min(t, &key);
+    rbtree_insert(t, key + steps[i]);
+    check[1] += key;
+  }
+  double pop_ns = now_ns() - start;
+  delete_rbtree(t);
+
+  for(size_t i = 0; i < n; i++) {
+    heap_push(&h, keys[i]);
+  }
+  start = now_ns();
+  for(size_t i = 0; i < ops; i++) {
+    key_t key = heap_pop(&h);
+    heap_push(&h, key + steps[i]);
+    check[2] += key;
+  }
+  double heap_ns = now_ns() - start;
+  free(h.keys);
+
+  printf("pq n=%zu ops=%zu  min+erase %.1f ns  pop_min %.1f ns  binary heap %.1f ns  %s\n",
+         n, ops, erase_ns / ops, pop_ns / ops, heap_ns / ops,
+         check[0] == check[1] && check[1] == check[2] ? "same" : "MISMATCH");
+  free(steps);
+  free(keys);
+  return 0;
+}
+
+/**
+ * 중복 key benchmark.
+ * 서로 다른 key가 DISTINCT개뿐인 N개의 random key를 insert, find, erase하고 node 수, 높이, 최대 RSS를 출력한다.
+ * RBTREE_COUNTED build(driver-counted)와 비교하면 같은 key를 node 하나에 모은 효과를 볼 수 있다.
+*/
+static int bench_dups(size_t n, size_t distinct) {
+  srand(1);
+  key_t *keys = (key_t *)malloc(n * sizeof(key_t));
+  if(keys == NULL) return out_of_memory("dups");
+  for(size_t i = 0; i < n; i++) {
+    keys[i] = rand() % (int)distinct;
+  }
+
+  rbtree *t = new_rbtree();
+  double start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    rbtree_insert(t, keys[i]);
+  }
+  double insert_ns = now_ns() - start;
+
+  size_t nodes = 0;
+  for(node_t *p = rbtree_min(t); p != NULL && p != t->nil; p = rbtree_next(t, p)) {
+    nodes++;
+  }
+  size_t height = 0;
+  for(node_t *p = rbtree_min(t); p != t->nil; p = rbtree_parent(p)) {
+    height++;
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  size_t found = 0;
+  start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    found += rbtree_find(t, keys[i]) != NULL;
+  }
+  double find_ns = now_ns() - start;
+
+  start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    rbtree_erase_key(t, keys[i]);
+  }
+  double erase_ns = now_ns() - start;
+
+  printf("dups n=%zu distinct=%zu  nodes %zu  min depth %zu  insert %.1f ns  find %.1f ns  erase %.1f ns  maxrss %ld MiB  %s\n",
+         n, distinct, nodes, height, insert_ns / n, find_ns / n, erase_ns / n, usage.ru_maxrss / 1024,
+         found == n && rbtree_size(t) == 0 ? "ok" : "MISMATCH");
+  delete_rbtree(t);
+  free(keys);
+  return 0;
+}
+
+/**
+ * rbtree와 B+tree backend 비교 benchmark.
+ * 같은 N개의 random key로 insert, find, erase(key로 찾아 삭제)의 key당 시간을 잰다.
+*/
+static int bench_btree(size_t n) {
+  srand(1);
+  key_t *keys = (key_t *)malloc(n * sizeof(key_t));
+  key_t *probes = (key_t *)malloc(n * sizeof(key_t));
+  if(keys == NULL || probes == NULL) {
+    free(probes);
+    free(keys);
+    return out_of_memory("btree");
+  }
+  for(size_t i = 0; i < n; i++) {
+    keys[i] = rand();
+  }
+  // find는 삽입 순서와 다른 순서로 찾는다
+  for(size_t i = 0; i < n; i++) {
+    probes[i] = keys[(size_t)rand() % n];
+  }
+
+  rbtree *t = new_rbtree();
+  double start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    rbtree_insert(t, keys[i]);
+  }
+  double insert_ns = now_ns() - start;
+  size_t found = 0;
+  start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    found += rbtree_find(t, probes[i]) != NULL;
+  }
+  double find_ns = now_ns() - start;
+  start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    rbtree_erase_key(t, keys[i]);
+  }
+  double erase_ns = now_ns() - start;
+  delete_rbtree(t);
+  printf("btree rbtree n=%zu  insert %.1f ns  find %.1f ns  erase %.1f ns  found=%zu\n",
+         n, insert_ns / n, find_ns / n, erase_ns / n, found);
+
+  btree *b = new_btree();
+  start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    btree_insert(b, keys[i]);
+  }
+  insert_ns = now_ns() - start;
+  found = 0;
+  start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    found += btree_find(b, probes[i]) != NULL;
+  }
+  find_ns = now_ns() - start;
+  start = now_ns();
+  for(size_t i = 0; i < n; i++) {
+    btree_erase(b, keys[i]);
+  }
+  erase_ns = now_ns() - start;
+  delete_btree(b);
+  printf("btree btree  n=%zu  insert %.1f ns  find %.1f ns  erase %.1f ns  found=%zu  (order %d)\n",
+         n, insert_ns / n, find_ns / n, erase_ns / n, found, BTREE_ORDER);
+
+  free(probes);
+  free(keys);
+  return 0;
+}
+
+/**
+ * latency histogram.
+ * [2^k, 2^(k+1)) ns 구간을 HIST_SUB개로 나누는 log-linear bucket이며, 상대 오차는 1/HIST_SUB 이하이다.
+*/
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (64 * HIST_SUB)
+
+typedef struct {
+  uint64_t counts[HIST_BUCKETS];
+  uint64_t total;
+  double elapsed_ns;   // 측정한 op들의 수행 시간 합
+} latency_hist;
+
+static int hist_bucket(uint64_t ns) {
+  if(ns < HIST_SUB) return (int)ns;
+  int msb = 63 - __builtin_clzll(ns);
+  int shift = msb - HIST_SUB_BITS;
+  return ((shift + 1) << HIST_SUB_BITS) + (int)((ns >> shift) & (HIST_SUB - 1));
+}
+
+/**
+ * BUCKET에 들어가는 가장 큰 값을 return하는 함수.
+*/
+static uint64_t hist_bucket_max(int bucket) {
+  if(bucket < HIST_SUB) return (uint64_t)bucket;
+  int shift = (bucket >> HIST_SUB_BITS) - 1;
+  uint64_t mantissa = HIST_SUB + (bucket & (HIST_SUB - 1));
+  return ((mantissa + 1) << shift) - 1;
+}
+
+static void hist_add(latency_hist *h, double ns) {
+  h->counts[hist_bucket(ns > 0 ? (uint64_t)ns : 0)]++;
+  h->total++;
+  h->elapsed_ns += ns;
+}
+
+/**
+ * 측정값의 Q 분위수(0 < Q <= 1)를 return하는 함수.
+*/
+static uint64_t hist_percentile(const latency_hist *h, double q) {
+  uint64_t target = (uint64_t)ceil(q * h->total);
+  uint64_t seen = 0;
+  for(int i = 0; i < HIST_BUCKETS; i++) {
+    seen += h->counts[i];
+    if(seen >= target && seen > 0) return hist_bucket_max(i);
+  }
+  return 0;
+}
+
+/**
+ * 재현 가능한 workload를 위한 난수 생성기. (xorshift64*)
+*/
+static uint64_t rng_state = 1;
+
+static uint64_t rng_next(void) {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 2685821657736338717ull;
+}
+
+static void rng_seed(uint64_t seed) {
+  rng_state = seed * 0x9e3779b97f4a7c15ull + 1;
+}
+
+/**
+ * [0, N) 범위의 zipfian 분포 난수 생성기. (Gray et al., "Quickly Generating Billion-Record Synthetic Databases")
+ * 0이 가장 자주 나온다.
+*/
+typedef struct {
+  size_t n;
+  double theta, alpha, zetan, eta;
+} zipf_gen;
+
+static void zipf_init(zipf_gen *z, size_t n, double theta) {
+  double zeta2 = 0;
+  z->zetan = 0;
+  for(size_t i = 1; i <= n; i++) {
+    z->zetan += 1.0 / pow((double)i, theta);
+    if(i == 2) zeta2 = z->zetan;
+  }
+  z->n = n;
+  z->theta = theta;
+  z->alpha = 1.0 / (1.0 - theta);
+  z->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+}
+
+static size_t zipf_next(const zipf_gen *z) {
+  double u = (double)(rng_next() >> 11) / (double)(1ull << 53);
+  double uz = u * z->zetan;
+  if(uz < 1.0) return 0;
+  if(uz < 1.0 + pow(0.5, z->theta)) return 1 < z->n ? 1 : 0;
+  size_t v = (size_t)(z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+  return v < z->n ? v : z->n - 1;
+}
+
+enum { OP_INSERT, OP_FIND, OP_ERASE, OP_MINMAX, OP_TO_ARRAY, OP_KINDS };
+static const char *op_names[OP_KINDS] = {"insert", "find", "erase", "minmax", "to_array"};
+
+typedef struct {
+  const char *workload;
+  size_t n;           // tree에 넣는 key 수
+  size_t ops;         // find 또는 mix op 수
+  int read_pct;       // mix workload의 find 비율 (%)
+  double theta;       // zipf workload의 skew
+  uint64_t seed;
+  FILE *csv;
+} bench_config;
+
+#define TO_ARRAY_REPS 5
+
+/**
+ * workload의 결과를 출력하는 함수. to_array는 key 단위로 throughput을 계산한다.
+*/
+static void bench_report(const bench_config *cfg, latency_hist *hists) {
+  for(int op = 0; op < OP_KINDS; op++) {
+    const latency_hist *h = &hists[op];
+    if(h->total == 0) continue;
+    double units = op == OP_TO_ARRAY ? (double)h->total * cfg->n : (double)h->total;
+    double mops = units / h->elapsed_ns * 1e3;
+    uint64_t p50 = hist_percentile(h, 0.5), p99 = hist_percentile(h, 0.99), p999 = hist_percentile(h, 0.999);
+    printf("%-10s %-9s count=%-9llu %9.2f Mops/s  p50 %6llu  p99 %6llu  p999 %6llu ns\n",
+           cfg->workload, op_names[op], (unsigned long long)h->total, mops,
+           (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)p999);
+    if(cfg->csv != NULL) {
+      fprintf(cfg->csv, "%s,%s,%zu,%zu,%llu,%.3f,%.1f,%llu,%llu,%llu\n",
+              cfg->workload, op_names[op], sizeof(node_t), cfg->n, (unsigned long long)h->total, mops,
+              h->elapsed_ns / h->total, (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)p999);
+    }
+  }
+}
+
+#ifdef RBTREE_STATS
+/**
+ * RBTREE_STATS로 빌드한 driver에서 T의 counter와 모양을 출력한다.
+*/
+static void print_tree_stats(const char *workload, const rbtree *t) {
+  rbtree_statistics st = rbtree_stats(t);
+  const rbtree_counters *c = &st.counters;
+  printf("%-10s stats     size=%zu height=%zu black_height=%zu  rotations L=%llu R=%llu  "
+         "fixup insert=%llu erase=%llu  find cmp avg=%.2f max=%llu\n",
+         workload, st.size, st.height, st.black_height,
+         (unsigned long long)c->left_rotations, (unsigned long long)c->right_rotations,
+         (unsigned long long)c->insert_fixup_iterations, (unsigned long long)c->erase_fixup_iterations,
+         c->finds ? (double)c->find_comparisons / c->finds : 0.0, (unsigned long long)c->find_max_comparisons);
+}
+#endif
+
+/**
+ * load workload: N개의 key를 insert하고, OPS번 find, min/max, to_array를 수행한 뒤 모든 key를 erase한다.
+ * sequential은 0..N-1을 순서대로, random은 random key를, duplicate는 N/64 종류의 key를 사용한다.
+ * zipfian은 random key를 넣고 find할 key를 zipfian 분포로 고른다.
+*/
+static int bench_load_workload(const bench_config *cfg, latency_hist *hists) {
+  const size_t n = cfg->n;
+  const int sequential = strcmp(cfg->workload, "sequential") == 0;
+  const int duplicate = strcmp(cfg->workload, "duplicate") == 0;
+  const int zipfian = strcmp(cfg->workload, "zipfian") == 0;
+  key_t *keys = (key_t *)malloc(n * sizeof(key_t));
+  key_t *out = (key_t *)malloc(n * sizeof(key_t));
+  if(keys == NULL || out == NULL) {
+    free(out);
+    free(keys);
+    return out_of_memory(cfg->workload);
+  }
+  for(size_t i = 0; i < n; i++) {
+    if(sequential) keys[i] = (key_t)i;
+    else if(duplicate) keys[i] = (key_t)(rng_next() % (n / 64 + 1));
+    else keys[i] = (key_t)(rng_next() & 0x7fffffff);
+  }
+  zipf_gen zipf = {0};
+  if(zipfian) zipf_init(&zipf, n, cfg->theta);
+
+  rbtree *t = new_rbtree();
+  for(size_t i = 0; i < n; i++) {
+    double start = now_ns();
+    rbtree_insert(t, keys[i]);
+    hist_add(&hists[OP_INSERT], now_ns() - start);
+  }
+
+  size_t found = 0;
+  for(size_t i = 0; i < cfg->ops; i++) {
+    key_t key;
+    if(sequential) key = keys[i % n];
+    else if(zipfian) key = keys[zipf_next(&zipf)];
+    else key = keys[rng_next() % n];
+    double start = now_ns();
+    found += rbtree_find(t, key) != NULL;
+    hist_add(&hists[OP_FIND], now_ns() - start);
+  }
+
+  for(size_t i = 0; i < cfg->ops; i++) {
+    double start = now_ns();
+    node_t *p = (i & 1) ? rbtree_max(t) : rbtree_min(t);
+    hist_add(&hists[OP_MINMAX], now_ns() - start);
+    found += p != NULL;
+  }
+
+  for(int rep = 0; rep < TO_ARRAY_REPS; rep++) {
+    double start = now_ns();
+    rbtree_to_array(t, out, n);
+    hist_add(&hists[OP_TO_ARRAY], now_ns() - start);
+  }
+#ifdef RBTREE_STATS
+  print_tree_stats(cfg->workload, t);
+#endif
+
+  for(size_t i = 0; i < n; i++) {
+    node_t *p = rbtree_find(t, keys[i]);
+    double start = now_ns();
+    rbtree_erase(t, p);
+    hist_add(&hists[OP_ERASE], now_ns() - start);
+  }
+
+  if(found != cfg->ops * 2) {
+    fprintf(stderr, "%s: %zu of %zu lookups failed\n", cfg->workload, cfg->ops * 2 - found, cfg->ops * 2);
+  }
+  delete_rbtree(t);
+  free(out);
+  free(keys);
+  return 0;
+}
+
+/**
+ * mix workload: N개의 random key로 채운 tree에 OPS개의 op를 수행한다.
+ * READ_PCT% 는 살아 있는 key의 find이고, 나머지는 임의의 node 하나를 erase하고 새 key를 insert한다. (tree 크기 유지)
+ * churn은 READ_PCT가 0인 mix이다.
+*/
+static int bench_mix_workload(const bench_config *cfg, latency_hist *hists) {
+  const size_t n = cfg->n;
+  node_t **live = (node_t **)malloc(n * sizeof(node_t *));
+  if(live == NULL) return out_of_memory(cfg->workload);
+  rbtree *t = new_rbtree();
+  for(size_t i = 0; i < n; i++) {
+    live[i] = rbtree_insert(t, (key_t)(rng_next() & 0x7fffffff));
+  }
+
+  size_t found = 0, reads = 0;
+  for(size_t i = 0; i < cfg->ops; i++) {
+    size_t slot = rng_next() % n;
+    if((int)(rng_next() % 100) < cfg->read_pct) {
+      key_t key = live[slot]->key;
+      double start = now_ns();
+      found += rbtree_find(t, key) != NULL;
+      hist_add(&hists[OP_FIND], now_ns() - start);
+      reads++;
+      continue;
+    }
+    key_t key = (key_t)(rng_next() & 0x7fffffff);
+    double start = now_ns();
+    rbtree_erase(t, live[slot]);
+    double mid = now_ns();
+    live[slot] = rbtree_insert(t, key);
+    double end = now_ns();
+    hist_add(&hists[OP_ERASE], mid - start);
+    hist_add(&hists[OP_INSERT], end - mid);
+  }
+
+  if(found != reads) {
+    fprintf(stderr, "%s: %zu of %zu lookups failed\n", cfg->workload, reads - found, reads);
+  }
+#ifdef RBTREE_STATS
+  print_tree_stats(cfg->workload, t);
+#endif
+  free(live);
+  delete_rbtree(t);
+  return 0;
+}
+
+static const char *bench_workloads[] = {"sequential", "random", "zipfian", "duplicate", "mix", "churn"};
+#define BENCH_WORKLOADS (sizeof(bench_workloads) / sizeof(bench_workloads[0]))
+
+static int bench_run(bench_config cfg) {
+  latency_hist *hists = (latency_hist *)calloc(OP_KINDS, sizeof(latency_hist));
+  if(hists == NULL) return 1;
+  rng_seed(cfg.seed);
+  int status;
+  if(strcmp(cfg.workload, "mix") == 0) {
+    status = bench_mix_workload(&cfg, hists);
+  } else if(strcmp(cfg.workload, "churn") == 0) {
+    cfg.read_pct = 0;
+    status = bench_mix_workload(&cfg, hists);
+  } else {
+    status = bench_load_workload(&cfg, hists);
+  }
+  if(status == 0) bench_report(&cfg, hists);
+  free(hists);
+  return status;
+}
+
+static void bench_usage(const char *prog) {
+  fprintf(stderr, "usage: %s bench [-w workload] [-n keys] [-o ops] [-r read%%] [-z theta] [-s seed] [-c csv]\n", prog);
+  fprintf(stderr, "  workload: all, sequential, random, zipfian, duplicate, mix, churn (default all)\n");
+}
+
+/**
+ * workload benchmark. 각 op의 throughput과 p50/p99/p999 latency를 출력하고,
+ * -c로 CSV 파일을 주면 결과를 덧붙인다. (파일이 비어 있으면 header도 쓴다)
+*/
+static int bench_main(const char *prog, int argc, char *argv[]) {
+  bench_config cfg = {"all", 1000000, 0, 90, 0.99, 1, NULL};
+  const char *csv_path = NULL;
+  int opt;
+  while((opt = getopt(argc, argv, "w:n:o:r:z:s:c:")) != -1) {
+    switch(opt) {
+      case 'w': cfg.workload = optarg; break;
+      case 'n': cfg.n = strtoul(optarg, NULL, 10); break;
+      case 'o': cfg.ops = strtoul(optarg, NULL, 10); break;
+      case 'r': cfg.read_pct = atoi(optarg); break;
+      case 'z': cfg.theta = atof(optarg); break;
+      case 's': cfg.seed = strtoull(optarg, NULL, 10); break;
+      case 'c': csv_path = optarg; break;
+      default:
+        bench_usage(prog);
+        return 1;
+    }
+  }
+  if(cfg.n == 0 || cfg.read_pct < 0 || cfg.read_pct > 100 || cfg.theta <= 0 || cfg.theta >= 1) {
+    bench_usage(prog);
+    return 1;
+  }
+  if(cfg.ops == 0) cfg.ops = cfg.n;
+
+  if(csv_path != NULL) {
+    cfg.csv = fopen(csv_path, "a");
+    if(cfg.csv == NULL) {
+      perror(csv_path);
+      return 1;
+    }
+    if(ftell(cfg.csv) == 0) {
+      fprintf(cfg.csv, "workload,op,node_bytes,n,count,mops,mean_ns,p50_ns,p99_ns,p999_ns\n");
+    }
+  }
+
+  int status = 0;
+  if(strcmp(cfg.workload, "all") == 0) {
+    for(size_t i = 0; i < BENCH_WORKLOADS && status == 0; i++) {
+      cfg.workload = bench_workloads[i];
+      status = bench_run(cfg);
+    }
+  } else {
+    size_t i = 0;
+    while(i < BENCH_WORKLOADS && strcmp(cfg.workload, bench_workloads[i]) != 0) i++;
+    if(i == BENCH_WORKLOADS) {
+      bench_usage(prog);
+      status = 1;
+    } else {
+      status = bench_run(cfg);
+    }
+  }
+
+  if(cfg.csv != NULL) fclose(cfg.csv);
+  return status;
+}
+
+/**
+ * 여러 thread가 하나의 tree를 읽는 benchmark.
+ * 전역 mutex로 감싼 rbtree, rbtree_sync, rbtree_persist를 비교한다.
+ * rbtree_persist reader는 snapshot 하나로 SNAPSHOT_READS번 find한다.
+*/
+#define SNAPSHOT_READS 64
+
+typedef struct {
+  rbtree *tree;
+  pthread_mutex_t *mutex;   // mutex mode에서만 사용
+  rbtree_sync *sync;
+  rbtree_persist *persist;
+  size_t n;
+  volatile int stop;
+} shared_bench;
+
+typedef struct {
+  shared_bench *shared;
+  unsigned int seed;
+  size_t ops;
+} thread_bench;
+
+static void *sync_reader_main(void *arg) {
+  thread_bench *b = (thread_bench *)arg;
+  shared_bench *sh = b->shared;
+  size_t found = 0;
+  while(!sh->stop) {
+    if(sh->persist != NULL) {
+      rbtree_snapshot snap = rbtree_persist_snapshot(sh->persist);
+      for(int i = 0; i < SNAPSHOT_READS; i++) {
+        found += rbtree_snapshot_find(&snap, (key_t)(rand_r(&b->seed) % sh->n) * 2);
+      }
+      rbtree_snapshot_release(&snap);
+      b->ops += SNAPSHOT_READS;
+      continue;
+    }
+    key_t key = (key_t)(rand_r(&b->seed) % sh->n) * 2;
+    if(sh->mutex != NULL) {
+      pthread_mutex_lock(sh->mutex);
+      found += rbtree_find(sh->tree, key) != NULL;
+      pthread_mutex_unlock(sh->mutex);
+    } else {
+      found += rbtree_sync_find(sh->sync, key);
+    }
+    b->ops++;
+  }
+  if(found != b->ops) fprintf(stderr, "sync: %zu lookups failed\n", b->ops - found);
+  return NULL;
+}
+
+static void *sync_writer_main(void *arg) {
+  thread_bench *b = (thread_bench *)arg;
+  shared_bench *sh = b->shared;
+  while(!sh->stop) {
+    // 홀수 key만 넣고 지우므로 reader가 찾는 짝수 key는 항상 있다
+    key_t key = (key_t)(rand_r(&b->seed) % sh->n) * 2 + 1;
+    if(sh->mutex != NULL) {
+      pthread_mutex_lock(sh->mutex);
+      node_t *p = rbtree_find(sh->tree, key);
+      if(p != NULL) rbtree_erase(sh->tree, p);
+      else rbtree_insert(sh->tree, key);
+      pthread_mutex_unlock(sh->mutex);
+    } else if(sh->persist != NULL) {
+      if(rbtree_persist_erase(sh->persist, key) != 0) {
+        rbtree_persist_insert(sh->persist, key);
+      }
+    } else if(rbtree_sync_erase(sh->sync, key) != 0) {
+      rbtree_sync_insert(sh->sync, key);
+    }
+    b->ops++;
+  }
+  return NULL;
+}
+
+static int bench_sync(size_t n, size_t readers, size_t writers, double seconds) {
+  const char *modes[] = {"mutex", "sync", "persist"};
+  size_t threads = readers + writers;
+  pthread_t *tids = (pthread_t *)calloc(threads, sizeof(pthread_t));
+  thread_bench *benches = (thread_bench *)calloc(threads, sizeof(thread_bench));
+  if(tids == NULL || benches == NULL) {
+    free(benches);
+    free(tids);
+    return out_of_memory("sync");
+  }
+  for(int mode = 0; mode < 3; mode++) {
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    shared_bench sh = {.n = n};
+    if(mode == 0) {
+      sh.tree = new_rbtree();
+      sh.mutex = &mutex;
+      for(size_t i = 0; i < n; i++) rbtree_insert(sh.tree, (key_t)i * 2);
+    } else if(mode == 1) {
+      sh.sync = new_rbtree_sync();
+      for(size_t i = 0; i < n; i++) rbtree_sync_insert(sh.sync, (key_t)i * 2);
+    } else {
+      sh.persist = new_rbtree_persist();
+      for(size_t i = 0; i < n; i++) rbtree_persist_insert(sh.persist, (key_t)i * 2);
+    }
+
+    for(size_t i = 0; i < threads; i++) {
+      benches[i] = (thread_bench){&sh, (unsigned int)i + 1, 0};
+      pthread_create(&tids[i], NULL, i < readers ? sync_reader_main : sync_writer_main, &benches[i]);
+    }
+    struct timespec duration = {(time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9)};
+    nanosleep(&duration, NULL);
+    sh.stop = 1;
+
+    size_t reads = 0, writes = 0;
+    for(size_t i = 0; i < threads; i++) {
+      pthread_join(tids[i], NULL);
+      if(i < readers) reads += benches[i].ops;
+      else writes += benches[i].ops;
+    }
+    printf("sync %-7s n=%zu readers=%zu writers=%zu  read %.2f Mops/s  write %.2f Mops/s\n",
+           modes[mode], n, readers, writers, reads / seconds / 1e6, writes / seconds / 1e6);
+
+    if(mode == 0) delete_rbtree(sh.tree);
+    else if(mode == 1) delete_rbtree_sync(sh.sync);
+    else delete_rbtree_persist(sh.persist);
+  }
+  free(benches);
+  free(tids);
+  return 0;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s bench [options]   (%s bench -h)\n", prog, prog);
+  fprintf(stderr, "       %s churn [size] [ops]\n", prog);
+  fprintf(stderr, "       %s rebuild [n] [cycles]\n", prog);
+  fprintf(stderr, "       %s layout [n]\n", prog);
+  fprintf(stderr, "       %s restart [n]\n", prog);
+  fprintf(stderr, "       %s load [n]\n", prog);
+  fprintf(stderr, "       %s batch [size] [batch]\n", prog);
+  fprintf(stderr, "       %s setops [n] [threads]\n", prog);
+  fprintf(stderr, "       %s sync [n] [readers] [writers] [seconds]\n", prog);
+  fprintf(stderr, "       %s btree [n]\n", prog);
+  fprintf(stderr, "       %s findmany [n] [batch]\n", prog);
+  fprintf(stderr, "       %s hint [n] [late_percent]\n", prog);
+  fprintf(stderr, "       %s pq [n] [ops]\n", prog);
+  fprintf(stderr, "       %s dups [n] [distinct]\n", prog);
+  fprintf(stderr, "       %s frozen [n]\n", prog);
+}
 
 int main(int argc, char *argv[]) {
+  if(argc < 2) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if(strcmp(argv[1], "bench") == 0) {
+    return bench_main(argv[0], argc - 1, argv + 1);
+  }
+
+  if(strcmp(argv[1], "churn") == 0) {
+    size_t size = argc > 2 ? strtoul(argv[2], NULL, 10) : 100000;
+    size_t ops = argc > 3 ? strtoul(argv[3], NULL, 10) : 1000000;
+    return bench_churn(size, ops);
+  }
+
+  if(strcmp(argv[1], "rebuild") == 0) {
+    size_t n = argc > 2 ? strtoul(argv[2], NULL, 10) : 100000;
+    size_t cycles = argc > 3 ? strtoul(argv[3], NULL, 10) : 100;
+    return bench_rebuild(n, cycles);
+  }
+
+  if(strcmp(argv[1], "layout") == 0) {
+    size_t n = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+    return bench_layout(n);
+  }
+
+  if(strcmp(argv[1], "restart") == 0) {
+    size_t n = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+    return bench_restart(n);
+  }
+
+  if(strcmp(argv[1], "load") == 0) {
+    size_t n = argc > 2 ? strtoul(argv[2], NULL, 10) : 10000000;
+    return bench_load(n);
+  }
+
+  if(strcmp(argv[1], "batch") == 0) {
+    size_t size = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+    size_t batch = argc > 3 ? strtoul(argv[3], NULL, 10) : 100000;
+    return bench_batch(size, batch);
+  }
+
+  if(strcmp(argv[1], "setops") == 0) {
+    size_t n = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+    size_t threads = argc > 3 ? strtoul(argv[3], NULL, 10) : 1;
+    return bench_setops(n, threads);
+  }
+
+  if(strcmp(argv[1], "sync") == 0) {
+    size_t n = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+    size_t readers = argc > 3 ? strtoul(argv[3], NULL, 10) : 1;
+    size_t writers = argc > 4 ? strtoul(argv[4], NULL, 10) : 0;
+    double seconds = argc > 5 ? atof(argv[5]) : 1.0;
+    return bench_sync(n, readers, writers, seconds);
+  }
+
+  if(strcmp(argv[1], "btree") == 0) {
+    size_t n = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+    return bench_btree(n);
+  }
+
+  if(strcmp(argv[1], "findmany") == 0) {
+    size_t n = argc > 2 ? strtoul(argv[2], NULL, 10) : 10000000;
+    size_t batch = argc > 3 ? strtoul(argv[3], NULL, 10) : 1000;
+    return bench_find_many(n, batch);
+  }
+
+  if(strcmp(argv[1], "hint") == 0) {
+    size_t n = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+    size_t late = argc > 3 ? strtoul(argv[3], NULL, 10) : 10;
+    return bench_hint(n, late);
+  }
+
+  if(strcmp(argv[1], "pq") == 0) {
+    size_t n = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+    size_t ops = argc > 3 ? strtoul(argv[3], NULL, 10) : 10000000;
+    return bench_pq(n, ops);
+  }
+
+  if(strcmp(argv[1], "dups") == 0) {
+    size_t n = argc > 2 ? strtoul(argv[2], NULL, 10) : 10000000;
+    size_t distinct = argc > 3 ? strtoul(argv[3], NULL, 10) : 1000;
+    return bench_dups(n, distinct);
+  }
+
+  if(strcmp(argv[1], "frozen") == 0) {
+    size_t n = argc > 2 ? strtoul(argv[2], NULL, 10) : 10000000;
+    return bench_frozen(n);
+  }
 
-}
\ No newline at end of file
+  usage(argv[0]);
+  return 1;
+}
@@ -2,389 +2,2641 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
-void init_nil(node_t *nil) {
-  nil->color = RBTREE_BLACK;
-  nil->key = 0;
-  nil->parent = NULL;
-  nil->left = NULL;
-  nil->right = NULL;
+#ifdef RBTREE_INDEX
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef RBTREE_PARALLEL
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#endif
+
+/**
+ * 모든 tree가 함께 쓰는 sentinel NIL.
+ * 
+ * tree 사이에서 node를 옮길 수 있도록(join, split, union 등) NIL은 하나만 두며,
+ * tree 연산은 NIL에 쓰지 않는다. NIL은 black이고 ORDER_STATS의 SIZE는 0이다.
+ * (RBTREE_INDEX layout에서는 node arena의 0번 node가 NIL이다.)
+*/
+#if defined(RBTREE_INDEX)
+#define NIL (rbtree_node_arena)
+#elif defined(RBTREE_COMPACT)
+static node_t nil_node = {.parent_color = RBTREE_BLACK};
+#define NIL (&nil_node)
+#else
+static node_t nil_node = {.color = RBTREE_BLACK};
+#define NIL (&nil_node)
+#endif
+
+/**
+ * RBTREE_STATS의 counter를 N만큼 늘린다. find처럼 T가 const인 연산에서도 센다.
+ * RBTREE_STATS가 아니면 아무 code도 만들지 않는다.
+*/
+#ifdef RBTREE_STATS
+#define STAT_ADD(t, field, n) (((rbtree *)(t))->counters.field += (n))
+#else
+#define STAT_ADD(t, field, n) ((void)0)
+#endif
+
+/**
+ * node slab의 chunk 하나.
+ * NODES에는 CAPACITY개의 node가 연속으로 배치된다.
+*/
+typedef struct node_chunk {
+  struct node_chunk *next;
+  size_t capacity;
+  node_t *nodes;
+} node_chunk;
+
+#define NODE_CHUNK_MIN 32
+#define NODE_CHUNK_MAX 8192
+
+/**
+ * tree가 소유하는 node slab allocator.
+ * 
+ * node는 chunk 단위로 한 번에 할당하고, erase된 node는 free list로 돌려보내 재사용한다.
+ * free list에는 node 하나뿐 아니라 subtree 전체를 root만으로 O(1)에 넣을 수 있다.
+ * free list는 parent link로 연결하며 NIL로 끝난다. 꺼낼 때 root의 자식들을 다시 free list에 넣는다.
+ * 
+ * rbtree_clear로 비운 chunk는 SPARE에 보관했다가 새 chunk를 할당하기 전에 다시 사용한다.
+ * 
+ * split으로 만든 tree는 원래 tree와 pool을 공유한다. (REFS)
+ * 서로 다른 pool의 tree를 합치면 한쪽 pool의 chunk를 다른 pool로 옮기고,
+ * 비워진 pool은 FORWARD로 합쳐진 pool을 가리킨다. tree는 다음 접근 때 FORWARD를 따라 옮겨간다.
+ * 비워진 pool을 tree 하나만 쓰고 있었으면 forwarding 없이 그 tree의 빈 pool로 남는다.
+ * pool에는 lock이 없으므로 pool을 공유하는 tree들은 서로 다른 thread에서 동시에 수정하거나 삭제하면 안 된다.
+*/
+struct node_pool {
+  node_chunk *chunks;   // 가장 최근에 할당한 chunk가 head
+  size_t used;          // head chunk에서 사용한 node 수
+  node_chunk *spare;    // 비어 있는 chunk들
+  node_t *free_list;
+  node_t *free_tail;
+  size_t refs;          // 이 pool을 가리키는 tree와 forwarding pool의 수
+  node_pool *forward;
+};
+
+#ifdef RBTREE_INDEX
+/**
+ * RBTREE_INDEX layout의 process 전역 node arena.
+ * 
+ * link가 32-bit index이므로 모든 tree의 node는 하나의 연속된 가상 주소 공간에 있어야 한다.
+ * 처음 사용할 때 NODE_ARENA_CAPACITY개 분량의 주소 공간을 예약하고, 실제 page는 접근할 때 할당된다.
+ * 0번 node는 NIL이며, tree의 chunk는 그 뒤에서 잘라낸다.
+ * 
+ * 반환된 chunk는 주소 순으로 정렬된 빈 구간 목록(ARENA_FREE)에 넣고 이웃한 빈 구간과 합친다.
+ * 구간은 크기와 상관없이 잘라 쓰므로 큰 block이 반환된 자리를 작은 chunk들이 다시 쓸 수 있고,
+ * 맨 끝의 빈 구간은 ARENA_TOP을 낮춘다. 반환된 chunk가 차지하던 page는 madvise로 OS에 돌려준다.
+*/
+#define NODE_ARENA_CAPACITY ((size_t)1 << 31)   // parent index가 31 bit이므로
+
+node_t *rbtree_node_arena;
+static size_t arena_top = 1;
+static node_chunk *arena_free;   // chunk header를 빈 구간의 descriptor로 쓴다
+static node_chunk *arena_headers;   // 구간을 합치며 남은 header. malloc 대신 다시 쓴다
+static size_t arena_page_size;
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void init_node_arena(void) {
+  void *base = mmap(NULL, NODE_ARENA_CAPACITY * sizeof(node_t), PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if(base != MAP_FAILED) {
+    rbtree_node_arena = (node_t *)base;
+    rbtree_set_color(NIL, RBTREE_BLACK);   // link는 0(자기 자신), SIZE는 0
+  }
+  arena_page_size = (size_t)sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * chunk header 하나를 꺼내거나 돌려놓는 함수. ARENA_LOCK을 잡은 채로 부른다.
+*/
+static node_chunk *take_header(void) {
+  node_chunk *header = arena_headers;
+  if(header == NULL) return (node_chunk *)malloc(sizeof(node_chunk));
+  arena_headers = header->next;
+  return header;
+}
+
+static void put_header(node_chunk *header) {
+  header->next = arena_headers;
+  arena_headers = header;
+}
+
+/**
+ * CAPACITY개의 node를 ARENA_FREE에서 first fit으로 잘라내거나, 없으면 ARENA_TOP 위에서 잘라낸다.
+*/
+node_chunk *alloc_chunk(size_t capacity) {
+  capacity = (capacity + NODE_CHUNK_MIN - 1) / NODE_CHUNK_MIN * NODE_CHUNK_MIN;
+  node_chunk *chunk = NULL;
+  pthread_mutex_lock(&arena_lock);
+  for(node_chunk **link = &arena_free; *link != NULL; link = &(*link)->next) {
+    node_chunk *range = *link;
+    if(range->capacity < capacity) continue;
+    if(range->capacity == capacity) {
+      *link = range->next;
+      chunk = range;
+    } else {
+      chunk = take_header();
+      if(chunk == NULL) break;
+      chunk->capacity = capacity;
+      chunk->nodes = range->nodes;
+      range->nodes += capacity;
+      range->capacity -= capacity;
+    }
+    break;
+  }
+  if(chunk == NULL && arena_top + capacity <= NODE_ARENA_CAPACITY) {
+    chunk = take_header();
+    if(chunk != NULL) {
+      chunk->capacity = capacity;
+      chunk->nodes = rbtree_node_arena + arena_top;
+      arena_top += capacity;
+    }
+  }
+  pthread_mutex_unlock(&arena_lock);
+  return chunk;
+}
+
+/**
+ * [BEGIN, END) 중 FREE_BEGIN..FREE_END 안에 완전히 들어 있는 page들을 OS에 돌려주는 함수.
+ * 반환한 chunk에 걸친 page만 다루므로, 이미 돌려준 구간을 다시 훑지 않는다.
+*/
+static void release_arena_pages(const node_t *begin, const node_t *end, const node_t *free_begin, const node_t *free_end) {
+  uintptr_t lo = (uintptr_t)begin / arena_page_size * arena_page_size;
+  uintptr_t hi = ((uintptr_t)end + arena_page_size - 1) / arena_page_size * arena_page_size;
+  if(lo < (uintptr_t)free_begin) lo += arena_page_size;
+  if(hi > (uintptr_t)free_end) hi -= arena_page_size;
+  if(lo < hi) madvise((void *)lo, hi - lo, MADV_DONTNEED);
+}
+
+/**
+ * CHUNK를 ARENA_FREE의 주소 순 위치에 넣고 앞뒤의 빈 구간과 합치는 함수.
+ * 합친 구간이 ARENA_TOP에 닿으면 ARENA_TOP을 낮춘다.
+*/
+void free_chunk(node_chunk *chunk) {
+  node_t *begin = chunk->nodes;
+  node_t *end = chunk->nodes + chunk->capacity;
+  pthread_mutex_lock(&arena_lock);
+  node_chunk *prev = NULL;
+  node_chunk **link = &arena_free;
+  while(*link != NULL && (*link)->nodes < begin) {
+    prev = *link;
+    link = &prev->next;
+  }
+  node_chunk *next = *link;
+  if(prev != NULL && prev->nodes + prev->capacity == begin) {
+    prev->capacity += chunk->capacity;
+    put_header(chunk);
+    chunk = prev;
+  } else {
+    chunk->next = next;
+    *link = chunk;
+  }
+  if(next != NULL && chunk->nodes + chunk->capacity == next->nodes) {
+    chunk->capacity += next->capacity;
+    chunk->next = next->next;
+    put_header(next);
+  }
+
+  // page는 lock을 잡은 채로 돌려준다. 풀어 준 뒤에는 다른 thread가 이 구간을 잘라 쓸 수 있다.
+  release_arena_pages(begin, end, chunk->nodes, chunk->nodes + chunk->capacity);
+  if(chunk->next == NULL && chunk->nodes + chunk->capacity == rbtree_node_arena + arena_top) {
+    arena_top = (size_t)(chunk->nodes - rbtree_node_arena);
+    node_chunk **last = &arena_free;
+    while(*last != chunk) last = &(*last)->next;
+    *last = NULL;
+    put_header(chunk);
+  }
+  pthread_mutex_unlock(&arena_lock);
+}
+#else
+/**
+ * chunk header와 node 배열을 한 번의 malloc으로 할당한다.
+*/
+node_chunk *alloc_chunk(size_t capacity) {
+  node_chunk *chunk = (node_chunk *)malloc(sizeof(node_chunk) + capacity * sizeof(node_t));
+  if(chunk == NULL) return NULL;
+  chunk->capacity = capacity;
+  chunk->nodes = (node_t *)(chunk + 1);
+  return chunk;
+}
+
+void free_chunk(node_chunk *chunk) {
+  free(chunk);
+}
+#endif
+
+node_pool *new_node_pool(void) {
+  node_pool *pool = (node_pool *)calloc(1, sizeof(node_pool));
+  if(pool == NULL) return NULL;
+  pool->free_list = NIL;
+  pool->free_tail = NIL;
+  pool->refs = 1;
+  return pool;
+}
+
+/**
+ * POOL의 참조를 하나 놓는 함수.
+ * 마지막 참조였다면 POOL이 할당한 모든 chunk를 반환한다. 각 node를 순회하지 않고 chunk 단위로 반환한다.
+*/
+static void free_chunk_list(node_chunk *chunk) {
+  while(chunk != NULL) {
+    node_chunk *next = chunk->next;
+    free_chunk(chunk);
+    chunk = next;
+  }
+}
+
+void release_node_pool(node_pool *pool) {
+  while(pool != NULL && --pool->refs == 0) {
+    node_pool *forward = pool->forward;
+    free_chunk_list(pool->chunks);
+    free_chunk_list(pool->spare);
+    free(pool);
+    pool = forward;   // forwarding pool은 합쳐진 pool의 참조를 하나 갖고 있다
+  }
+}
+
+/**
+ * T가 사용하는 pool을 return하는 함수.
+ * T의 pool이 다른 pool에 합쳐졌으면 T가 합쳐진 pool을 직접 가리키도록 옮긴다.
+*/
+node_pool *tree_pool(rbtree *t) {
+  node_pool *pool = t->pool;
+  if(pool->forward == NULL) return pool;
+
+  while(pool->forward != NULL) {
+    pool = pool->forward;
+  }
+  pool->refs++;
+  release_node_pool(t->pool);
+  t->pool = pool;
+  return pool;
+}
+
+/**
+ * SRC pool의 free list를 DST pool의 free list 뒤에 붙이는 함수. O(1)
+*/
+static void pool_take_free_list(node_pool *dst, node_pool *src) {
+  if(src->free_list != NIL) {
+    if(dst->free_list == NIL) {
+      dst->free_list = src->free_list;
+    } else {
+      rbtree_set_parent(dst->free_tail, src->free_list);
+    }
+    dst->free_tail = src->free_tail;
+  }
+  src->free_list = NIL;
+  src->free_tail = NIL;
+}
+
+/**
+ * CHUNKS 목록 전체를 HEAD 목록 앞에 붙이고 새 head를 return하는 함수.
+*/
+static node_chunk *prepend_chunks(node_chunk *chunks, node_chunk *head) {
+  if(chunks == NULL) return head;
+  node_chunk *tail = chunks;
+  while(tail->next != NULL) tail = tail->next;
+  tail->next = head;
+  return chunks;
+}
+
+/**
+ * SRC pool의 chunk와 free list를 모두 DST pool로 옮기는 함수.
+ * SRC를 다른 tree나 pool도 가리키고 있으면 SRC는 이후 DST를 가리키는 forwarding pool이 된다.
+ * SRC를 tree 하나만 쓰고 있으면 (REFS가 1) SRC는 그 tree의 빈 pool로 남아 DST와 상관없어진다.
+*/
+void merge_node_pool(node_pool *dst, node_pool *src) {
+  if(src->chunks != NULL) {
+    // SRC의 chunk들은 DST의 head chunk 뒤에 연결한다.
+    node_chunk *tail = src->chunks;
+    while(tail->next != NULL) tail = tail->next;
+    if(dst->chunks == NULL) {
+      tail->next = NULL;
+      dst->chunks = src->chunks;
+      dst->used = src->used;
+    } else {
+      tail->next = dst->chunks->next;
+      dst->chunks->next = src->chunks;
+      // SRC head chunk의 남은 공간은 사용하지 않는다
+    }
+  }
+  pool_take_free_list(dst, src);
+  dst->spare = prepend_chunks(src->spare, dst->spare);
+
+  src->chunks = NULL;
+  src->used = 0;
+  src->spare = NULL;
+  if(src->refs > 1) {
+    src->forward = dst;
+    dst->refs++;
+  }
 }
 
+/**
+ * ROOT가 root인 subtree 전체를 POOL의 free list에 넣는 함수. O(1)
+*/
+void pool_free_subtree(node_pool *pool, node_t *root) {
+  if(root == NIL) return;
+  rbtree_set_parent(root, pool->free_list);
+  if(pool->free_list == NIL) pool->free_tail = root;
+  pool->free_list = root;
+}
+
+/**
+ * POOL에서 node 하나를 꺼내는 함수.
+ * free list를 먼저 사용하고, 비어 있으면 head chunk에서 잘라낸다.
+ * head chunk가 가득 찼으면 예비 chunk를 꺼내고,
+ * 예비 chunk도 없으면 이전 chunk의 두 배 크기(최대 NODE_CHUNK_MAX)로 새 chunk를 할당한다.
+*/
+node_t *pool_alloc(node_pool *pool) {
+  if(pool->free_list != NIL) {
+    node_t *node = pool->free_list;
+    pool->free_list = rbtree_parent(node);
+    if(pool->free_list == NIL) pool->free_tail = NIL;
+    pool_free_subtree(pool, rbtree_left(node));
+    pool_free_subtree(pool, rbtree_right(node));
+    return node;
+  }
+
+  if(pool->chunks == NULL || pool->used == pool->chunks->capacity) {
+    node_chunk *chunk = pool->spare;
+    if(chunk != NULL) {
+      pool->spare = chunk->next;
+    } else {
+      size_t capacity = NODE_CHUNK_MIN;
+      if(pool->chunks != NULL) {
+        capacity = pool->chunks->capacity * 2;
+        if(capacity > NODE_CHUNK_MAX) capacity = NODE_CHUNK_MAX;
+      }
+      chunk = alloc_chunk(capacity);
+      if(chunk == NULL) return NULL;
+    }
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+    pool->used = 0;
+  }
+  return &pool->chunks->nodes[pool->used++];
+}
+
+/**
+ * POOL에서 연속된 N개의 node를 한 번에 할당하는 함수.
+ * 전용 chunk를 만들어 head chunk 뒤에 연결하므로 head chunk의 남은 공간은 그대로 사용된다.
+*/
+node_t *pool_alloc_block(node_pool *pool, size_t n) {
+  node_chunk *chunk = alloc_chunk(n);
+  if(chunk == NULL) return NULL;
+  if(pool->chunks == NULL) {
+    chunk->next = NULL;
+    pool->chunks = chunk;
+    pool->used = n;
+  } else {
+    chunk->next = pool->chunks->next;
+    pool->chunks->next = chunk;
+  }
+  return chunk->nodes;
+}
+
+/**
+ * NODE 하나를 POOL의 free list로 돌려보내는 함수.
+*/
+void pool_free(node_pool *pool, node_t *node) {
+  rbtree_set_left(node, NIL);
+  rbtree_set_right(node, NIL);
+  pool_free_subtree(pool, node);
+}
+
+/**
+ * join3 등이 내부에서 잠깐 쓰는 tree처럼 count를 관리하지 않는 tree의 count 값.
+ * 사용자에게 돌려주는 tree의 count는 항상 정확하다.
+*/
+#define COUNT_UNKNOWN ((size_t)-1)
+
 rbtree *new_rbtree(void) {
+#ifdef RBTREE_INDEX
+  pthread_once(&arena_once, init_node_arena);
+  if(rbtree_node_arena == NULL) return NULL;
+#endif
   rbtree *p = (rbtree *)calloc(1, sizeof(rbtree));
-  node_t *nil = (node_t *)calloc(1, sizeof(node_t));
+  if(p == NULL) return NULL;
+  p->pool = new_node_pool();
+  if(p->pool == NULL) {
+    free(p);
+    return NULL;
+  }
 
-  init_nil(nil);
-  p->nil = nil;
+  p->nil = NIL;
   p->root = p->nil;
+  p->min = p->nil;
+  p->max = p->nil;
   return p;
 }
 
 /**
- * node N을 root로 갖고 NIL을 sentinel로 하는 RB tree의 
- * NIL을 제외한 모든 node에 할당된 메모리를 반환하는 함수.
+ * T가 사용한 모든 메모리를 반환하는 함수.
+ * T가 pool을 혼자 쓰고 있으면 tree를 순회하지 않고 chunk 단위로 반환하고,
+ * 다른 tree와 공유하고 있으면 T의 node 전체를 subtree 단위로 free list에 넣는다.
+*/
+void delete_rbtree(rbtree *t) {
+  node_pool *pool = tree_pool(t);
+  if(pool->refs > 1) {
+    pool_free_subtree(pool, t->root);
+  }
+  release_node_pool(pool);
+  free(t);
+}
+
+/**
+ * T를 빈 tree로 만드는 함수. node의 메모리는 반환하지 않고 이후의 insert에서 다시 사용한다.
+ * T가 pool을 혼자 쓰고 있으면 node를 순회하지 않고 모든 chunk를 예비 chunk로 돌려,
+ * 다음에 채울 때 처음부터 순서대로 잘라 쓰게 한다. (O(chunk 수))
+ * 다른 tree와 공유하고 있으면 T의 node 전체를 subtree 단위로 free list에 넣는다. (O(1))
 */
-void delete_sub_node(node_t *n, node_t *nil) {
-  if(n == nil) return;
-  delete_sub_node(n->left, nil);
-  delete_sub_node(n->right, nil);
-  free(n);
+void rbtree_clear(rbtree *t) {
+  node_pool *pool = tree_pool(t);
+  if(pool->refs > 1) {
+    pool_free_subtree(pool, t->root);
+  } else {
+    // 가장 최근의(가장 큰) chunk부터 다시 사용한다
+    pool->spare = prepend_chunks(pool->chunks, pool->spare);
+    pool->chunks = NULL;
+    pool->used = 0;
+    pool->free_list = NIL;
+    pool->free_tail = NIL;
+  }
+  t->root = t->nil;
+  t->count = 0;
+  t->min = t->nil;
+  t->max = t->nil;
 }
 
+#ifdef RBTREE_ORDER_STATS
 /**
- * T가 사용한 모든 메모리를 반환하는 함수.
+ * 자식들의 SIZE로 N의 SIZE를 다시 계산하는 함수.
 */
-void delete_rbtree(rbtree *t) {
-  delete_sub_node(t->root, t->nil);
-  free(t->nil);
-  free(t);
+static void update_size(node_t *n) {
+  n->size = rbtree_left(n)->size + rbtree_right(n)->size + 1;
 }
+#endif
 
 void left_rotate(rbtree *t, node_t *x) {
-  node_t *y = x->right;
-  x->right = y->left;
-  if(y->left != t->nil) {
-    y->left->parent = x;
+  STAT_ADD(t, left_rotations, 1);
+  node_t *y = rbtree_right(x);
+  rbtree_set_right(x, rbtree_left(y));
+  if(rbtree_left(y) != t->nil) {
+    rbtree_set_parent(rbtree_left(y), x);
   }
-  y->parent = x->parent;
-  if(x->parent == t->nil) {
+  rbtree_set_parent(y, rbtree_parent(x));
+  if(rbtree_parent(x) == t->nil) {
     t->root = y;
-  } else if(x == x->parent->left) {
-    x->parent->left = y;
+  } else if(x == rbtree_left(rbtree_parent(x))) {
+    rbtree_set_left(rbtree_parent(x), y);
   } else {
-    x->parent->right = y;
+    rbtree_set_right(rbtree_parent(x), y);
   }
-  y->left = x;
-  x->parent = y;
+  rbtree_set_left(y, x);
+  rbtree_set_parent(x, y);
+#ifdef RBTREE_ORDER_STATS
+  y->size = x->size;
+  update_size(x);
+#endif
 }
 
 void right_rotate(rbtree *t, node_t *x) {
-  node_t *y = x->left;
-  x->left = y->right;
-  if(y->right != t->nil) {
-    y->right->parent = x;
+  STAT_ADD(t, right_rotations, 1);
+  node_t *y = rbtree_left(x);
+  rbtree_set_left(x, rbtree_right(y));
+  if(rbtree_right(y) != t->nil) {
+    rbtree_set_parent(rbtree_right(y), x);
   }
-  y->parent = x->parent;
-  if(x->parent == t->nil) {
+  rbtree_set_parent(y, rbtree_parent(x));
+  if(rbtree_parent(x) == t->nil) {
     t->root = y;
-  } else if(x == x->parent->left) {
-    x->parent->left = y;
+  } else if(x == rbtree_left(rbtree_parent(x))) {
+    rbtree_set_left(rbtree_parent(x), y);
   } else {
-    x->parent->right = y;
+    rbtree_set_right(rbtree_parent(x), y);
   }
-  y->right = x;
-  x->parent = y;
+  rbtree_set_right(y, x);
+  rbtree_set_parent(x, y);
+#ifdef RBTREE_ORDER_STATS
+  y->size = x->size;
+  update_size(x);
+#endif
 }
 
 /**
  * insert이후 T의 rbtree 특성을 복구하는 함수.
+ * 마지막에 red가 된 root를 black으로 바꾸었으면 (T의 black height가 1 늘었으면) 1을 return.
 */
-void rbtree_insert_fixup(rbtree *t, node_t *cursor) {
+int rbtree_insert_fixup(rbtree *t, node_t *cursor) {
   // 종료 조건: cursor 부모 노드의 color (RBTREE_BLACK or RBTREE_RED)
-  while(cursor->parent->color == RBTREE_RED) {
+  while(rbtree_color(rbtree_parent(cursor)) == RBTREE_RED) {
+    STAT_ADD(t, insert_fixup_iterations, 1);
     // 분기 1: cursor 부모 노드의 위치 (left child or right child)
-    if(cursor->parent == cursor->parent->parent->left) {
-      node_t *uncle = cursor->parent->parent->right;
+    if(rbtree_parent(cursor) == rbtree_left(rbtree_parent(rbtree_parent(cursor)))) {
+      node_t *uncle = rbtree_right(rbtree_parent(rbtree_parent(cursor)));
       // 분기 2: cursor 삼촌 노드(uncle)의 color (RBTREE_BLACK or RBTREE_RED)
-      if(uncle->color == RBTREE_RED) {
-        cursor->parent->color = RBTREE_BLACK;
-        uncle->color = RBTREE_BLACK;
-        cursor->parent->parent->color = RBTREE_RED;
-        cursor = cursor->parent->parent;
+      if(rbtree_color(uncle) == RBTREE_RED) {
+        rbtree_set_color(rbtree_parent(cursor), RBTREE_BLACK);
+        rbtree_set_color(uncle, RBTREE_BLACK);
+        rbtree_set_color(rbtree_parent(rbtree_parent(cursor)), RBTREE_RED);
+        cursor = rbtree_parent(rbtree_parent(cursor));
       } else {
         // 분기 3: cursor의 위치 (left child or right child)
-        if(cursor == cursor->parent->right) {
-          cursor = cursor->parent;
+        if(cursor == rbtree_right(rbtree_parent(cursor))) {
+          cursor = rbtree_parent(cursor);
           left_rotate(t, cursor);
         }
-        cursor->parent->color = RBTREE_BLACK;
-        cursor->parent->parent->color = RBTREE_RED;
-        right_rotate(t, cursor->parent->parent);
+        rbtree_set_color(rbtree_parent(cursor), RBTREE_BLACK);
+        rbtree_set_color(rbtree_parent(rbtree_parent(cursor)), RBTREE_RED);
+        right_rotate(t, rbtree_parent(rbtree_parent(cursor)));
       }
     } else {
-      node_t *uncle = cursor->parent->parent->left;
-      if(uncle->color == RBTREE_RED) {
-        cursor->parent->color = RBTREE_BLACK;
-        uncle->color = RBTREE_BLACK;
-        cursor->parent->parent->color = RBTREE_RED;
-        cursor = cursor->parent->parent;
+      node_t *uncle = rbtree_left(rbtree_parent(rbtree_parent(cursor)));
+      if(rbtree_color(uncle) == RBTREE_RED) {
+        rbtree_set_color(rbtree_parent(cursor), RBTREE_BLACK);
+        rbtree_set_color(uncle, RBTREE_BLACK);
+        rbtree_set_color(rbtree_parent(rbtree_parent(cursor)), RBTREE_RED);
+        cursor = rbtree_parent(rbtree_parent(cursor));
       } else {
-        if(cursor == cursor->parent->left) {
-          cursor = cursor->parent;
+        if(cursor == rbtree_left(rbtree_parent(cursor))) {
+          cursor = rbtree_parent(cursor);
           right_rotate(t, cursor);
         }
-        cursor->parent->color = RBTREE_BLACK;
-        cursor->parent->parent->color = RBTREE_RED;
-        left_rotate(t, cursor->parent->parent);
+        rbtree_set_color(rbtree_parent(cursor), RBTREE_BLACK);
+        rbtree_set_color(rbtree_parent(rbtree_parent(cursor)), RBTREE_RED);
+        left_rotate(t, rbtree_parent(rbtree_parent(cursor)));
       }
     }
   }
-  t->root->color = RBTREE_BLACK;
+  int grew = rbtree_color(t->root) == RBTREE_RED;
+  rbtree_set_color(t->root, RBTREE_BLACK);
+  return grew;
 }
 
 /**
  * KEY를 갖는 node를 생성 후 return하는 함수.
 */
-node_t *create_new_node(const key_t key, node_t *nil) {
-  node_t *new_node = (node_t *)calloc(1, sizeof(node_t));
+node_t *create_new_node(rbtree *t, const key_t key) {
+  node_t *new_node = pool_alloc(tree_pool(t));
+  if(new_node == NULL) return NULL;
   new_node->key = key;
-  new_node->right = nil;
-  new_node->left = nil;
-  new_node->color = RBTREE_RED;
+#ifdef RBTREE_VALUE_TYPE
+  memset(&new_node->value, 0, sizeof(value_t));
+#endif
+  rbtree_set_parent(new_node, t->nil);
+  rbtree_set_right(new_node, t->nil);
+  rbtree_set_left(new_node, t->nil);
+  rbtree_set_color(new_node, RBTREE_RED);
+#ifdef RBTREE_ORDER_STATS
+  new_node->size = 1;
+#endif
+#ifdef RBTREE_COUNTED
+  new_node->copies = 1;
+#endif
   return new_node;
 }
 
 /**
- * T에 KEY를 갖는 node를 삽입하는 함수.
+ * NEW_NODE를 PARENT_NODE의 빈 자식 자리(IS_LEFT)에 연결하고 rbtree 특성을 복구하는 함수.
+ * PARENT_NODE가 nil이면 NEW_NODE가 root가 된다.
 */
-node_t *rbtree_insert(rbtree *t, const key_t key) {
-  // rbtree에 저장할 new_node 생성
-  node_t *new_node = create_new_node(key, t->nil);
-
-  // insert 위치 탐색
-  node_t *parent_node = t->nil;
-  node_t *cursor = t->root;
-  while(cursor != t->nil) {
-    parent_node = cursor;
-    if(new_node->key < cursor->key) {
-      cursor = cursor->left;
-    } else {
-      cursor = cursor->right;
-    }
+static void attach_node(rbtree *t, node_t *parent_node, node_t *new_node, const int is_left) {
+#ifdef RBTREE_ORDER_STATS
+  // PARENT_NODE와 그 조상들의 subtree에 new_node가 들어간다
+  for(node_t *p = parent_node; p != t->nil; p = rbtree_parent(p)) {
+    p->size++;
   }
+#endif
 
   // new_node와 parent_node의 자식-부모 관계 설정
-  new_node->parent = parent_node;
-  if(parent_node == t->nil) {                     // 1. parent_node가 nil인 경우 (newNode가 root)
+  rbtree_set_parent(new_node, parent_node);
+  // new_node의 초기화가 연결보다 먼저 보이도록 한다. (lock 없이 읽는 rbtree_sync reader를 위해)
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  if(parent_node == t->nil) {   // 1. parent_node가 nil인 경우 (newNode가 root)
     t->root = new_node;
-  } else if(new_node->key < parent_node->key) {   // 2. new_node가 parent_node의 왼쪽 자식 노드인 경우
-    parent_node->left = new_node;
-  } else {                                        // 3. new_node가 parent_node의 오른쪽 자식 노드인 경우
-    parent_node->right = new_node;
+  } else if(is_left) {          // 2. new_node가 parent_node의 왼쪽 자식 노드인 경우
+    rbtree_set_left(parent_node, new_node);
+  } else {                      // 3. new_node가 parent_node의 오른쪽 자식 노드인 경우
+    rbtree_set_right(parent_node, new_node);
   }
 
-  // rbtree 복구
+  // rbtree 복구 (rotation은 key 순서를 바꾸지 않으므로 min/max는 그대로이다)
   rbtree_insert_fixup(t, new_node);
-
-  // 생성 후 insert한 노드의 pointer를 반환
-  return new_node;
+  if(t->count != COUNT_UNKNOWN) t->count++;
+  if(parent_node == t->nil || (parent_node == t->min && is_left)) t->min = new_node;
+  if(parent_node == t->nil || (parent_node == t->max && !is_left)) t->max = new_node;
 }
 
 /**
- * T에서 KEY를 갖는 node의 pointer를 찾는 함수.
+ * FINGER에서 위로 올라가며 KEY가 들어갈 자리를 포함하는 가장 가까운 subtree의 root를 찾는 함수.
  * 
- * KEY를 갖는 node가 존재하면 node를 return.
- * KEY를 갖는 node가 존재하지 않으면 NULL을 return.
+ * KEY가 FINGER의 key 이상이면 FINGER의 subtree는 아래쪽으로는 FINGER의 key로 제한되므로,
+ * 위쪽 경계(왼쪽 자식으로 매달린 조상의 key)가 KEY보다 큰 곳까지만 올라가면 된다.
+ * KEY가 더 작으면 반대로 아래쪽 경계(오른쪽 자식으로 매달린 조상의 key)가 KEY보다 작은 곳까지 올라간다.
+ * 경계가 KEY와 같으면 더 올라가므로, KEY와 같은 node는 항상 찾은 subtree 안에 있다.
 */
-node_t *rbtree_find(const rbtree *t, const key_t key) {
-  node_t *cursor = t->root;
-  while(cursor != t->nil) {
-    if(key < cursor->key) {
-      cursor = cursor->left;
-    } else if(key > cursor->key) {
-      cursor = cursor->right;
-    } else {
+static node_t *climb_for_insert(const rbtree *t, node_t *finger, const key_t key) {
+  const int after = !RBTREE_KEY_LESS(key, finger->key);
+  node_t *node = finger;
+  while(node != t->root) {
+    node_t *parent = rbtree_parent(node);
+    if(after ? node == rbtree_left(parent) && RBTREE_KEY_LESS(key, parent->key)
+             : node == rbtree_right(parent) && RBTREE_KEY_LESS(parent->key, key)) {
       break;
     }
+    node = parent;
   }
-  
-  if(cursor == t->nil) {
-    return NULL;
+  return node;
+}
+
+#ifdef RBTREE_COUNTED
+/**
+ * NODE에 같은 key를 하나 더 세고 NODE를 return하는 함수. COPIES가 가득 찼으면 NULL을 return.
+*/
+static node_t *add_copy(rbtree *t, node_t *node) {
+  if(node->copies == RBTREE_MAX_COPIES) return NULL;
+  node->copies++;
+  if(t->count != COUNT_UNKNOWN) t->count++;
+  return node;
+}
+#endif
+
+/**
+ * KEY를 HINT 근처에서부터 찾은 위치에 삽입하고 그 node를 return하는 함수. HINT가 NULL이면 root부터 찾는다.
+ * 
+ * KEY가 max 이상이면 탐색하지 않고 max의 오른쪽 자식으로 바로 붙이고, min보다 작으면 min의 왼쪽에 붙인다.
+ * (max의 오른쪽은 항상 비어 있고, 같은 key는 오른쪽으로 내려가므로 root부터 찾은 위치와 같다)
+ * 거의 정렬된 순서로 들어오는 key는 비교 한 번과 amortized O(1)의 fixup으로 삽입된다.
+ * RBTREE_COUNTED이면 같은 key의 node를 만났을 때 새 node를 만들지 않고 그 node의 copies를 늘린다.
+*/
+static node_t *insert_key_near(rbtree *t, node_t *hint, const key_t key) {
+  node_t *max = rbtree_max(t);
+  node_t *min = rbtree_min(t);
+  node_t *parent_node;
+  int is_left = 0;
+  if(max != t->nil && !RBTREE_KEY_LESS(key, max->key)) {
+#ifdef RBTREE_COUNTED
+    if(!RBTREE_KEY_LESS(max->key, key)) return add_copy(t, max);
+#endif
+    parent_node = max;
+  } else if(min != t->nil && RBTREE_KEY_LESS(key, min->key)) {
+    parent_node = min;
+    is_left = 1;
   } else {
-    return cursor;
+    // insert 위치 탐색. 시작 subtree는 KEY가 들어갈 자리를 포함한다. (T의 root이면 항상 만족)
+    node_t *cursor = hint == NULL ? t->root : climb_for_insert(t, hint, key);
+    parent_node = cursor == t->root ? t->nil : rbtree_parent(cursor);
+    while(cursor != t->nil) {
+      parent_node = cursor;
+#ifdef RBTREE_COUNTED
+      const int cmp = RBTREE_KEY_COMPARE(key, cursor->key);
+      if(cmp == 0) return add_copy(t, cursor);
+      is_left = cmp < 0;
+#else
+      is_left = RBTREE_KEY_LESS(key, cursor->key);
+#endif
+      cursor = is_left ? rbtree_left(cursor) : rbtree_right(cursor);
+    }
   }
+
+  // rbtree에 저장할 new_node 생성
+  node_t *new_node = create_new_node(t, key);
+  if(new_node == NULL) return NULL;
+  attach_node(t, parent_node, new_node, is_left);
+  return new_node;
 }
 
 /**
- * CURSOR가 root인 subtree에서 최소 key값을 갖는 node를 return하는 함수.
+ * T에 KEY를 갖는 node를 삽입하는 함수. 삽입한 node의 pointer를 return하며, 메모리가 부족하면 NULL을 return.
+ * RBTREE_COUNTED이고 KEY가 이미 있으면 그 node의 copies를 늘리고 그 node를 return한다.
 */
-node_t *subtree_min(node_t *cursor, node_t *nil) {
-  node_t *min = cursor;
-  while(cursor != nil) {
-    min = cursor;
-    cursor = cursor->left;
-  }
-  return min;
+node_t *rbtree_insert(rbtree *t, const key_t key) {
+  return insert_key_near(t, NULL, key);
 }
 
 /**
- * T에서 key값이 최소인 node를 return하는 함수.
+ * T에 KEY를 갖는 node를 HINT 근처에서부터 찾아 삽입하는 함수. HINT는 T의 node이거나 NULL이다.
+ * 
+ * root부터 내려가지 않고, HINT에서 KEY가 들어갈 자리를 포함하는 가장 가까운 subtree까지만 올라간 뒤 내려간다.
+ * 직전에 삽입한 node처럼 key 순서가 가까운 node를 주면 root까지의 경로를 거의 읽지 않으며,
+ * HINT가 멀어도 결과는 rbtree_insert와 같은 tree이다. (같은 key 사이의 위치만 다를 수 있다)
 */
-node_t *rbtree_min(const rbtree *t) {
-  return subtree_min(t->root, t->nil);
+node_t *rbtree_insert_hint(rbtree *t, node_t *hint, const key_t key) {
+  return insert_key_near(t, hint, key);
 }
 
+#ifdef RBTREE_VALUE_TYPE
 /**
- * CURSOR가 root인 subtree에서 최대 key값을 갖는 node를 return하는 함수.
+ * T에서 KEY의 value를 VALUE로 설정하는 함수. (map mode)
+ * 
+ * KEY를 갖는 node가 있으면 그 node의 value를 바꾸고, 없으면 새 node를 삽입한다.
+ * 한 번의 탐색으로 두 경우를 모두 처리하며, 해당 node를 return한다. (할당 실패 시 NULL)
 */
-node_t *subtree_max(node_t *cursor, node_t *nil) {
-  node_t *max = cursor;
-  while(cursor != nil) {
-    max = cursor;
-    cursor = cursor->right;
+node_t *rbtree_put(rbtree *t, const key_t key, const value_t value) {
+  node_t *parent_node = t->nil;
+  node_t *cursor = t->root;
+  int cmp = 0;
+  while(cursor != t->nil) {
+    cmp = RBTREE_KEY_COMPARE(key, cursor->key);
+    if(cmp == 0) {
+      cursor->value = value;
+      return cursor;
+    }
+    parent_node = cursor;
+    cursor = cmp < 0 ? rbtree_left(cursor) : rbtree_right(cursor);
   }
-  return max;
+
+  node_t *new_node = create_new_node(t, key);
+  if(new_node == NULL) return NULL;
+  new_node->value = value;
+  attach_node(t, parent_node, new_node, cmp < 0);
+  return new_node;
 }
+#endif
 
 /**
- * T에서 key값이 최대인 node를 return하는 함수.
+ * build_balanced에 node를 key 순서대로 하나씩 공급하는 함수.
 */
-node_t *rbtree_max(const rbtree *t) {
-  return subtree_max(t->root, t->nil);
+typedef node_t *(*node_source)(void *ctx);
+
+/**
+ * SOURCE가 key 순서대로 공급하는 SIZE개의 node로 높이가 균형잡힌 subtree를 만들고 그 root를 return하는 함수.
+ * in-order 순서로 node를 꺼내므로 왼쪽 subtree를 만든 뒤 root를, 그 다음 오른쪽 subtree를 만든다.
+ * 
+ * 양쪽 subtree의 크기 차이는 1 이하이므로
+ * DEPTH가 RED_DEPTH인 (마지막 level의) node만 red로 칠하면 모든 경로의 black 수가 같다.
+*/
+static node_t *build_balanced(rbtree *t, size_t size, int depth, int red_depth,
+                              node_source source, void *ctx) {
+  if(size == 0) return t->nil;
+
+  size_t left_size = size / 2;
+  node_t *left = build_balanced(t, left_size, depth + 1, red_depth, source, ctx);
+  node_t *node = source(ctx);
+  node_t *right = build_balanced(t, size - left_size - 1, depth + 1, red_depth, source, ctx);
+  rbtree_set_left(node, left);
+  rbtree_set_right(node, right);
+  if(left != t->nil) rbtree_set_parent(left, node);
+  if(right != t->nil) rbtree_set_parent(right, node);
+  rbtree_set_color(node, depth == red_depth ? RBTREE_RED : RBTREE_BLACK);
+#ifdef RBTREE_ORDER_STATS
+  node->size = size;
+#endif
+  return node;
 }
 
+static void reset_extremes(rbtree *t);
+
 /**
- * 부모와의 관계에서, old_child를 new_child로 대체하는 함수.
+ * SOURCE가 공급하는 N개의 node로 T의 tree 전체를 다시 만드는 함수. O(n)
+ * T의 기존 node 연결은 무시하며, T의 count는 N개의 node가 담은 key의 수 COUNT로 바뀐다.
 */
-void trans_plant(rbtree *t, node_t *old_child, node_t *new_child) {
-  if(old_child->parent == t->nil) {
-    t->root = new_child;
-  } else if(old_child == old_child->parent->left) {
-    old_child->parent->left = new_child;
-  } else {
-    old_child->parent->right = new_child;
+static void build_tree(rbtree *t, size_t n, size_t count, node_source source, void *ctx) {
+  // 가득 찬 level의 수 = floor(log2(n + 1)), 그 아래 level의 node들이 red가 된다.
+  int red_depth = 0;
+  while(((size_t)2 << red_depth) - 1 <= n) red_depth++;
+
+  t->root = build_balanced(t, n, 0, red_depth, source, ctx);
+  rbtree_set_parent(t->root, t->nil);
+  t->count = count;
+  reset_extremes(t);
+}
+
+/**
+ * 연속된 node block에 정렬된 key를 채우며 공급하는 node_source.
+ * RBTREE_COUNTED이면 같은 key들을 node 하나에 모은다.
+*/
+typedef struct {
+  node_t *nodes;
+  size_t used;
+  const key_t *keys;
+  size_t next, count;
+} block_source;
+
+static node_t *next_block_node(void *ctx) {
+  block_source *src = (block_source *)ctx;
+  node_t *node = &src->nodes[src->used++];
+  node->key = src->keys[src->next++];
+#ifdef RBTREE_VALUE_TYPE
+  memset(&node->value, 0, sizeof(value_t));
+#endif
+#ifdef RBTREE_COUNTED
+  node->copies = 1;
+  while(src->next < src->count && !RBTREE_KEY_LESS(node->key, src->keys[src->next])) {
+    node->copies++;
+    src->next++;
   }
-  new_child->parent = old_child->parent;
+#endif
+  return node;
 }
 
+#ifdef RBTREE_COUNTED
 /**
- * erase 후 rbtree 특성을 복구하는 함수.
+ * 정렬된 KEYS의 N개 key에서 서로 다른 key의 수를 return하는 함수.
+ * 같은 key가 RBTREE_MAX_COPIES개를 넘으면 node 하나에 담을 수 없으므로 0을 return.
 */
-void rbtree_erase_fixup(rbtree *t, node_t *cursor) {
-  while(cursor != t->root && cursor->color == RBTREE_BLACK) {
-    if(cursor == cursor->parent->left) {
-      node_t *sibling_node = cursor->parent->right;
-      if(sibling_node->color == RBTREE_RED) {
-        sibling_node->color = RBTREE_BLACK;
-        cursor->parent->color = RBTREE_RED;
-        left_rotate(t, cursor->parent);
-        sibling_node = cursor->parent->right;
-      } 
-      if(sibling_node->left->color == RBTREE_BLACK && sibling_node->right->color == RBTREE_BLACK) {
-        sibling_node->color = RBTREE_RED;
-        cursor = cursor->parent;
-      } else {
-        if(sibling_node->right->color == RBTREE_BLACK) {
-          sibling_node->left->color = RBTREE_BLACK;
-          sibling_node->color = RBTREE_RED;
-          right_rotate(t, sibling_node);
-          sibling_node = cursor->parent->right;
-        }
-        sibling_node->color = cursor->parent->color;
-        cursor->parent->color = RBTREE_BLACK;
-        sibling_node->right->color = RBTREE_BLACK;
-        left_rotate(t, cursor->parent);
-        cursor = t->root;
-      }
+static size_t count_distinct(const key_t *keys, const size_t n) {
+  size_t distinct = 0, run = 0;
+  for(size_t i = 0; i < n; i++) {
+    if(i > 0 && !RBTREE_KEY_LESS(keys[i - 1], keys[i])) {
+      if(++run >= RBTREE_MAX_COPIES) return 0;
     } else {
-      node_t *sibling_node = cursor->parent->left;
-      if(sibling_node->color == RBTREE_RED) {
-        sibling_node->color = RBTREE_BLACK;
-        cursor->parent->color = RBTREE_RED;
-        right_rotate(t, cursor->parent);
-        sibling_node = cursor->parent->left;
-      } 
-      if(sibling_node->left->color == RBTREE_BLACK && sibling_node->right->color == RBTREE_BLACK) {
-        sibling_node->color = RBTREE_RED;
-        cursor = cursor->parent;
-      } else {
-        if(sibling_node->left->color == RBTREE_BLACK) {
-          sibling_node->right->color = RBTREE_BLACK;
-          sibling_node->color = RBTREE_RED;
-          left_rotate(t, sibling_node);
-          sibling_node = cursor->parent->left;
-        }
-        sibling_node->color = cursor->parent->color;
-        cursor->parent->color = RBTREE_BLACK;
-        sibling_node->left->color = RBTREE_BLACK;
-        right_rotate(t, cursor->parent);
-        cursor = t->root;
-      }
+      distinct++;
+      run = 0;
     }
   }
-  cursor->color = RBTREE_BLACK;
+  return distinct;
 }
+#endif
 
 /**
- * T에서 TARGET node를 삭제하는 함수.
+ * 오름차순으로 정렬된 ARR의 N개 key로 RB tree를 만들어 return하는 함수. O(n)
+ * 
+ * node들은 하나의 연속된 block에 key 순서대로 할당되며, insert와 달리 rotation이 없다.
+ * 메모리 할당에 실패하면 NULL을 return.
 */
-int rbtree_erase(rbtree *t, node_t *target) {
-  node_t *y = target;
-  color_t y_color = y->color;
+rbtree *rbtree_from_sorted(const key_t *arr, const size_t n) {
+  rbtree *t = new_rbtree();
+  if(t == NULL || n == 0) return t;
 
-  node_t *x;
-  if(target->left == t->nil) {
-    x = target->right;
-    trans_plant(t, target, target->right);
-  } else if(target->right == t->nil) {
-    x = target->left;
-    trans_plant(t, target, target->left);
-  } else {
-    /** case 1 **/
-    /** 삭제 될 target의 자리를 right subtree의 min node로 대체 **/
-    // y = subtree_min(target->right, t->nil);
-    // y_color = y->color;
-    // x = y->right;
-    // if(y->parent == target) {
-    //   x->parent = y;
-    // } else {
-    //   trans_plant(t, y, y->right);
-    //   y->right = target->right;
-    //   y->right->parent = y;
-    // }
-    // trans_plant(t, target, y);
-    // y->left = target->left;
-    // y->left->parent = y;
-    // y->color = target->color;
-    /** end of case 1 **/
+  size_t node_count = n;
+#ifdef RBTREE_COUNTED
+  node_count = count_distinct(arr, n);
+#endif
+  node_t *nodes = node_count == 0 ? NULL : pool_alloc_block(tree_pool(t), node_count);
+  if(nodes == NULL) {
+    delete_rbtree(t);
+    return NULL;
+  }
+  block_source src = {nodes, 0, arr, 0, n};
+  build_tree(t, node_count, n, next_block_node, &src);
+  return t;
+}
 
-    /** case 2 **/
+/**
+ * rbtree_validate가 내려가는 최대 깊이.
+ * node 수가 2^64보다 작은 rbtree의 높이는 128을 넘지 않으므로, 이보다 깊으면 link가 잘못된 것이다.
+*/
+#define VALIDATE_MAX_DEPTH 128
+
+/**
+ * T가 rbtree 특성을 모두 만족하는지 검사하고, 처음 발견한 위반을 return하는 함수.
+ * 
+ * parent link를 따라 한 번 중위 순회하며 key 순서, red node의 자식 color, 경로마다의 black node 수,
+ * 자식-부모 link의 일치, 저장된 key 수(ORDER_STATS이면 subtree 크기)와 cache한 min/max node를 함께 검사한다.
+ * 재귀와 추가 메모리를 쓰지 않으며, 자식으로 내려가기 전에 그 자식의 parent를 확인하므로
+ * link가 손상된 tree에서도 순환하지 않고 끝난다. O(n)
+*/
+rbtree_violation rbtree_validate(const rbtree *t) {
+  if(rbtree_color(t->nil) != RBTREE_BLACK) return RBTREE_BAD_NIL;
+  if(t->root != t->nil && (rbtree_color(t->root) != RBTREE_BLACK || rbtree_parent(t->root) != t->nil)) {
+    return RBTREE_BAD_ROOT;
+  }
+
+  size_t keys = 0, depth = 0, black = 0;
+  size_t black_height = (size_t)-1;   // 처음 만난 nil까지의 black node 수
+  const node_t *first = NULL;         // 중위 순회의 첫 node
+  const node_t *last = NULL;          // 중위 순회에서 직전 node
+  node_t *prev = t->nil;
+  node_t *cursor = t->root;
+  while(cursor != t->nil) {
+    node_t *left = rbtree_left(cursor);
+    node_t *right = rbtree_right(cursor);
+    node_t *next;
+    int visit = 0;
+    if(prev == rbtree_parent(cursor)) {
+      // 위에서 처음 내려왔다: node 자체를 검사한다
+      if(++depth > VALIDATE_MAX_DEPTH) return RBTREE_BAD_PARENT;
+      if(rbtree_color(cursor) == RBTREE_BLACK) {
+        black++;
+      } else if(rbtree_color(left) == RBTREE_RED || rbtree_color(right) == RBTREE_RED) {
+        return RBTREE_RED_RED;
+      }
+      if((left != t->nil && (left == right || rbtree_parent(left) != cursor)) ||
+         (right != t->nil && rbtree_parent(right) != cursor)) {
+        return RBTREE_BAD_PARENT;
+      }
+      if(left == t->nil || right == t->nil) {
+        if(black_height == (size_t)-1) black_height = black;
+        if(black != black_height) return RBTREE_BAD_BLACK_HEIGHT;
+      }
+#ifdef RBTREE_ORDER_STATS
+      if(cursor->size != left->size + right->size + 1) return RBTREE_BAD_SIZE;
+#endif
+      visit = left == t->nil;
+      next = left != t->nil ? left : (right != t->nil ? right : rbtree_parent(cursor));
+    } else if(prev == left) {
+      // 왼쪽 subtree를 마쳤다
+      visit = 1;
+      next = right != t->nil ? right : rbtree_parent(cursor);
+    } else {
+      next = rbtree_parent(cursor);
+    }
+
+    if(visit) {
+#ifdef RBTREE_COUNTED
+      // 같은 key는 node 하나에 모여 있어야 한다
+      if(last != NULL && !RBTREE_KEY_LESS(last->key, cursor->key)) return RBTREE_BAD_ORDER;
+      if(cursor->copies == 0) return RBTREE_BAD_SIZE;
+#else
+      if(last != NULL && RBTREE_KEY_LESS(cursor->key, last->key)) return RBTREE_BAD_ORDER;
+#endif
+      if(first == NULL) first = cursor;
+      last = cursor;
+      keys += rbtree_copies(cursor);
+    }
+    if(next == rbtree_parent(cursor)) {
+      // cursor의 subtree를 마치고 올라간다
+      depth--;
+      if(rbtree_color(cursor) == RBTREE_BLACK) black--;
+    }
+    prev = cursor;
+    cursor = next;
+  }
+
+  if(t->count != keys) return RBTREE_BAD_SIZE;
+  if(t->min != (first != NULL ? first : t->nil)) return RBTREE_BAD_CACHE;
+  if(t->max != (last != NULL ? last : t->nil)) return RBTREE_BAD_CACHE;
+  return RBTREE_VALID;
+}
+
+/**
+ * T에서 KEY를 갖는 node의 pointer를 찾는 함수.
+ * 
+ * KEY를 갖는 node가 존재하면 node를 return.
+ * KEY를 갖는 node가 존재하지 않으면 NULL을 return.
+*/
+node_t *rbtree_find(const rbtree *t, const key_t key) {
+  node_t *cursor = t->root;
+#ifdef RBTREE_STATS
+  uint64_t comparisons = 0;
+#endif
+  while(cursor != t->nil) {
+#ifdef RBTREE_STATS
+    comparisons++;
+#endif
+    const int cmp = RBTREE_KEY_COMPARE(key, cursor->key);
+    if(cmp < 0) {
+      cursor = rbtree_left(cursor);
+    } else if(cmp > 0) {
+      cursor = rbtree_right(cursor);
+    } else {
+      break;
+    }
+  }
+#ifdef RBTREE_STATS
+  rbtree_counters *counters = &((rbtree *)t)->counters;
+  counters->finds++;
+  counters->find_comparisons += comparisons;
+  if(comparisons > counters->find_max_comparisons) counters->find_max_comparisons = comparisons;
+#endif
+  
+  if(cursor == t->nil) {
+    return NULL;
+  } else {
+    return cursor;
+  }
+}
+
+#ifdef RBTREE_VALUE_TYPE
+/**
+ * T에서 KEY의 value를 찾는 함수. (map mode)
+ * 
+ * KEY를 갖는 node가 존재하면 그 node의 value slot의 pointer를, 존재하지 않으면 NULL을 return.
+ * 같은 key가 여러 개이면 그중 하나의 value를 return한다.
+*/
+value_t *rbtree_get(const rbtree *t, const key_t key) {
+  node_t *node = rbtree_find(t, key);
+  return node == NULL ? NULL : &node->value;
+}
+#endif
+
+/**
+ * rbtree_find_many에서 동시에 진행하는 탐색의 수.
+ * 한 node를 비교하는 동안 나머지 탐색의 prefetch가 메모리에서 올라올 수 있을 만큼 커야 한다.
+*/
+#ifndef FIND_MANY_GROUP
+#define FIND_MANY_GROUP 16
+#endif
+
+/**
+ * KEYS의 N개 key를 T에서 찾아 OUT[i]에 rbtree_find(t, KEYS[i])의 결과를 담는 함수.
+ * 
+ * 탐색 하나는 root부터 서로 의존하는 pointer load의 연속이라 큰 tree에서는 level마다 cache miss를 기다린다.
+ * FIND_MANY_GROUP개의 탐색을 돌아가며 한 level씩 진행하고(AMAC), 다음에 읽을 자식을 미리 prefetch하여
+ * 여러 탐색의 cache miss가 겹치도록 한다. 끝난 탐색의 자리에는 바로 다음 key의 탐색을 시작한다.
+*/
+void rbtree_find_many(const rbtree *t, const key_t *keys, const size_t n, node_t **out) {
+  node_t *cursor[FIND_MANY_GROUP];
+  size_t index[FIND_MANY_GROUP];
+  size_t active = 0, next = 0;
+  while(active < FIND_MANY_GROUP && next < n) {
+    cursor[active] = t->root;
+    index[active++] = next++;
+  }
+  __builtin_prefetch(t->root);
+
+  while(active > 0) {
+    for(size_t slot = 0; slot < active;) {
+      node_t *c = cursor[slot];
+      node_t *found = NULL;
+      if(c != t->nil) {
+        const int cmp = RBTREE_KEY_COMPARE(keys[index[slot]], c->key);
+        if(cmp != 0) {
+          c = cmp < 0 ? rbtree_left(c) : rbtree_right(c);
+          __builtin_prefetch(c);
+          cursor[slot++] = c;
+          continue;
+        }
+        found = c;
+      }
+
+      // 이 탐색은 끝났다. 다음 key로 자리를 채우거나, 남은 key가 없으면 마지막 탐색을 옮겨 온다
+      out[index[slot]] = found;
+      if(next < n) {
+        cursor[slot] = t->root;
+        index[slot++] = next++;
+      } else {
+        active--;
+        cursor[slot] = cursor[active];
+        index[slot] = index[active];
+      }
+    }
+  }
+}
+
+/**
+ * CURSOR가 root인 subtree에서 최소 key값을 갖는 node를 return하는 함수.
+*/
+node_t *subtree_min(node_t *cursor, node_t *nil) {
+  node_t *min = cursor;
+  while(cursor != nil) {
+    min = cursor;
+    cursor = rbtree_left(cursor);
+  }
+  return min;
+}
+
+/**
+ * T에서 key값이 최소인 node를 return하는 함수.
+*/
+node_t *rbtree_min(const rbtree *t) {
+  return t->min;
+}
+
+/**
+ * CURSOR가 root인 subtree에서 최대 key값을 갖는 node를 return하는 함수.
+*/
+node_t *subtree_max(node_t *cursor, node_t *nil) {
+  node_t *max = cursor;
+  while(cursor != nil) {
+    max = cursor;
+    cursor = rbtree_right(cursor);
+  }
+  return max;
+}
+
+/**
+ * T에서 key값이 최대인 node를 return하는 함수.
+*/
+node_t *rbtree_max(const rbtree *t) {
+  return t->max;
+}
+
+/**
+ * T의 tree 전체를 다시 만든 뒤(build, join, split, 집합 연산) min/max cache를 다시 채우는 함수. O(log n)
+ * cache를 쓰는 곳은 수정 연산뿐이므로, const tree를 읽는 rbtree_min/rbtree_max는 T에 쓰지 않는다.
+*/
+static void reset_extremes(rbtree *t) {
+  t->min = subtree_min(t->root, t->nil);
+  t->max = subtree_max(t->root, t->nil);
+}
+
+/**
+ * 부모와의 관계에서, old_child를 new_child로 대체하는 함수.
+*/
+void trans_plant(rbtree *t, node_t *old_child, node_t *new_child) {
+  if(rbtree_parent(old_child) == t->nil) {
+    t->root = new_child;
+  } else if(old_child == rbtree_left(rbtree_parent(old_child))) {
+    rbtree_set_left(rbtree_parent(old_child), new_child);
+  } else {
+    rbtree_set_right(rbtree_parent(old_child), new_child);
+  }
+  if(new_child != t->nil) {
+    rbtree_set_parent(new_child, rbtree_parent(old_child));
+  }
+}
+
+/**
+ * erase 후 rbtree 특성을 복구하는 함수.
+ * CURSOR는 black 하나가 부족한 자리의 node이며 NIL일 수 있으므로, 그 부모 PARENT를 따로 받는다.
+ * (NIL은 모든 tree가 공유하므로 NIL의 parent에 쓰지 않는다.)
+ * 
+ * 부족한 black을 root까지 올려보내서 T의 black height가 1 줄었으면 1을 return.
+*/
+int rbtree_erase_fixup(rbtree *t, node_t *cursor, node_t *parent) {
+  int balanced = 0;
+  while(cursor != t->root && rbtree_color(cursor) == RBTREE_BLACK) {
+    STAT_ADD(t, erase_fixup_iterations, 1);
+    // cursor가 NIL이어도 sibling은 NIL이 아니므로, 부모의 왼쪽이 cursor이면 cursor는 왼쪽 자식이다.
+    if(cursor == rbtree_left(parent)) {
+      node_t *sibling_node = rbtree_right(parent);
+      if(rbtree_color(sibling_node) == RBTREE_RED) {
+        rbtree_set_color(sibling_node, RBTREE_BLACK);
+        rbtree_set_color(parent, RBTREE_RED);
+        left_rotate(t, parent);
+        sibling_node = rbtree_right(parent);
+      } 
+      if(rbtree_color(rbtree_left(sibling_node)) == RBTREE_BLACK && rbtree_color(rbtree_right(sibling_node)) == RBTREE_BLACK) {
+        rbtree_set_color(sibling_node, RBTREE_RED);
+        cursor = parent;
+        parent = rbtree_parent(cursor);
+      } else {
+        if(rbtree_color(rbtree_right(sibling_node)) == RBTREE_BLACK) {
+          rbtree_set_color(rbtree_left(sibling_node), RBTREE_BLACK);
+          rbtree_set_color(sibling_node, RBTREE_RED);
+          right_rotate(t, sibling_node);
+          sibling_node = rbtree_right(parent);
+        }
+        rbtree_set_color(sibling_node, rbtree_color(parent));
+        rbtree_set_color(parent, RBTREE_BLACK);
+        rbtree_set_color(rbtree_right(sibling_node), RBTREE_BLACK);
+        left_rotate(t, parent);
+        cursor = t->root;
+        balanced = 1;
+      }
+    } else {
+      node_t *sibling_node = rbtree_left(parent);
+      if(rbtree_color(sibling_node) == RBTREE_RED) {
+        rbtree_set_color(sibling_node, RBTREE_BLACK);
+        rbtree_set_color(parent, RBTREE_RED);
+        right_rotate(t, parent);
+        sibling_node = rbtree_left(parent);
+      } 
+      if(rbtree_color(rbtree_left(sibling_node)) == RBTREE_BLACK && rbtree_color(rbtree_right(sibling_node)) == RBTREE_BLACK) {
+        rbtree_set_color(sibling_node, RBTREE_RED);
+        cursor = parent;
+        parent = rbtree_parent(cursor);
+      } else {
+        if(rbtree_color(rbtree_left(sibling_node)) == RBTREE_BLACK) {
+          rbtree_set_color(rbtree_right(sibling_node), RBTREE_BLACK);
+          rbtree_set_color(sibling_node, RBTREE_RED);
+          left_rotate(t, sibling_node);
+          sibling_node = rbtree_left(parent);
+        }
+        rbtree_set_color(sibling_node, rbtree_color(parent));
+        rbtree_set_color(parent, RBTREE_BLACK);
+        rbtree_set_color(rbtree_left(sibling_node), RBTREE_BLACK);
+        right_rotate(t, parent);
+        cursor = t->root;
+        balanced = 1;
+      }
+    }
+  }
+  int shrunk = !balanced && rbtree_color(cursor) == RBTREE_BLACK;
+  if(cursor != t->nil) {
+    rbtree_set_color(cursor, RBTREE_BLACK);
+  }
+  return shrunk;
+}
+
+/**
+ * T에서 TARGET node를 떼어내는 함수. TARGET의 메모리는 반환하지 않는다.
+ * T의 black height가 1 줄었으면 1을 return.
+*/
+static int unlink_node(rbtree *t, node_t *target) {
+  node_t *y = target;
+  color_t y_color = rbtree_color(y);
+  if(target == t->min) {
+    // min은 왼쪽 자식이 없으므로 오른쪽 subtree의 min이나 parent가 새 min이다
+    t->min = rbtree_right(target) != t->nil ? subtree_min(rbtree_right(target), t->nil) : rbtree_parent(target);
+  }
+  if(target == t->max) {
+    t->max = rbtree_left(target) != t->nil ? subtree_max(rbtree_left(target), t->nil) : rbtree_parent(target);
+  }
+
+#ifdef RBTREE_ORDER_STATS
+  // 실제로 자리에서 빠지는 node(target 또는 target을 대체할 node)의 조상들은 node가 하나 줄어든다.
+  node_t *removed = target;
+  if(rbtree_left(target) != t->nil && rbtree_right(target) != t->nil) {
+    removed = subtree_max(rbtree_left(target), t->nil);
+  }
+  for(node_t *p = rbtree_parent(removed); p != t->nil; p = rbtree_parent(p)) {
+    p->size--;
+  }
+#endif
+
+  node_t *x;
+  node_t *x_parent;   // x가 NIL일 수 있으므로 x의 부모를 따로 기억한다
+  if(rbtree_left(target) == t->nil) {
+    x = rbtree_right(target);
+    x_parent = rbtree_parent(target);
+    trans_plant(t, target, rbtree_right(target));
+  } else if(rbtree_right(target) == t->nil) {
+    x = rbtree_left(target);
+    x_parent = rbtree_parent(target);
+    trans_plant(t, target, rbtree_left(target));
+  } else {
+    /** case 1 **/
+    /** 삭제 될 target의 자리를 right subtree의 min node로 대체 **/
+    // y = subtree_min(target->right, t->nil);
+    // y_color = y->color;
+    // x = y->right;
+    // if(y->parent == target) {
+    //   x->parent = y;
+    // } else {
+    //   trans_plant(t, y, y->right);
+    //   y->right = target->right;
+    //   y->right->parent = y;
+    // }
+    // trans_plant(t, target, y);
+    // y->left = target->left;
+    // y->left->parent = y;
+    // y->color = target->color;
+    /** end of case 1 **/
+
+    /** case 2 **/
     /** 삭제 될 target의 자리를 left subtree의 max node로 대체 **/
-    y = subtree_max(target->left, t->nil);
-    y_color = y->color;
-    x = y->left;
-    if(y->parent == target) {
-      x->parent = y;
+    y = subtree_max(rbtree_left(target), t->nil);
+    y_color = rbtree_color(y);
+    x = rbtree_left(y);
+    if(rbtree_parent(y) == target) {
+      x_parent = y;
     } else {
-      trans_plant(t, y, y->left);
-      y->left = target->left;
-      y->left->parent = y;
+      x_parent = rbtree_parent(y);
+      trans_plant(t, y, rbtree_left(y));
+      rbtree_set_left(y, rbtree_left(target));
+      rbtree_set_parent(rbtree_left(y), y);
     }
     trans_plant(t, target, y);
-    y->right = target->right;
-    y->right->parent = y;
-    y->color = target->color;
+    rbtree_set_right(y, rbtree_right(target));
+    rbtree_set_parent(rbtree_right(y), y);
+    rbtree_set_color(y, rbtree_color(target));
+#ifdef RBTREE_ORDER_STATS
+    y->size = target->size;
+#endif
     /** end of case 2 **/
   }
 
-  free(target);
+  if(t->count != COUNT_UNKNOWN) t->count -= rbtree_copies(target);
 
   if(y_color == RBTREE_BLACK) {
-    rbtree_erase_fixup(t, x);
+    return rbtree_erase_fixup(t, x, x_parent);
   }
+  return 0;
+}
 
-  init_nil(t->nil);
-  
+/**
+ * NODE가 같은 key를 여럿 담고 있으면 그중 하나를 빼고 1을 return하는 함수. (RBTREE_COUNTED)
+ * 마지막 하나이면 0을 return하며, 이때는 NODE를 tree에서 떼어내야 한다.
+*/
+static int drop_copy(rbtree *t, node_t *node) {
+#ifdef RBTREE_COUNTED
+  if(node->copies > 1) {
+    node->copies--;
+    if(t->count != COUNT_UNKNOWN) t->count--;
+    return 1;
+  }
+#endif
+  (void)t;
+  (void)node;
   return 0;
 }
 
 /**
- * 배열 ARR에 ROOT_NODE의 모든 자손 node들을 오름차순으로 저장하는 함수.
- * NIL은 sentinel node 이며, INDEX에는 ARR의 첫번째 인덱스로 지정할 값을 갖는 pointer를 전달한다.
+ * T에서 TARGET node를 삭제하는 함수.
+ * RBTREE_COUNTED이면 TARGET의 key 하나만 지우고, 마지막 하나일 때 node를 삭제한다.
 */
-void set_array(node_t *root_node, node_t *nil, key_t *arr, size_t *index) {
-  if(root_node == nil) return;
-  set_array(root_node->left, nil, arr, index);
-  arr[(*index)++] = root_node->key;
-  set_array(root_node->right, nil, arr, index);
+int rbtree_erase(rbtree *t, node_t *target) {
+  if(drop_copy(t, target)) return 0;
+  unlink_node(t, target);
+  pool_free(tree_pool(t), target);
+  return 0;
 }
 
 /**
- * 길이가 N인 pointer ARR에 T의 node들을 오름차순으로 저장하는 함수.
+ * T에서 KEY를 갖는 node 하나를 삭제하는 함수. KEY가 없으면 -1을 return.
+ * 찾은 node를 그 자리에서 바로 떼어내므로 rbtree_find 후 rbtree_erase를 부르는 것과 결과가 같다.
 */
-int rbtree_to_array(const rbtree *t, key_t *arr, const size_t n) {
-  size_t index = 0;
-  set_array(t->root, t->nil, arr, &index);
+int rbtree_erase_key(rbtree *t, const key_t key) {
+  node_t *cursor = t->root;
+  while(cursor != t->nil) {
+    const int cmp = RBTREE_KEY_COMPARE(key, cursor->key);
+    if(cmp == 0) return rbtree_erase(t, cursor);
+    cursor = cmp < 0 ? rbtree_left(cursor) : rbtree_right(cursor);
+  }
+  return -1;
+}
+
+/**
+ * 자식이 CHILD 하나뿐인(CHILD는 nil일 수 있다) TARGET을 T에서 떼어내는 함수.
+ * min/max node처럼 한쪽 자식이 없는 node는 대체할 node를 찾지 않고 CHILD를 그 자리에 올리면 된다.
+ * min/max cache는 호출하는 쪽에서 고친다.
+*/
+static void unlink_edge_node(rbtree *t, node_t *target, node_t *child) {
+  node_t *parent = rbtree_parent(target);
+#ifdef RBTREE_ORDER_STATS
+  for(node_t *p = parent; p != t->nil; p = rbtree_parent(p)) {
+    p->size--;
+  }
+#endif
+  trans_plant(t, target, child);
+  if(t->count != COUNT_UNKNOWN) t->count -= rbtree_copies(target);
+  if(rbtree_color(target) == RBTREE_BLACK) {
+    rbtree_erase_fixup(t, child, parent);
+  }
+}
+
+/**
+ * T에서 최소 key를 갖는 node를 삭제하고 그 key를 KEY에 담는 함수. (KEY가 NULL이면 담지 않는다)
+ * T가 비어 있으면 -1을 return.
+ * 
+ * cache한 min은 왼쪽 자식이 없으므로 오른쪽 자식(있다면 red leaf)을 그 자리에 올리기만 하고,
+ * 새 min은 그 오른쪽 자식이나 parent이다. 탐색 없이 amortized O(1)이므로 priority queue로 쓸 수 있다.
+*/
+int rbtree_pop_min(rbtree *t, key_t *key) {
+  node_t *min = rbtree_min(t);
+  if(min == t->nil) return -1;
+  if(key != NULL) *key = min->key;
+  if(drop_copy(t, min)) return 0;
+
+  node_t *right = rbtree_right(min);
+  t->min = right != t->nil ? subtree_min(right, t->nil) : rbtree_parent(min);
+  if(min == t->max) t->max = t->min;
+  unlink_edge_node(t, min, right);
+  pool_free(tree_pool(t), min);
   return 0;
 }
+
+/**
+ * T에서 최대 key를 갖는 node를 삭제하고 그 key를 KEY에 담는 함수. rbtree_pop_min과 대칭이다.
+*/
+int rbtree_pop_max(rbtree *t, key_t *key) {
+  node_t *max = rbtree_max(t);
+  if(max == t->nil) return -1;
+  if(key != NULL) *key = max->key;
+  if(drop_copy(t, max)) return 0;
+
+  node_t *left = rbtree_left(max);
+  t->max = left != t->nil ? subtree_max(left, t->nil) : rbtree_parent(max);
+  if(max == t->min) t->min = t->max;
+  unlink_edge_node(t, max, left);
+  pool_free(tree_pool(t), max);
+  return 0;
+}
+
+/**
+ * T에서 NODE 다음 순서의 node를 return하는 함수. 마지막 node이면 T의 NIL을 return한다.
+ * parent pointer를 따라가므로 추가 메모리 없이 O(1) amortized로 동작한다.
+*/
+node_t *successor(const rbtree *t, const node_t *node) {
+  if(rbtree_right(node) != t->nil) {
+    return subtree_min(rbtree_right(node), t->nil);
+  }
+  node_t *parent = rbtree_parent(node);
+  while(parent != t->nil && node == rbtree_right(parent)) {
+    node = parent;
+    parent = rbtree_parent(parent);
+  }
+  return parent;
+}
+
+/**
+ * T에서 NODE 이전 순서의 node를 return하는 함수. 첫 node이면 T의 NIL을 return한다.
+*/
+node_t *predecessor(const rbtree *t, const node_t *node) {
+  if(rbtree_left(node) != t->nil) {
+    return subtree_max(rbtree_left(node), t->nil);
+  }
+  node_t *parent = rbtree_parent(node);
+  while(parent != t->nil && node == rbtree_left(parent)) {
+    node = parent;
+    parent = rbtree_parent(parent);
+  }
+  return parent;
+}
+
+/**
+ * T에 저장된 key의 수를 return하는 함수.
+*/
+size_t rbtree_size(const rbtree *t) {
+  return t->count;
+}
+
+/**
+ * NIL을 NULL로 바꾸어 return하는 함수.
+*/
+static node_t *nil_to_null(const rbtree *t, node_t *node) {
+  return node == t->nil ? NULL : node;
+}
+
+/**
+ * T에서 NODE 다음 순서의 node를 return하는 함수.
+ * NODE가 마지막 node이면 NULL을 return.
+*/
+node_t *rbtree_next(const rbtree *t, const node_t *node) {
+  return nil_to_null(t, successor(t, node));
+}
+
+/**
+ * T에서 NODE 이전 순서의 node를 return하는 함수.
+ * NODE가 첫 node이면 NULL을 return.
+*/
+node_t *rbtree_prev(const rbtree *t, const node_t *node) {
+  return nil_to_null(t, predecessor(t, node));
+}
+
+/**
+ * T에서 key가 KEY 이상인 첫 node를 return하는 함수. 그런 node가 없으면 NULL을 return.
+ * 같은 key가 여러 개이면 그중 가장 앞의 node를 return한다.
+*/
+node_t *rbtree_lower_bound(const rbtree *t, const key_t key) {
+  node_t *bound = t->nil;
+  node_t *cursor = t->root;
+  while(cursor != t->nil) {
+    if(RBTREE_KEY_LESS(cursor->key, key)) {
+      cursor = rbtree_right(cursor);
+    } else {
+      bound = cursor;
+      cursor = rbtree_left(cursor);
+    }
+  }
+  return nil_to_null(t, bound);
+}
+
+/**
+ * T에서 key가 KEY보다 큰 첫 node를 return하는 함수. 그런 node가 없으면 NULL을 return.
+*/
+node_t *rbtree_upper_bound(const rbtree *t, const key_t key) {
+  node_t *bound = t->nil;
+  node_t *cursor = t->root;
+  while(cursor != t->nil) {
+    if(RBTREE_KEY_LESS(key, cursor->key)) {
+      bound = cursor;
+      cursor = rbtree_left(cursor);
+    } else {
+      cursor = rbtree_right(cursor);
+    }
+  }
+  return nil_to_null(t, bound);
+}
+
+/**
+ * T에서 key가 KEY인 node들의 범위 [lower_bound, upper_bound)를 return하는 함수.
+ * KEY가 없으면 FIRST와 LAST가 같다.
+*/
+rbtree_range rbtree_equal_range(const rbtree *t, const key_t key) {
+  rbtree_range range = {rbtree_lower_bound(t, key), rbtree_upper_bound(t, key)};
+  return range;
+}
+
+/**
+ * T에서 key가 [LO, HI) 범위에 있는 key의 수를 return하는 함수.
+ * RBTREE_ORDER_STATS이면 O(log n), 아니면 O(log n + k)
+*/
+size_t rbtree_count_range(const rbtree *t, const key_t lo, const key_t hi) {
+  if(!RBTREE_KEY_LESS(lo, hi)) return 0;
+#ifdef RBTREE_ORDER_STATS
+  return rbtree_rank(t, hi) - rbtree_rank(t, lo);
+#else
+  size_t count = 0;
+  for(node_t *p = rbtree_lower_bound(t, lo); p != NULL && RBTREE_KEY_LESS(p->key, hi); p = rbtree_next(t, p)) {
+    count += rbtree_copies(p);
+  }
+  return count;
+#endif
+}
+
+#ifdef RBTREE_ORDER_STATS
+/**
+ * T에서 K번째(0부터 시작)로 작은 node를 return하는 함수. K가 T의 크기 이상이면 NULL을 return.
+*/
+node_t *rbtree_select(const rbtree *t, const size_t k) {
+  size_t rest = k;
+  node_t *cursor = t->root;
+  while(cursor != t->nil) {
+    size_t left_size = rbtree_left(cursor)->size;
+    if(rest < left_size) {
+      cursor = rbtree_left(cursor);
+    } else if(rest == left_size) {
+      return cursor;
+    } else {
+      rest -= left_size + 1;
+      cursor = rbtree_right(cursor);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * T에서 key가 KEY보다 작은 node의 수를 return하는 함수.
+ * rbtree_lower_bound(t, KEY)가 return하는 node의 순서(0부터 시작)와 같다.
+*/
+size_t rbtree_rank(const rbtree *t, const key_t key) {
+  size_t rank = 0;
+  node_t *cursor = t->root;
+  while(cursor != t->nil) {
+    if(RBTREE_KEY_LESS(cursor->key, key)) {
+      rank += rbtree_left(cursor)->size + 1;
+      cursor = rbtree_right(cursor);
+    } else {
+      cursor = rbtree_left(cursor);
+    }
+  }
+  return rank;
+}
+#endif
+
+/**
+ * T의 최소 node에 위치한 cursor를 return하는 함수. T가 비어 있으면 cursor의 node는 NULL이다.
+*/
+rbtree_cursor rbtree_cursor_first(const rbtree *t) {
+  rbtree_cursor c = {t, nil_to_null(t, subtree_min(t->root, t->nil))};
+  return c;
+}
+
+/**
+ * T의 최대 node에 위치한 cursor를 return하는 함수. T가 비어 있으면 cursor의 node는 NULL이다.
+*/
+rbtree_cursor rbtree_cursor_last(const rbtree *t) {
+  rbtree_cursor c = {t, nil_to_null(t, subtree_max(t->root, t->nil))};
+  return c;
+}
+
+/**
+ * T의 NODE에 위치한 cursor를 return하는 함수.
+ * rbtree_find 등이 return한 node에서 순회를 이어갈 때 사용한다.
+*/
+rbtree_cursor rbtree_cursor_at(const rbtree *t, node_t *node) {
+  rbtree_cursor c = {t, node};
+  return c;
+}
+
+/**
+ * cursor C를 다음 node로 옮기고 그 node를 return하는 함수. 범위를 벗어나면 NULL을 return.
+*/
+node_t *rbtree_cursor_next(rbtree_cursor *c) {
+  if(c->node != NULL) {
+    c->node = rbtree_next(c->tree, c->node);
+  }
+  return c->node;
+}
+
+/**
+ * cursor C를 이전 node로 옮기고 그 node를 return하는 함수. 범위를 벗어나면 NULL을 return.
+*/
+node_t *rbtree_cursor_prev(rbtree_cursor *c) {
+  if(c->node != NULL) {
+    c->node = rbtree_prev(c->tree, c->node);
+  }
+  return c->node;
+}
+
+/**
+ * 길이가 N인 pointer ARR에 T의 node들을 오름차순으로 저장하는 함수.
+ * T의 크기가 N보다 크면 순서대로 N개까지만 저장한다.
+ * 
+ * 재귀 대신 successor를 따라 순회하므로 tree의 높이와 관계없이 stack을 사용하지 않는다.
+*/
+int rbtree_to_array(const rbtree *t, key_t *arr, const size_t n) {
+  if(n == 0 || t->root == t->nil) return 0;
+
+  size_t index = 0;
+  node_t *cursor = subtree_min(t->root, t->nil);
+  while(cursor != t->nil && index < n) {
+    for(size_t copies = rbtree_copies(cursor); copies > 0 && index < n; copies--) {
+      arr[index++] = cursor->key;
+    }
+    cursor = successor(t, cursor);
+  }
+  return 0;
+}
+
+/**
+ * rbtree_export가 이어서 내보낼 첫 node를 return하는 함수. 더 내보낼 node가 없으면 NULL을 return.
+ * TOKEN의 마지막 key와 같은 key는 이미 내보낸 TOKEN->dups개를 건너뛴다.
+ * 그 node의 key 중 앞의 몇 개를 이미 내보냈으면(RBTREE_COUNTED) 그 수를 SKIP에 담는다.
+*/
+static node_t *export_resume(const rbtree *t, const rbtree_export_token *token, size_t *skip) {
+  *skip = 0;
+  if(!token->started) return nil_to_null(t, subtree_min(t->root, t->nil));
+#ifdef RBTREE_ORDER_STATS
+  return rbtree_select(t, rbtree_rank(t, token->last) + token->dups);
+#else
+  node_t *p = rbtree_lower_bound(t, token->last);
+  size_t dups = token->dups;
+  while(dups > 0 && p != NULL && !RBTREE_KEY_LESS(token->last, p->key)) {
+    if(dups < rbtree_copies(p)) {
+      *skip = dups;
+      break;
+    }
+    dups -= rbtree_copies(p);
+    p = rbtree_next(t, p);
+  }
+  return p;
+#endif
+}
+
+/**
+ * T의 key를 TOKEN의 위치부터 오름차순으로 길이 N인 BUF에 채우고, 채운 key의 수를 return하는 함수.
+ * 0을 return하면 export가 끝난 것이다.
+ * 
+ * TOKEN은 0으로 초기화하여 처음부터 시작하며, 호출할 때마다 마지막으로 내보낸 위치로 갱신된다.
+ * node 대신 key로 위치를 기억하므로 호출 사이에 tree가 바뀌어도 되고,
+ * 그때는 이미 내보낸 마지막 key 뒤의 key부터 이어서 내보낸다.
+ * 이어서 시작하는 데 O(log n)이 걸린다. (RBTREE_ORDER_STATS가 아니면 같은 key를 건너뛰는 만큼 더 걸린다)
+*/
+size_t rbtree_export(const rbtree *t, rbtree_export_token *token, key_t *buf, const size_t n) {
+  if(n == 0) return 0;
+  size_t count = 0, skip;
+  for(node_t *p = export_resume(t, token, &skip); p != NULL && p != t->nil && count < n; p = successor(t, p)) {
+    for(size_t copies = rbtree_copies(p) - skip; copies > 0 && count < n; copies--) {
+      buf[count++] = p->key;
+    }
+    skip = 0;
+  }
+  if(count == 0) return 0;
+
+  // 이번에 채운 key 중 마지막 key와 같은 key의 수
+  const key_t last = buf[count - 1];
+  size_t run = 1;
+  while(run < count && !RBTREE_KEY_LESS(buf[count - run - 1], last)) run++;
+  if(run == count && token->started && !RBTREE_KEY_LESS(token->last, last)) {
+    token->dups += run;
+  } else {
+    token->dups = run;
+  }
+  token->last = last;
+  token->started = 1;
+  return count;
+}
+
+/**
+ * T의 key를 오름차순으로 길이 BATCH인 BUF에 채워 가며, 가득 찰 때마다(마지막에는 남은 만큼) VISIT을 호출하는 함수.
+ * tree를 한 번만 순회하며 BUF 외의 메모리를 쓰지 않는다.
+ * VISIT이 0이 아닌 값을 return하면 순회를 멈추고 그 값을 return한다. 끝까지 순회하면 0을 return.
+*/
+int rbtree_export_each(const rbtree *t, key_t *buf, const size_t batch, rbtree_visitor visit, void *ctx) {
+  if(batch == 0) return 0;
+  size_t count = 0;
+  for(node_t *p = subtree_min(t->root, t->nil); p != t->nil; p = successor(t, p)) {
+    for(size_t copies = rbtree_copies(p); copies > 0; copies--) {
+      buf[count++] = p->key;
+      if(count == batch) {
+        int stop = visit(buf, count, ctx);
+        if(stop != 0) return stop;
+        count = 0;
+      }
+    }
+  }
+  return count > 0 ? visit(buf, count, ctx) : 0;
+}
+
+static int compare_keys(const void *p1, const void *p2) {
+  const key_t *k1 = (const key_t *)p1;
+  const key_t *k2 = (const key_t *)p2;
+  return RBTREE_KEY_COMPARE(*k1, *k2);
+}
+
+#ifndef RBTREE_COUNTED
+/**
+ * tree의 기존 node들과 정렬된 batch의 새 node들을 key 순서대로 merge하여 공급하는 node_source.
+ * 같은 key이면 기존 node가 먼저 나온다.
+*/
+typedef struct {
+  node_t **old_nodes;
+  size_t old_count, old_next;
+  node_t **new_nodes;
+  size_t new_count, new_next;
+} merge_source;
+
+static node_t *next_merged_node(void *ctx) {
+  merge_source *src = (merge_source *)ctx;
+  if(src->new_next == src->new_count ||
+     (src->old_next < src->old_count &&
+      !RBTREE_KEY_LESS(src->new_nodes[src->new_next]->key, src->old_nodes[src->old_next]->key))) {
+    return src->old_nodes[src->old_next++];
+  }
+  return src->new_nodes[src->new_next++];
+}
+
+/**
+ * T의 node들과 정렬된 KEYS로 tree 전체를 O(m + n)에 다시 만드는 함수.
+ * 기존 node는 그대로 재사용하므로 node pointer는 계속 유효하다.
+*/
+static int rebuild_with_batch(rbtree *t, const key_t *keys, const size_t n) {
+  size_t m = rbtree_size(t);
+  node_t **nodes = (node_t **)malloc((m + n) * sizeof(node_t *));
+  if(nodes == NULL) return -1;
+
+  size_t i = 0;
+  for(node_t *p = subtree_min(t->root, t->nil); p != t->nil; p = successor(t, p)) {
+    nodes[i++] = p;
+  }
+  for(size_t j = 0; j < n; j++) {
+    node_t *new_node = create_new_node(t, keys[j]);
+    if(new_node == NULL) {
+      while(j > 0) pool_free(tree_pool(t), nodes[m + --j]);
+      free(nodes);
+      return -1;
+    }
+    nodes[m + j] = new_node;
+  }
+
+  merge_source src = {nodes, m, 0, nodes + m, n, 0};
+  build_tree(t, m + n, m + n, next_merged_node, &src);
+  free(nodes);
+  return 0;
+}
+#else
+/**
+ * tree의 기존 node들과 정렬된 batch의 key들을 key 순서대로 merge하여 공급하는 node_source. (RBTREE_COUNTED)
+ * batch의 key는 같은 key의 기존 node에 더하고, 기존 node가 없는 key는 BLOCK의 새 node 하나에 모은다.
+*/
+typedef struct {
+  node_t **old_nodes;
+  size_t old_count, old_next;
+  const key_t *keys;
+  size_t key_count, key_next;
+  node_t *block;
+  size_t block_next;
+} counted_merge_source;
+
+static node_t *next_counted_node(void *ctx) {
+  counted_merge_source *src = (counted_merge_source *)ctx;
+  node_t *node;
+  if(src->old_next < src->old_count &&
+     (src->key_next == src->key_count ||
+      !RBTREE_KEY_LESS(src->keys[src->key_next], src->old_nodes[src->old_next]->key))) {
+    node = src->old_nodes[src->old_next++];
+  } else {
+    node = &src->block[src->block_next++];
+    node->key = src->keys[src->key_next];
+    node->copies = 0;
+  }
+  while(src->key_next < src->key_count && !RBTREE_KEY_LESS(node->key, src->keys[src->key_next])) {
+    node->copies++;
+    src->key_next++;
+  }
+  return node;
+}
+
+/**
+ * T의 node들과 정렬된 KEYS로 tree 전체를 O(m + n)에 다시 만드는 함수. (RBTREE_COUNTED)
+ * 기존 node는 그대로 재사용하므로 node pointer는 계속 유효하다.
+ * tree를 바꾸기 전에 새 node 수와 copies가 넘치는지를 먼저 세므로, 실패해도 T는 그대로이다.
+*/
+static int rebuild_with_batch(rbtree *t, const key_t *keys, const size_t n) {
+  size_t m = 0;
+  for(node_t *p = subtree_min(t->root, t->nil); p != t->nil; p = successor(t, p)) {
+    m++;
+  }
+  node_t **nodes = (node_t **)malloc((m + 1) * sizeof(node_t *));
+  if(nodes == NULL) return -1;
+  size_t i = 0;
+  for(node_t *p = subtree_min(t->root, t->nil); p != t->nil; p = successor(t, p)) {
+    nodes[i++] = p;
+  }
+
+  // 기존 node가 없는 key의 수
+  size_t fresh = 0;
+  for(size_t j = 0, k = 0; j < n;) {
+    size_t run = 1;
+    while(j + run < n && !RBTREE_KEY_LESS(keys[j], keys[j + run])) run++;
+    while(k < m && RBTREE_KEY_LESS(nodes[k]->key, keys[j])) k++;
+    size_t copies = run;
+    if(k < m && !RBTREE_KEY_LESS(keys[j], nodes[k]->key)) {
+      copies += nodes[k]->copies;
+    } else {
+      fresh++;
+    }
+    if(copies > RBTREE_MAX_COPIES) {
+      free(nodes);
+      return -1;
+    }
+    j += run;
+  }
+
+  node_t *block = fresh == 0 ? NULL : pool_alloc_block(tree_pool(t), fresh);
+  if(fresh > 0 && block == NULL) {
+    free(nodes);
+    return -1;
+  }
+  counted_merge_source src = {nodes, m, 0, keys, n, 0, block, 0};
+  build_tree(t, m + fresh, rbtree_size(t) + n, next_counted_node, &src);
+  free(nodes);
+  return 0;
+}
+#endif
+
+/**
+ * batch 크기 * BATCH_REBUILD_RATIO가 tree 크기 이상이면 하나씩 insert하지 않고 tree를 다시 만든다.
+ * 
+ * 정렬된 batch의 finger insert는 cache 지역성이 좋아서, driver의 batch benchmark에서
+ * batch가 tree 크기와 비슷해질 때까지 rebuild보다 느려지지 않았다.
+*/
+#ifndef BATCH_REBUILD_RATIO
+#define BATCH_REBUILD_RATIO 1
+#endif
+
+/**
+ * batch 크기 * BATCH_FINGER_RATIO가 tree 크기보다 작으면 정렬하지 않고 root부터 하나씩 insert한다.
+ * 
+ * 작은 batch의 key들은 tree 안에서 서로 멀어서 finger가 거의 root까지 올라갔다 내려와야 하므로,
+ * 이미 정렬되어 있어도 root부터 찾는 것보다 느리다. driver의 batch benchmark에서
+ * 1M tree는 batch가 약 1/32일 때 정렬한 finger insert가 insert 반복을 따라잡았다.
+*/
+#ifndef BATCH_FINGER_RATIO
+#define BATCH_FINGER_RATIO 32
+#endif
+
+/**
+ * KEYS의 N개 key가 정렬되어 있으면 1을 return하는 함수. O(n)
+*/
+static int keys_sorted(const key_t *keys, const size_t n) {
+  for(size_t i = 1; i < n; i++) {
+    if(RBTREE_KEY_LESS(keys[i], keys[i - 1])) return 0;
+  }
+  return 1;
+}
+
+/**
+ * T에 정렬된 KEYS의 N개 key를 삽입하는 함수. 크기에 따라 tree를 다시 만들거나 finger insert를 한다.
+*/
+static int insert_sorted_batch(rbtree *t, const key_t *sorted, const size_t n) {
+  if(n * BATCH_REBUILD_RATIO >= rbtree_size(t)) return rebuild_with_batch(t, sorted, n);
+  node_t *finger = NULL;
+  for(size_t i = 0; i < n; i++) {
+    finger = insert_key_near(t, finger, sorted[i]);
+    if(finger == NULL) return -1;
+  }
+  return 0;
+}
+
+/**
+ * T에 KEYS의 N개 key를 모두 삽입하는 함수.
+ * 
+ * batch를 정렬한 뒤, tree에 비해 batch가 작으면 직전에 삽입한 node에서부터 위치를 찾아
+ * (root부터 다시 내려가지 않고) 하나씩 삽입하고, 크면 기존 tree와 merge하여 O(m + n)에 다시 만든다.
+ * tree에 비해 아주 작은 batch는 정렬하지 않고 입력 순서대로 root부터 삽입하며, 이미 정렬된 batch는 복사하지 않는다.
+ * 성공하면 0, 메모리 할당에 실패하면 -1을 return.
+ * 하나씩 삽입하던 중에 실패하면 그때까지 삽입한 key(정렬된 batch 또는 입력 순서의 앞부분)는 T에 남는다.
+ * tree를 다시 만드는 경우에는 실패해도 T는 그대로이다.
+*/
+int rbtree_insert_batch(rbtree *t, const key_t *keys, const size_t n) {
+  if(n == 0) return 0;
+  if(n * BATCH_FINGER_RATIO < rbtree_size(t)) {
+    for(size_t i = 0; i < n; i++) {
+      if(insert_key_near(t, NULL, keys[i]) == NULL) return -1;
+    }
+    return 0;
+  }
+  if(keys_sorted(keys, n)) return insert_sorted_batch(t, keys, n);
+
+  key_t *sorted = (key_t *)malloc(n * sizeof(key_t));
+  if(sorted == NULL) return -1;
+  memcpy(sorted, keys, n * sizeof(key_t));
+  qsort(sorted, n, sizeof(key_t), compare_keys);
+  int result = insert_sorted_batch(t, sorted, n);
+  free(sorted);
+  return result;
+}
+
+/**
+ * join/split에서 다루는 떨어진 subtree.
+ * ROOT는 black이고 (비어 있으면 NIL) ROOT의 parent는 NIL이다.
+ * BH는 ROOT에서 leaf까지 경로의 black node 수이다. (NIL 제외, 빈 subtree는 0)
+*/
+typedef struct {
+  node_t *root;
+  int bh;
+} subtree;
+
+#define EMPTY_SUBTREE ((subtree){NIL, 0})
+
+/**
+ * ROOT가 root인 subtree의 key 수를 return하는 함수. ORDER_STATS이면 O(1), 아니면 O(subtree 크기)
+*/
+static size_t subtree_keys(const node_t *root) {
+#ifdef RBTREE_ORDER_STATS
+  return root->size;
+#else
+  if(root == NIL) return 0;
+  return subtree_keys(rbtree_left(root)) + rbtree_copies(root) + subtree_keys(rbtree_right(root));
+#endif
+}
+
+/**
+ * T 전체를 subtree로 return하는 함수.
+*/
+static subtree tree_subtree(const rbtree *t) {
+  subtree s = {t->root, 0};
+  for(node_t *p = t->root; p != NIL; p = rbtree_left(p)) {
+    if(rbtree_color(p) == RBTREE_BLACK) s.bh++;
+  }
+  return s;
+}
+
+/**
+ * 자식 subtree S를 부모에서 떼어내는 함수. root가 red이면 black으로 바꾼다.
+*/
+static void detach_subtree(subtree *s) {
+  if(s->root == NIL) return;
+  rbtree_set_parent(s->root, NIL);
+  if(rbtree_color(s->root) == RBTREE_RED) {
+    rbtree_set_color(s->root, RBTREE_BLACK);
+    s->bh++;
+  }
+}
+
+/**
+ * S의 root를 떼어내고 왼쪽, 오른쪽 subtree를 L, R에 담는 함수.
+*/
+static void expose(subtree s, subtree *l, subtree *r) {
+  *l = (subtree){rbtree_left(s.root), s.bh - 1};
+  *r = (subtree){rbtree_right(s.root), s.bh - 1};
+  detach_subtree(l);
+  detach_subtree(r);
+}
+
+/**
+ * K의 자식으로 LEFT, RIGHT를 연결하는 함수.
+*/
+static void link_children(node_t *k, node_t *left, node_t *right) {
+  rbtree_set_left(k, left);
+  rbtree_set_right(k, right);
+  if(left != NIL) rbtree_set_parent(left, k);
+  if(right != NIL) rbtree_set_parent(right, k);
+#ifdef RBTREE_ORDER_STATS
+  update_size(k);
+#endif
+}
+
+/**
+ * L의 모든 key <= K의 key <= R의 모든 key일 때, L, K, R을 하나의 subtree로 합치는 함수.
+ * black height가 큰 쪽의 spine을 따라 내려가 작은 쪽과 같은 black height의 자리에 K를 red로 연결하고
+ * insert fixup으로 복구한다. O(|L.bh - R.bh| + 1)
+*/
+static subtree join3(subtree l, node_t *k, subtree r) {
+  if(l.bh == r.bh) {
+    link_children(k, l.root, r.root);
+    rbtree_set_parent(k, NIL);
+    rbtree_set_color(k, RBTREE_BLACK);
+    return (subtree){k, l.bh + 1};
+  }
+
+  rbtree tmp = {.nil = NIL, .count = COUNT_UNKNOWN};
+  node_t *parent = NIL;
+  int h;
+  if(l.bh > r.bh) {
+    // L의 right spine에서 black height가 R과 같은 black node를 찾는다
+    node_t *c = l.root;
+    for(h = l.bh; rbtree_color(c) == RBTREE_RED || h > r.bh; c = rbtree_right(c)) {
+      if(rbtree_color(c) == RBTREE_BLACK) h--;
+      parent = c;
+    }
+    tmp.root = l.root;
+    link_children(k, c, r.root);
+    rbtree_set_right(parent, k);
+  } else {
+    node_t *c = r.root;
+    for(h = r.bh; rbtree_color(c) == RBTREE_RED || h > l.bh; c = rbtree_left(c)) {
+      if(rbtree_color(c) == RBTREE_BLACK) h--;
+      parent = c;
+    }
+    tmp.root = r.root;
+    link_children(k, l.root, c);
+    rbtree_set_left(parent, k);
+  }
+  rbtree_set_parent(k, parent);
+  rbtree_set_color(k, RBTREE_RED);
+#ifdef RBTREE_ORDER_STATS
+  for(node_t *p = parent; p != NIL; p = rbtree_parent(p)) {
+    update_size(p);
+  }
+#endif
+
+  int bh = l.bh > r.bh ? l.bh : r.bh;
+  bh += rbtree_insert_fixup(&tmp, k);
+  return (subtree){tmp.root, bh};
+}
+
+/**
+ * L의 모든 key <= R의 모든 key일 때 L과 R을 합치는 함수.
+ * R의 min node를 떼어내 가운데 node로 사용한다.
+*/
+static subtree join2(subtree l, subtree r) {
+  if(l.root == NIL) return r;
+  if(r.root == NIL) return l;
+
+  rbtree tmp = {.root = r.root, .nil = NIL, .count = COUNT_UNKNOWN};
+  node_t *k = subtree_min(r.root, NIL);
+  r.bh -= unlink_node(&tmp, k);
+  r.root = tmp.root;
+  return join3(l, k, r);
+}
+
+/**
+ * S를 KEY 기준으로 둘로 나누는 함수.
+ * INCLUSIVE가 0이면 L에 KEY보다 작은 key, R에 나머지를 담고
+ * INCLUSIVE가 1이면 L에 KEY 이하의 key, R에 나머지를 담는다.
+*/
+static void split_subtree(subtree s, const key_t key, const int inclusive, subtree *l, subtree *r) {
+  if(s.root == NIL) {
+    *l = EMPTY_SUBTREE;
+    *r = EMPTY_SUBTREE;
+    return;
+  }
+
+  node_t *k = s.root;
+  subtree a, b;
+  expose(s, &a, &b);
+  if(inclusive ? RBTREE_KEY_LESS(key, k->key) : !RBTREE_KEY_LESS(k->key, key)) {
+    subtree ar;
+    split_subtree(a, key, inclusive, l, &ar);
+    *r = join3(ar, k, b);
+  } else {
+    subtree bl;
+    split_subtree(b, key, inclusive, &bl, r);
+    *l = join3(a, k, bl);
+  }
+}
+
+/**
+ * S를 KEY보다 작은 key(LT), KEY와 같은 key(EQ), 큰 key(GT)로 나누는 함수.
+*/
+static void split3(subtree s, const key_t key, subtree *lt, subtree *eq, subtree *gt) {
+  subtree ge;
+  split_subtree(s, key, 0, lt, &ge);
+  split_subtree(ge, key, 1, eq, gt);
+}
+
+typedef enum { SET_UNION, SET_INTERSECTION, SET_DIFFERENCE } set_op;
+
+/**
+ * 집합 연산의 한 단계.
+ * B의 root K를 기준으로 A와 B를 나눈 두 부분 문제 (AL, BL), (AG, BR)와
+ * 두 결과 사이에 들어갈 가운데 node(K 또는 EQ)를 담는다.
+*/
+typedef struct {
+  subtree al, bl;
+  subtree ag, br;
+  node_t *k;    // 결과에 K 하나가 들어가면 K, 아니면 NULL
+  subtree eq;   // K가 NULL일 때 가운데에 들어갈 subtree (A의 K와 같은 key들)
+  size_t tally; // 결과 크기를 구하기 위해 이 단계에서 센 key 수 (set_operation 참고)
+} set_step;
+
+/**
+ * A나 B가 비어 있으면 결과를 RESULT에 담고 1을 return하는 함수.
+*/
+static int set_base_case(set_op op, node_pool *pool, subtree a, subtree b, subtree *result) {
+  if(a.root != NIL && b.root != NIL) return 0;
+
+  switch(op) {
+    case SET_UNION:
+      *result = a.root == NIL ? b : a;
+      break;
+    case SET_INTERSECTION:
+      pool_free_subtree(pool, a.root);
+      pool_free_subtree(pool, b.root);
+      *result = EMPTY_SUBTREE;
+      break;
+    case SET_DIFFERENCE:
+      pool_free_subtree(pool, b.root);
+      *result = a;
+      break;
+  }
+  return 1;
+}
+
+/**
+ * B의 root K를 떼어내고 A를 K의 key로 나누는 함수. 결과에 남지 않는 node는 POOL로 돌려보낸다.
+ * 
+ * union: A에 K와 같은 key가 없으면 K가, 있으면 A의 같은 key들이 가운데에 들어가고 B 쪽의 같은 key는 모두 버린다.
+ * intersection: A의 같은 key들만 가운데에 남는다. (K의 key는 B에 있으므로)
+ * difference: A의 같은 key들을 모두 버린다.
+ * 
+ * STEP->TALLY에는 union이면 버린 B의 key 수, intersection이면 남긴 A의 key 수, difference면 버린 A의 key 수를 담는다.
+ * 셀 때 걸리는 시간은 버리거나 남기는 같은 key들의 수에 비례한다.
+*/
+static void set_divide(set_op op, node_pool *pool, subtree a, subtree b, set_step *step) {
+  node_t *k = b.root;
+  subtree aeq;
+  expose(b, &step->bl, &step->br);
+  split3(a, k->key, &step->al, &aeq, &step->ag);
+  step->k = NULL;
+  step->eq = EMPTY_SUBTREE;
+  step->tally = 0;
+
+  if(op == SET_UNION && aeq.root == NIL) {
+    step->k = k;
+    return;
+  }
+  if(op == SET_UNION) {
+    subtree dup;
+    split_subtree(step->bl, k->key, 0, &step->bl, &dup);
+    step->tally += subtree_keys(dup.root);
+    pool_free_subtree(pool, dup.root);
+    split_subtree(step->br, k->key, 1, &dup, &step->br);
+    step->tally += subtree_keys(dup.root);
+    pool_free_subtree(pool, dup.root);
+    step->tally += rbtree_copies(k);
+  } else {
+    step->tally = subtree_keys(aeq.root);
+  }
+  if(op == SET_DIFFERENCE) {
+    pool_free_subtree(pool, aeq.root);
+  } else {
+    step->eq = aeq;
+  }
+  pool_free(pool, k);
+}
+
+/**
+ * 두 부분 문제의 결과 L, R과 STEP의 가운데 node를 합치는 함수.
+*/
+static subtree set_combine(const set_step *step, subtree l, subtree r) {
+  if(step->k != NULL) {
+    return join3(l, step->k, r);
+  }
+  return join2(join2(l, step->eq), r);
+}
+
+/**
+ * A와 B에 OP를 수행한 subtree를 return하는 함수. 크기가 m <= n일 때 O(m log(n/m + 1))
+ * 
+ * union: A의 모든 node와, B의 node 중 A에 같은 key가 없는 node
+ * intersection: A의 node 중 B에 같은 key가 있는 node
+ * difference: A의 node 중 B에 같은 key가 없는 node
+ * 결과에 남지 않는 node는 POOL로 돌려보낸다. set_divide가 센 key 수는 TALLY에 더한다.
+*/
+static subtree set_subtree(set_op op, node_pool *pool, subtree a, subtree b, size_t *tally) {
+  subtree result;
+  if(set_base_case(op, pool, a, b, &result)) return result;
+
+  set_step step;
+  set_divide(op, pool, a, b, &step);
+  *tally += step.tally;
+  subtree l = set_subtree(op, pool, step.al, step.bl, tally);
+  subtree r = set_subtree(op, pool, step.ag, step.br, tally);
+  return set_combine(&step, l, r);
+}
+
+/**
+ * T2의 node를 T1의 pool에서 다룰 수 있도록 T2의 pool을 T1의 pool에 합치고, 그 pool을 return하는 함수.
+ * T2가 pool을 혼자 쓰고 있었으면 T2에는 빈 pool이 남는다.
+*/
+static node_pool *share_pool(rbtree *t1, rbtree *t2) {
+  node_pool *p1 = tree_pool(t1);
+  node_pool *p2 = tree_pool(t2);
+  if(p1 != p2) merge_node_pool(p1, p2);
+  return p1;
+}
+
+/**
+ * node를 모두 내준 T2가 아직 다른 tree와 pool을 공유하면 새 빈 pool로 옮기는 함수.
+ * join과 집합 연산 뒤의 T2가 다른 thread에 넘겨져도 되도록 한다.
+ * 메모리가 부족하면 T2는 pool을 계속 공유한다.
+*/
+static void detach_empty_tree(rbtree *t2) {
+  node_pool *pool = tree_pool(t2);
+  if(pool->refs == 1) return;
+  node_pool *fresh = new_node_pool();
+  if(fresh == NULL) return;
+  release_node_pool(pool);
+  t2->pool = fresh;
+}
+
+/**
+ * T1의 모든 key <= T2의 모든 key일 때 T2의 node를 모두 T1로 옮기는 함수. T2는 빈 tree가 된다.
+ * node를 새로 할당하지 않으며 O(log n)에 동작한다.
+ * 조건을 만족하지 않으면 아무것도 바꾸지 않고 -1을 return.
+ * T2의 node pool은 T1의 pool에 합쳐지므로, T2와 pool을 공유하던 tree(split)는 이후 T1과 pool을 공유한다.
+ * 비워진 T2는 자기 pool을 가지므로 다른 thread에서 써도 된다.
+*/
+int rbtree_join(rbtree *t1, rbtree *t2) {
+  if(t1 == t2) return -1;
+  if(t1->root != t1->nil && t2->root != t2->nil
+     && RBTREE_KEY_LESS(subtree_min(t2->root, t2->nil)->key, subtree_max(t1->root, t1->nil)->key)) {
+    return -1;
+  }
+
+#ifdef RBTREE_COUNTED
+  // 경계의 같은 key는 T1의 max node 하나에 모은다
+  node_t *max = rbtree_max(t1);
+  node_t *min = rbtree_min(t2);
+  if(max != t1->nil && min != t2->nil && !RBTREE_KEY_LESS(max->key, min->key)) {
+    if(max->copies > RBTREE_MAX_COPIES - min->copies) return -1;
+    max->copies += min->copies;
+    t1->count += min->copies;
+    unlink_node(t2, min);
+    pool_free(tree_pool(t2), min);
+  }
+#endif
+
+  share_pool(t1, t2);
+  t1->root = join2(tree_subtree(t1), tree_subtree(t2)).root;
+  t1->count += t2->count;
+  reset_extremes(t1);
+  t2->root = t2->nil;
+  t2->count = 0;
+  t2->min = t2->nil;
+  t2->max = t2->nil;
+  detach_empty_tree(t2);
+  return 0;
+}
+
+/**
+ * key 수의 합이 TOTAL인 두 subtree A, B 중 A의 key 수를 return하는 함수.
+ * 두 subtree를 한 node씩 번갈아 세다가 먼저 끝난 쪽으로 나머지를 구하므로 O(min(|A|, |B|))이다.
+ * (subtree 크기를 node에 두지 않으면 split한 spine만으로는 양쪽 크기를 알 수 없다)
+*/
+static size_t split_count(const rbtree *t, node_t *a, node_t *b, const size_t total) {
+#ifdef RBTREE_ORDER_STATS
+  (void)t;
+  (void)b;
+  (void)total;
+  return a->size;
+#else
+  size_t a_count = 0, b_count = 0;
+  node_t *p = subtree_min(a, t->nil);
+  node_t *q = subtree_min(b, t->nil);
+  while(p != t->nil && q != t->nil) {
+    a_count += rbtree_copies(p);
+    b_count += rbtree_copies(q);
+    p = successor(t, p);
+    q = successor(t, q);
+  }
+  return p == t->nil ? a_count : total - b_count;
+#endif
+}
+
+/**
+ * T에서 KEY 이상의 key를 모두 떼어내 새 tree로 return하는 함수. T에는 KEY보다 작은 key만 남는다.
+ * node를 새로 할당하지 않으며, 두 tree의 크기를 작은 쪽의 key를 세어 구하므로
+ * 떼어낸 key가 k개일 때 O(log n + min(k, n - k))에 동작한다. (ORDER_STATS이면 O(log n))
+ * 새 tree는 T와 node pool을 공유하므로, 두 tree는 (어느 한쪽이 삭제될 때까지) 서로 다른 thread에서
+ * 동시에 수정하거나 삭제하면 안 된다. 이후 join이나 집합 연산으로 합친 tree도 이 공유를 이어받는다.
+*/
+rbtree *rbtree_split(rbtree *t, const key_t key) {
+  rbtree *right = (rbtree *)calloc(1, sizeof(rbtree));
+  if(right == NULL) return NULL;
+  right->pool = tree_pool(t);
+  right->pool->refs++;
+  right->nil = NIL;
+
+  subtree l, r;
+  split_subtree(tree_subtree(t), key, 0, &l, &r);
+  const size_t left_count = split_count(t, l.root, r.root, t->count);
+  right->count = t->count - left_count;
+  t->root = l.root;
+  t->count = left_count;
+  reset_extremes(t);
+  right->root = r.root;
+  reset_extremes(right);
+  return right;
+}
+
+#ifdef RBTREE_PARALLEL
+/**
+ * 병렬 집합 연산.
+ * 
+ * set_subtree의 두 부분 문제는 서로 다른 node만 다루므로 동시에 수행할 수 있다.
+ * 왼쪽 부분 문제를 task로 만들어 자신의 deque에 넣고 오른쪽을 직접 수행한 뒤,
+ * task가 아직 남아 있으면 직접 수행하고, 다른 worker가 가져갔으면 끝날 때까지 다른 task를 가져와 수행한다. (work stealing)
+ * 
+ * task가 반환하는 node는 task마다 따로 모았다가 합칠 때 한 번에 옮기므로 pool에 lock이 필요 없다.
+ * 두 subtree 중 하나의 black height가 PARALLEL_MIN_BH보다 작으면 (node 수 < 2^PARALLEL_MIN_BH) 직렬로 수행한다.
+*/
+#ifndef PARALLEL_MIN_BH
+#define PARALLEL_MIN_BH 10
+#endif
+#define TASK_DEQUE_CAPACITY 256
+
+typedef struct {
+  set_op op;
+  subtree a, b;
+  subtree result;
+  size_t tally;       // 이 task에서 set_divide가 센 key 수
+  node_pool freed;    // 이 task가 반환한 node들 (free list만 사용)
+  atomic_int done;
+} set_task;
+
+/**
+ * worker 하나의 task deque. 주인은 TAIL 쪽에서 넣고 빼며, 다른 worker는 HEAD 쪽에서 가져간다.
+*/
+typedef struct {
+  pthread_mutex_t lock;
+  size_t head, tail;
+  set_task *tasks[TASK_DEQUE_CAPACITY];
+} task_deque;
+
+typedef struct {
+  task_deque *deques;
+  size_t workers;
+  atomic_int finished;
+} set_scheduler;
+
+typedef struct {
+  set_scheduler *sched;
+  size_t id;
+  unsigned int seed;
+} set_worker;
+
+static size_t parallel_threads = 0;   // 0이면 online CPU 수
+
+/**
+ * 병렬 집합 연산에 사용할 thread 수를 정하는 함수. 0이면 online CPU 수를 사용한다.
+*/
+void rbtree_set_parallelism(const size_t threads) {
+  parallel_threads = threads;
+}
+
+static int deque_push(task_deque *d, set_task *task) {
+  pthread_mutex_lock(&d->lock);
+  int pushed = d->tail < TASK_DEQUE_CAPACITY;
+  if(pushed) d->tasks[d->tail++] = task;
+  pthread_mutex_unlock(&d->lock);
+  return pushed;
+}
+
+/**
+ * D의 마지막 task가 TASK이면 꺼내고 1을 return하는 함수. 다른 worker가 가져갔으면 0을 return.
+*/
+static int deque_pop(task_deque *d, set_task *task) {
+  pthread_mutex_lock(&d->lock);
+  int popped = d->tail > d->head && d->tasks[d->tail - 1] == task;
+  if(popped) d->tail--;
+  if(d->tail == d->head) d->head = d->tail = 0;
+  pthread_mutex_unlock(&d->lock);
+  return popped;
+}
+
+static set_task *deque_steal(task_deque *d) {
+  set_task *task = NULL;
+  pthread_mutex_lock(&d->lock);
+  if(d->head < d->tail) {
+    task = d->tasks[d->head++];
+    if(d->head == d->tail) d->head = d->tail = 0;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return task;
+}
+
+/**
+ * 임의의 다른 worker에게서 task 하나를 가져오는 함수. 모두 비어 있으면 NULL을 return.
+*/
+static set_task *steal_task(set_worker *w) {
+  size_t n = w->sched->workers;
+  w->seed = w->seed * 1103515245 + 12345;
+  size_t start = (w->seed >> 16) % n;
+  for(size_t i = 0; i < n; i++) {
+    size_t victim = (start + i) % n;
+    if(victim == w->id) continue;
+    set_task *task = deque_steal(&w->sched->deques[victim]);
+    if(task != NULL) return task;
+  }
+  return NULL;
+}
+
+static void run_task(set_worker *w, set_task *task);
+
+static subtree parallel_set_subtree(set_worker *w, set_op op, node_pool *pool, subtree a, subtree b, size_t *tally) {
+  subtree result;
+  if(set_base_case(op, pool, a, b, &result)) return result;
+  if(a.bh < PARALLEL_MIN_BH || b.bh < PARALLEL_MIN_BH) {
+    return set_subtree(op, pool, a, b, tally);
+  }
+
+  set_step step;
+  set_divide(op, pool, a, b, &step);
+  *tally += step.tally;
+
+  set_task left = {.op = op, .a = step.al, .b = step.bl};
+  left.freed.free_list = NIL;
+  left.freed.free_tail = NIL;
+  atomic_init(&left.done, 0);
+  task_deque *own = &w->sched->deques[w->id];
+  if(!deque_push(own, &left)) {
+    run_task(w, &left);
+  }
+
+  subtree r = parallel_set_subtree(w, op, pool, step.ag, step.br, tally);
+
+  if(deque_pop(own, &left)) {
+    run_task(w, &left);
+  }
+  while(!atomic_load_explicit(&left.done, memory_order_acquire)) {
+    set_task *task = steal_task(w);
+    if(task != NULL) {
+      run_task(w, task);
+    } else {
+      sched_yield();
+    }
+  }
+  pool_take_free_list(pool, &left.freed);
+  *tally += left.tally;
+  return set_combine(&step, left.result, r);
+}
+
+static void run_task(set_worker *w, set_task *task) {
+  task->result = parallel_set_subtree(w, task->op, &task->freed, task->a, task->b, &task->tally);
+  atomic_store_explicit(&task->done, 1, memory_order_release);
+}
+
+static void *worker_main(void *arg) {
+  set_worker *w = (set_worker *)arg;
+  while(!atomic_load_explicit(&w->sched->finished, memory_order_acquire)) {
+    set_task *task = steal_task(w);
+    if(task != NULL) {
+      run_task(w, task);
+    } else {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+/**
+ * set_subtree를 여러 thread로 수행하는 함수.
+ * thread를 만들 수 없으면 만들어진 thread만으로 (최소한 호출한 thread 혼자) 수행한다.
+*/
+static subtree parallel_set(set_op op, node_pool *pool, subtree a, subtree b, size_t threads, size_t *tally) {
+  set_scheduler sched = {.workers = threads};
+  atomic_init(&sched.finished, 0);
+  sched.deques = (task_deque *)calloc(threads, sizeof(task_deque));
+  set_worker *workers = (set_worker *)calloc(threads, sizeof(set_worker));
+  pthread_t *tids = (pthread_t *)calloc(threads, sizeof(pthread_t));
+  if(sched.deques == NULL || workers == NULL || tids == NULL) {
+    free(tids);
+    free(workers);
+    free(sched.deques);
+    return set_subtree(op, pool, a, b, tally);
+  }
+
+  for(size_t i = 0; i < threads; i++) {
+    pthread_mutex_init(&sched.deques[i].lock, NULL);
+    workers[i] = (set_worker){&sched, i, (unsigned int)i * 2654435761u + 1};
+  }
+  size_t started = 1;
+  while(started < threads && pthread_create(&tids[started], NULL, worker_main, &workers[started]) == 0) {
+    started++;
+  }
+
+  subtree result = parallel_set_subtree(&workers[0], op, pool, a, b, tally);
+
+  atomic_store_explicit(&sched.finished, 1, memory_order_release);
+  for(size_t i = 1; i < started; i++) {
+    pthread_join(tids[i], NULL);
+  }
+  for(size_t i = 0; i < threads; i++) {
+    pthread_mutex_destroy(&sched.deques[i].lock);
+  }
+  free(tids);
+  free(workers);
+  free(sched.deques);
+  return result;
+}
+
+static size_t set_threads(void) {
+  if(parallel_threads > 0) return parallel_threads;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  return cpus > 0 ? (size_t)cpus : 1;
+}
+#endif
+
+/**
+ * T1에 T2와의 OP 결과를 남기고 T2를 비우는 함수.
+ * 결과의 크기는 set_divide가 센 key 수(TALLY)로 구한다.
+ * union은 T1과 T2의 key 중 버린 T2의 key를 빼고, intersection은 남긴 key 수, difference는 T1에서 버린 key를 뺀다.
+*/
+static void set_operation(set_op op, rbtree *t1, rbtree *t2) {
+  if(t1 == t2) {
+    if(op == SET_DIFFERENCE) {
+      pool_free_subtree(tree_pool(t1), t1->root);
+      t1->root = t1->nil;
+      t1->count = 0;
+      t1->min = t1->nil;
+      t1->max = t1->nil;
+    }
+    return;
+  }
+
+  node_pool *pool = share_pool(t1, t2);
+  subtree a = tree_subtree(t1);
+  subtree b = tree_subtree(t2);
+  size_t tally = 0;
+#ifdef RBTREE_PARALLEL
+  size_t threads = set_threads();
+  if(threads > 1 && a.bh >= PARALLEL_MIN_BH && b.bh >= PARALLEL_MIN_BH) {
+    t1->root = parallel_set(op, pool, a, b, threads, &tally).root;
+  } else {
+    t1->root = set_subtree(op, pool, a, b, &tally).root;
+  }
+#else
+  t1->root = set_subtree(op, pool, a, b, &tally).root;
+#endif
+  switch(op) {
+    case SET_UNION:
+      t1->count += t2->count - tally;
+      break;
+    case SET_INTERSECTION:
+      t1->count = tally;
+      break;
+    case SET_DIFFERENCE:
+      t1->count -= tally;
+      break;
+  }
+  reset_extremes(t1);
+  t2->root = t2->nil;
+  t2->count = 0;
+  t2->min = t2->nil;
+  t2->max = t2->nil;
+  detach_empty_tree(t2);
+}
+
+/**
+ * T1에 T2의 key 중 T1에 없는 key를 모두 옮기는 함수. T2는 빈 tree가 된다.
+ * T1에 이미 있는 key의 T2 node는 반환된다.
+ * 크기가 m <= n인 두 tree에 대해 O(m log(n/m + 1))에 동작하며, node를 새로 할당하지 않는다.
+ * pool은 rbtree_join처럼 합쳐진다. T2와 pool을 공유하던 tree는 이후 T1과 공유하며, 비워진 T2는 자기 pool을 갖는다.
+*/
+void rbtree_union(rbtree *t1, rbtree *t2) {
+  set_operation(SET_UNION, t1, t2);
+}
+
+/**
+ * T1에 T2에도 있는 key만 남기는 함수. T2는 빈 tree가 된다.
+ * 크기가 m <= n인 두 tree에 대해 O(m log(n/m + 1))에 동작한다. pool은 rbtree_union과 같이 합쳐진다.
+*/
+void rbtree_intersection(rbtree *t1, rbtree *t2) {
+  set_operation(SET_INTERSECTION, t1, t2);
+}
+
+/**
+ * T1에서 T2에 있는 key를 모두 지우는 함수. T2는 빈 tree가 된다.
+ * 크기가 m <= n인 두 tree에 대해 O(m log(n/m + 1))에 동작한다. pool은 rbtree_union과 같이 합쳐진다.
+*/
+void rbtree_difference(rbtree *t1, rbtree *t2) {
+  set_operation(SET_DIFFERENCE, t1, t2);
+}
+
+#ifdef RBTREE_STATS
+/**
+ * T의 높이(가장 깊은 node까지의 node 수)를 return하는 함수.
+ * parent link를 따라 순회하므로 stack을 쓰지 않는다. O(n)
+*/
+static size_t tree_height(const rbtree *t) {
+  size_t height = 0, depth = 1;
+  node_t *prev = t->nil;
+  node_t *cursor = t->root;
+  while(cursor != t->nil) {
+    node_t *next;
+    if(prev == rbtree_parent(cursor)) {
+      // 위에서 내려왔다: 왼쪽, 오른쪽, 위 순서로 간다
+      if(depth > height) height = depth;
+      if(rbtree_left(cursor) != t->nil) next = rbtree_left(cursor);
+      else if(rbtree_right(cursor) != t->nil) next = rbtree_right(cursor);
+      else next = rbtree_parent(cursor);
+    } else if(prev == rbtree_left(cursor) && rbtree_right(cursor) != t->nil) {
+      next = rbtree_right(cursor);
+    } else {
+      next = rbtree_parent(cursor);
+    }
+    depth = next == rbtree_parent(cursor) ? depth - 1 : depth + 1;
+    prev = cursor;
+    cursor = next;
+  }
+  return height;
+}
+
+/**
+ * T의 counter와 현재 높이, black height, 크기를 return하는 함수.
+ * 높이를 구하느라 tree 전체를 순회한다. O(n)
+*/
+rbtree_statistics rbtree_stats(const rbtree *t) {
+  rbtree_statistics stats = {t->counters, tree_height(t), 0, rbtree_size(t)};
+  for(node_t *p = t->root; p != t->nil; p = rbtree_left(p)) {
+    if(rbtree_color(p) == RBTREE_BLACK) stats.black_height++;
+  }
+  return stats;
+}
+
+/**
+ * T의 counter를 모두 0으로 되돌리는 함수.
+*/
+void rbtree_stats_reset(rbtree *t) {
+  memset(&t->counters, 0, sizeof(t->counters));
+}
+#endif
@@ -2,31 +2,355 @@
 #define _RBTREE_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum { RBTREE_RED, RBTREE_BLACK } color_t;
 
+/**
+ * key와 payload의 type은 build flag로 선택한다.
+ * 
+ * - 기본: int key
+ * - RBTREE_KEY_TYPE: 정수처럼 <, ==로 비교할 수 있는 key type (예: -DRBTREE_KEY_TYPE=uint64_t)
+ * - RBTREE_KEY_BYTES: 길이 N의 고정 길이 byte string key. memcmp 순서로 비교한다.
+ * - RBTREE_VALUE_TYPE: 정의하면 node에 VALUE slot을 두는 map mode가 된다.
+ * 
+ * key 비교는 모두 RBTREE_KEY_LESS/RBTREE_KEY_COMPARE macro를 거치므로 compile time에 특수화된다.
+ * 직접 정의하여 다른 순서를 쓸 수도 있다. (RBTREE_KEY_COMPARE는 음수/0/양수를 return)
+ * 
+ * key type을 바꾸면 <sys/types.h>의 key_t(System V IPC key)와 겹치지 않도록
+ * key_t는 rbtree_key_t의 macro가 된다.
+*/
+#if defined(RBTREE_KEY_BYTES)
+#include <string.h>
+#include <sys/types.h>
+#define key_t rbtree_key_t
+typedef struct {
+  unsigned char bytes[RBTREE_KEY_BYTES];
+} key_t;
+#ifndef RBTREE_KEY_COMPARE
+#define RBTREE_KEY_COMPARE(a, b) memcmp((a).bytes, (b).bytes, RBTREE_KEY_BYTES)
+#endif
+#ifndef RBTREE_KEY_LESS
+#define RBTREE_KEY_LESS(a, b) (RBTREE_KEY_COMPARE(a, b) < 0)
+#endif
+#elif defined(RBTREE_KEY_TYPE)
+#include <sys/types.h>
+#define key_t rbtree_key_t
+typedef RBTREE_KEY_TYPE key_t;
+#else
 typedef int key_t;
+#endif
+
+#ifndef RBTREE_KEY_LESS
+#define RBTREE_KEY_LESS(a, b) ((a) < (b))
+#endif
+#ifndef RBTREE_KEY_COMPARE
+#define RBTREE_KEY_COMPARE(a, b) (((a) > (b)) - ((a) < (b)))
+#endif
+
+#ifdef RBTREE_VALUE_TYPE
+typedef RBTREE_VALUE_TYPE value_t;
+#endif
 
+/**
+ * node layout은 build flag로 선택한다.
+ * 
+ * - 기본: color, key, parent/left/right pointer (32 bytes)
+ * - RBTREE_COMPACT: color를 parent pointer의 최하위 bit에 저장한다.
+ *   key_t가 pointer 크기일 때 8 bytes를 줄인다.
+ * - RBTREE_INDEX: link를 process 전역 node arena의 32-bit index로 저장하고,
+ *   color를 parent index의 최하위 bit에 저장한다. (16 bytes)
+ * 
+ * RBTREE_ORDER_STATS를 정의하면 각 node에 subtree의 node 수(SIZE)를 추가하여
+ * rbtree_select/rbtree_rank를 O(log n)에 수행한다.
+ * 
+ * RBTREE_COUNTED를 정의하면 같은 key를 node 하나에 모으고 그 개수(COPIES)를 세는 counted multiset이 된다.
+ * 같은 key의 insert/erase는 COPIES만 바꾸므로 node 수와 높이가 서로 다른 key의 수에 비례한다.
+ * node 단위로 순회하는 API(rbtree_next, cursor, equal_range 등)는 key마다 node 하나를 보고,
+ * key 단위 API(rbtree_size, rbtree_to_array, export, count_range)는 COPIES만큼 센다.
+ * map mode, RBTREE_ORDER_STATS와는 함께 쓸 수 없다.
+ * 
+ * layout에 관계없이 node의 link와 color는 아래 accessor로 접근한다.
+*/
+#if defined(RBTREE_COUNTED) && (defined(RBTREE_VALUE_TYPE) || defined(RBTREE_ORDER_STATS))
+#error "RBTREE_COUNTED cannot be combined with RBTREE_VALUE_TYPE or RBTREE_ORDER_STATS"
+#endif
+
+/**
+ * node 하나가 가진 같은 key의 최대 수. 넘치면 insert가 NULL을 return한다.
+*/
+#define RBTREE_MAX_COPIES UINT32_MAX
+
+#if defined(RBTREE_INDEX)
+typedef struct node_t {
+  uint32_t parent_color;
+  uint32_t left, right;
+  key_t key;
+#ifdef RBTREE_COUNTED
+  uint32_t copies;
+#endif
+#ifdef RBTREE_VALUE_TYPE
+  value_t value;
+#endif
+#ifdef RBTREE_ORDER_STATS
+  uint32_t size;
+#endif
+} node_t;
+#elif defined(RBTREE_COMPACT)
+typedef struct node_t {
+  uintptr_t parent_color;
+  struct node_t *left, *right;
+  key_t key;
+#ifdef RBTREE_COUNTED
+  uint32_t copies;
+#endif
+#ifdef RBTREE_VALUE_TYPE
+  value_t value;
+#endif
+#ifdef RBTREE_ORDER_STATS
+  size_t size;
+#endif
+} node_t;
+#else
 typedef struct node_t {
   color_t color;
   key_t key;
+#ifdef RBTREE_COUNTED
+  uint32_t copies;
+#endif
   struct node_t *parent, *left, *right;
+#ifdef RBTREE_VALUE_TYPE
+  value_t value;
+#endif
+#ifdef RBTREE_ORDER_STATS
+  size_t size;
+#endif
 } node_t;
+#endif
+
+#if defined(RBTREE_INDEX)
+extern node_t *rbtree_node_arena;
+
+static inline uint32_t rbtree_node_index(const node_t *n) {
+  return (uint32_t)(n - rbtree_node_arena);
+}
+
+static inline node_t *rbtree_parent(const node_t *n) {
+  return rbtree_node_arena + (n->parent_color >> 1);
+}
+
+static inline color_t rbtree_color(const node_t *n) {
+  return (color_t)(n->parent_color & 1);
+}
+
+static inline node_t *rbtree_left(const node_t *n) { return rbtree_node_arena + n->left; }
+static inline node_t *rbtree_right(const node_t *n) { return rbtree_node_arena + n->right; }
+
+static inline void rbtree_set_parent(node_t *n, node_t *parent) {
+  n->parent_color = rbtree_node_index(parent) << 1 | (n->parent_color & 1);
+}
+
+static inline void rbtree_set_color(node_t *n, color_t color) {
+  n->parent_color = (n->parent_color & ~(uint32_t)1) | (uint32_t)color;
+}
+
+static inline void rbtree_set_left(node_t *n, node_t *left) { n->left = rbtree_node_index(left); }
+static inline void rbtree_set_right(node_t *n, node_t *right) { n->right = rbtree_node_index(right); }
+#else
+#if defined(RBTREE_COMPACT)
+static inline node_t *rbtree_parent(const node_t *n) {
+  return (node_t *)(n->parent_color & ~(uintptr_t)1);
+}
+
+static inline color_t rbtree_color(const node_t *n) {
+  return (color_t)(n->parent_color & 1);
+}
+
+static inline void rbtree_set_parent(node_t *n, node_t *parent) {
+  n->parent_color = (uintptr_t)parent | (n->parent_color & 1);
+}
+
+static inline void rbtree_set_color(node_t *n, color_t color) {
+  n->parent_color = (n->parent_color & ~(uintptr_t)1) | (uintptr_t)color;
+}
+#else
+static inline node_t *rbtree_parent(const node_t *n) { return n->parent; }
+static inline color_t rbtree_color(const node_t *n) { return n->color; }
+static inline void rbtree_set_parent(node_t *n, node_t *parent) { n->parent = parent; }
+static inline void rbtree_set_color(node_t *n, color_t color) { n->color = color; }
+#endif
+
+static inline node_t *rbtree_left(const node_t *n) { return n->left; }
+static inline node_t *rbtree_right(const node_t *n) { return n->right; }
+static inline void rbtree_set_left(node_t *n, node_t *left) { n->left = left; }
+static inline void rbtree_set_right(node_t *n, node_t *right) { n->right = right; }
+#endif
+
+/**
+ * NODE가 담고 있는 key의 수. RBTREE_COUNTED가 아니면 항상 1이다.
+*/
+static inline size_t rbtree_copies(const node_t *n) {
+#ifdef RBTREE_COUNTED
+  return n->copies;
+#else
+  (void)n;
+  return 1;
+#endif
+}
+
+typedef struct node_pool node_pool;
+
+/**
+ * rbtree_validate가 찾은 첫 번째 위반. RBTREE_VALID(0)이면 위반이 없다.
+*/
+typedef enum {
+  RBTREE_VALID = 0,
+  RBTREE_BAD_NIL,            // sentinel이 black이 아니다
+  RBTREE_BAD_ROOT,           // root가 red이거나 root의 parent가 nil이 아니다
+  RBTREE_BAD_PARENT,         // 자식의 parent가 그 node가 아니다 (또는 tree가 너무 깊다)
+  RBTREE_BAD_ORDER,          // 중위 순회에서 key가 작아진다
+  RBTREE_RED_RED,            // red node의 자식이 red이다
+  RBTREE_BAD_BLACK_HEIGHT,   // nil까지의 black node 수가 경로마다 다르다
+  RBTREE_BAD_SIZE,           // 저장된 key 수나 ORDER_STATS의 subtree 크기가 실제와 다르다
+  RBTREE_BAD_CACHE           // cache해 둔 min/max node가 실제와 다르다
+} rbtree_violation;
+
+#ifdef RBTREE_STATS
+/**
+ * RBTREE_STATS로 빌드하면 tree마다 세는 값들. 빌드하지 않으면 세는 code 자체가 없다.
+ * find도 값을 바꾸므로, 이 mode에서는 한 tree를 여러 thread에서 동시에 읽으면 값이 정확하지 않다.
+*/
+typedef struct {
+  uint64_t left_rotations;
+  uint64_t right_rotations;
+  uint64_t insert_fixup_iterations;   // rbtree_insert_fixup의 loop 반복 수
+  uint64_t erase_fixup_iterations;    // rbtree_erase_fixup의 loop 반복 수
+  uint64_t finds;                     // rbtree_find 호출 수
+  uint64_t find_comparisons;          // rbtree_find에서 비교한 node 수의 합
+  uint64_t find_max_comparisons;      // rbtree_find 한 번에서 비교한 node 수의 최댓값
+} rbtree_counters;
+
+/**
+ * rbtree_stats가 return하는 값. COUNTERS와, 호출한 시점의 tree 모양.
+*/
+typedef struct {
+  rbtree_counters counters;
+  size_t height;          // root에서 가장 깊은 node까지의 node 수 (빈 tree는 0)
+  size_t black_height;    // root에서 nil까지의 black node 수 (root 포함, nil 제외)
+  size_t size;
+} rbtree_statistics;
+#endif
 
 typedef struct {
   node_t *root;
   node_t *nil;  // for sentinel
+  node_pool *pool;  // node slab allocator
+  size_t count;     // 저장된 key의 수
+  node_t *min;      // rbtree_min/rbtree_max의 cache (빈 tree이면 nil)
+  node_t *max;
+#ifdef RBTREE_STATS
+  rbtree_counters counters;
+#endif
 } rbtree;
 
+/**
+ * tree를 key 순서대로 순회하는 cursor.
+ * NODE가 현재 위치이며, 범위를 벗어나면 NULL이 된다.
+*/
+typedef struct {
+  const rbtree *tree;
+  node_t *node;
+} rbtree_cursor;
+
+/**
+ * [FIRST, LAST) 범위의 node들. LAST가 NULL이면 tree의 끝까지를 의미한다.
+*/
+typedef struct {
+  node_t *first;
+  node_t *last;
+} rbtree_range;
+
+/**
+ * rbtree_export가 이어서 내보낼 위치. 0으로 초기화하면 처음부터 시작한다.
+ * 마지막으로 내보낸 key와, 그와 같은 key를 몇 개 내보냈는지를 기억한다.
+*/
+typedef struct {
+  key_t last;
+  size_t dups;
+  int started;
+} rbtree_export_token;
+
+/**
+ * rbtree_export_each가 key 묶음마다 호출하는 함수. 0이 아닌 값을 return하면 export를 멈춘다.
+*/
+typedef int (*rbtree_visitor)(const key_t *, const size_t, void *);
+
 rbtree *new_rbtree(void);
+rbtree *rbtree_from_sorted(const key_t *, const size_t);
 void delete_rbtree(rbtree *);
+void rbtree_clear(rbtree *);
 
 node_t *rbtree_insert(rbtree *, const key_t);
+node_t *rbtree_insert_hint(rbtree *, node_t *, const key_t);
+int rbtree_insert_batch(rbtree *, const key_t *, const size_t);
 node_t *rbtree_find(const rbtree *, const key_t);
+void rbtree_find_many(const rbtree *, const key_t *, const size_t, node_t **);
 node_t *rbtree_min(const rbtree *);
 node_t *rbtree_max(const rbtree *);
 int rbtree_erase(rbtree *, node_t *);
+int rbtree_erase_key(rbtree *, const key_t);
+int rbtree_pop_min(rbtree *, key_t *);
+int rbtree_pop_max(rbtree *, key_t *);
+
+#ifdef RBTREE_VALUE_TYPE
+node_t *rbtree_put(rbtree *, const key_t, const value_t);
+value_t *rbtree_get(const rbtree *, const key_t);
+#endif
+
+size_t rbtree_size(const rbtree *);
+rbtree_violation rbtree_validate(const rbtree *);
+
+node_t *rbtree_next(const rbtree *, const node_t *);
+node_t *rbtree_prev(const rbtree *, const node_t *);
+
+node_t *rbtree_lower_bound(const rbtree *, const key_t);
+node_t *rbtree_upper_bound(const rbtree *, const key_t);
+rbtree_range rbtree_equal_range(const rbtree *, const key_t);
+size_t rbtree_count_range(const rbtree *, const key_t, const key_t);
+
+#ifdef RBTREE_ORDER_STATS
+node_t *rbtree_select(const rbtree *, const size_t);
+size_t rbtree_rank(const rbtree *, const key_t);
+#endif
+
+rbtree_cursor rbtree_cursor_first(const rbtree *);
+rbtree_cursor rbtree_cursor_last(const rbtree *);
+rbtree_cursor rbtree_cursor_at(const rbtree *, node_t *);
+node_t *rbtree_cursor_next(rbtree_cursor *);
+node_t *rbtree_cursor_prev(rbtree_cursor *);
 
 int rbtree_to_array(const rbtree *, key_t *, const size_t);
+size_t rbtree_export(const rbtree *, rbtree_export_token *, key_t *, const size_t);
+int rbtree_export_each(const rbtree *, key_t *, const size_t, rbtree_visitor, void *);
+
+/**
+ * rbtree_split은 떼어낸 key가 k개일 때 O(log n + min(k, n - k))에 동작한다. (RBTREE_ORDER_STATS이면 O(log n))
+ * 집합 연산은 크기 m <= n인 두 tree에 대해 O(m log(n/m + 1))에 더해, 버리거나 남기는 중복 key의 수에 비례하는 시간이 든다.
+ * (결과 크기를 구하려고 중복 key를 세므로. RBTREE_ORDER_STATS나 RBTREE_COUNTED이면 이 추가 비용은 없다)
+*/
+int rbtree_join(rbtree *, rbtree *);
+rbtree *rbtree_split(rbtree *, const key_t);
+void rbtree_union(rbtree *, rbtree *);
+void rbtree_intersection(rbtree *, rbtree *);
+void rbtree_difference(rbtree *, rbtree *);
+
+#ifdef RBTREE_PARALLEL
+void rbtree_set_parallelism(const size_t);
+#endif
+
+#ifdef RBTREE_STATS
+rbtree_statistics rbtree_stats(const rbtree *);
+void rbtree_stats_reset(rbtree *);
+#endif
 
 #endif  // _RBTREE_H_
@@ -0,0 +1,146 @@
+#include "rbtree_frozen.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * 탐색 중 몇 level 아래를 prefetch할지 정하는 index 배수.
+ * KEYS[k]의 i level 아래 자손은 KEYS[k * 2^i]부터 2^i개가 연속해 있으므로,
+ * 한 cache line에 든 key 수를 곱하면 그 level의 자손들이 든 cache line 하나를 미리 읽는다.
+*/
+#define FROZEN_PREFETCH_STRIDE (64 / sizeof(key_t) > 0 ? 64 / sizeof(key_t) : 1)
+
+/**
+ * N개의 key를 담을 배열을 cache line 경계에 맞춰 할당하는 함수. KEYS[0]은 비워 두므로 한 칸 더 잡는다.
+*/
+static void *alloc_slots(size_t n, size_t size) {
+  size_t bytes = (n + 1) * size;
+  bytes = (bytes + 63) / 64 * 64;   // aligned_alloc은 size가 alignment의 배수여야 한다
+  return aligned_alloc(64, bytes);
+}
+
+/**
+ * N개짜리 Eytzinger 배열에서 in-order로 K 다음 index를 return하는 함수. K가 마지막이면 0을 return.
+ * K = 0에서 시작하면 in-order의 첫 index(맨 왼쪽)를 return한다.
+*/
+static size_t next_slot(size_t k, const size_t n) {
+  if(k == 0 || 2 * k + 1 <= n) {
+    // 오른쪽 subtree(처음이면 전체)의 맨 왼쪽으로 내려간다
+    k = k == 0 ? 1 : 2 * k + 1;
+    while(2 * k <= n) k *= 2;
+    return k;
+  }
+  // 오른쪽 자식으로 올라오는 동안 올라간 뒤, 한 번 더 올라간 곳이 다음이다
+  while(k & 1) k >>= 1;
+  return k >> 1;
+}
+
+/**
+ * T의 key를 순서대로 읽어 Eytzinger 순서의 배열로 옮기는 함수. O(n)
+ * 메모리가 부족하면 NULL을 return.
+*/
+rbtree_frozen *rbtree_freeze(const rbtree *t) {
+  rbtree_frozen *f = (rbtree_frozen *)malloc(sizeof(rbtree_frozen));
+  if(f == NULL) return NULL;
+  f->count = rbtree_size(t);
+  f->keys = (key_t *)alloc_slots(f->count, sizeof(key_t));
+  if(f->keys == NULL) {
+    free(f);
+    return NULL;
+  }
+#ifdef RBTREE_VALUE_TYPE
+  f->values = (value_t *)alloc_slots(f->count, sizeof(value_t));
+  if(f->values == NULL) {
+    free(f->keys);
+    free(f);
+    return NULL;
+  }
+#endif
+
+  // implicit tree를 in-order로 돌며 tree의 key를 작은 것부터 채운다
+  size_t k = 0;
+  for(node_t *p = rbtree_min(t); p != NULL && p != t->nil; p = rbtree_next(t, p)) {
+    for(size_t copies = rbtree_copies(p); copies > 0; copies--) {
+      k = next_slot(k, f->count);
+      f->keys[k] = p->key;
+#ifdef RBTREE_VALUE_TYPE
+      f->values[k] = p->value;
+#endif
+    }
+  }
+  return f;
+}
+
+void delete_rbtree_frozen(rbtree_frozen *f) {
+#ifdef RBTREE_VALUE_TYPE
+  free(f->values);
+#endif
+  free(f->keys);
+  free(f);
+}
+
+/**
+ * F에서 KEY 이상인 가장 작은 key의 index를 return하는 함수. 없으면 0을 return.
+ *
+ * 비교 결과(0 또는 1)를 index에 더해 분기 없이 leaf 아래까지 내려간 뒤,
+ * 마지막으로 왼쪽으로 내려간 곳(index의 끝에 이어진 1들과 그 위의 0 하나를 떼어낸 곳)으로 돌아간다.
+ * 한 번도 왼쪽으로 가지 않았으면 모든 key가 KEY보다 작으므로 0이 된다.
+ * leaf 근처에서는 prefetch할 index가 배열 밖이므로, 그 주소는 pointer 연산 대신 정수로 계산한다.
+ * (prefetch는 잘못된 주소에서도 fault를 내지 않는다)
+*/
+static size_t frozen_lower_bound(const rbtree_frozen *f, const key_t key) {
+  const key_t *keys = f->keys;
+  size_t k = 1;
+  while(k <= f->count) {
+    __builtin_prefetch((const void *)((uintptr_t)keys + k * FROZEN_PREFETCH_STRIDE * sizeof(key_t)));
+    k = 2 * k + RBTREE_KEY_LESS(keys[k], key);
+  }
+  return k >> __builtin_ffsll((long long)~k);
+}
+
+/**
+ * F에서 KEY와 같은 key를 찾는 함수. 없으면 NULL을 return.
+*/
+const key_t *rbtree_frozen_find(const rbtree_frozen *f, const key_t key) {
+  size_t k = frozen_lower_bound(f, key);
+  if(k == 0 || RBTREE_KEY_LESS(key, f->keys[k])) return NULL;
+  return &f->keys[k];
+}
+
+/**
+ * F에서 KEY 이상인 가장 작은 key를 return하는 함수. 없으면 NULL을 return.
+*/
+const key_t *rbtree_frozen_lower_bound(const rbtree_frozen *f, const key_t key) {
+  size_t k = frozen_lower_bound(f, key);
+  return k == 0 ? NULL : &f->keys[k];
+}
+
+/**
+ * 가장 작은 key는 맨 왼쪽 경로의 끝, 2^floor(log2 n)번째 칸에 있다.
+*/
+const key_t *rbtree_frozen_min(const rbtree_frozen *f) {
+  if(f->count == 0) return NULL;
+  return &f->keys[(size_t)1 << (63 - __builtin_clzll(f->count))];
+}
+
+/**
+ * 가장 큰 key는 맨 오른쪽 경로의 끝, 2^floor(log2 (n + 1)) - 1번째 칸에 있다.
+*/
+const key_t *rbtree_frozen_max(const rbtree_frozen *f) {
+  if(f->count == 0) return NULL;
+  return &f->keys[((size_t)1 << (63 - __builtin_clzll(f->count + 1))) - 1];
+}
+
+size_t rbtree_frozen_size(const rbtree_frozen *f) {
+  return f->count;
+}
+
+#ifdef RBTREE_VALUE_TYPE
+/**
+ * F에서 KEY의 value를 가리키는 pointer를 return하는 함수. 없으면 NULL을 return.
+*/
+const value_t *rbtree_frozen_get(const rbtree_frozen *f, const key_t key) {
+  const key_t *found = rbtree_frozen_find(f, key);
+  return found == NULL ? NULL : &f->values[found - f->keys];
+}
+#endif
@@ -0,0 +1,41 @@
+#ifndef _RBTREE_FROZEN_H_
+#define _RBTREE_FROZEN_H_
+
+#include "rbtree.h"
+
+/**
+ * 더 이상 바꾸지 않는 tree를 읽기 전용 배열로 얼린 것.
+ *
+ * key를 Eytzinger 순서(BFS 순서의 implicit tree: KEYS[k]의 자식은 KEYS[2k], KEYS[2k + 1])로 저장한다.
+ * 탐색은 pointer를 따라가지 않고 index 계산만 하므로 level마다의 load가 서로 독립적이며,
+ * 위쪽 level은 몇 개의 cache line에 모여 있고, 비교 결과를 분기 없이 index에 더한다.
+ * 한 cache line에 든 key 수만큼 아래 level의 자손들이 연속해 있으므로 몇 level 앞을 prefetch한다.
+ * node마다 있던 link와 color가 없으므로 key당 메모리는 key_t 하나(map mode면 value_t 하나 더)이다.
+ *
+ * - rbtree_freeze: T를 O(n)에 얼린다. T는 그대로 두므로 더 쓰지 않으면 delete_rbtree로 해제한다.
+ * - find/lower_bound/min/max는 같은 이름의 rbtree 함수와 같은 key를 가리키는 pointer를 return한다. (없으면 NULL)
+ *   같은 key가 여러 개이면 정렬 순서상 첫 번째를 가리킨다.
+ * - RBTREE_COUNTED이면 COPIES만큼 펼쳐 저장한다.
+*/
+typedef struct {
+  key_t *keys;        // Eytzinger 순서, KEYS[0]은 쓰지 않는다
+  size_t count;
+#ifdef RBTREE_VALUE_TYPE
+  value_t *values;    // VALUES[k]는 KEYS[k]의 value
+#endif
+} rbtree_frozen;
+
+rbtree_frozen *rbtree_freeze(const rbtree *);
+void delete_rbtree_frozen(rbtree_frozen *);
+
+const key_t *rbtree_frozen_find(const rbtree_frozen *, const key_t);
+const key_t *rbtree_frozen_lower_bound(const rbtree_frozen *, const key_t);
+const key_t *rbtree_frozen_min(const rbtree_frozen *);
+const key_t *rbtree_frozen_max(const rbtree_frozen *);
+size_t rbtree_frozen_size(const rbtree_frozen *);
+
+#ifdef RBTREE_VALUE_TYPE
+const value_t *rbtree_frozen_get(const rbtree_frozen *, const key_t);
+#endif
+
+#endif  // _RBTREE_FROZEN_H_
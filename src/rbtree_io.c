@@ -0,0 +1,208 @@
+#include "rbtree_io.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char file_magic[8] = {'R', 'B', 'T', 'R', 'E', 'E', 0, 0};
+
+/**
+ * file header. key 배열이 8 bytes 경계에서 시작하도록 32 bytes로 맞춘다.
+*/
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t key_size;
+  uint64_t count;
+  uint64_t reserved;
+} file_header;
+
+/**
+ * key 배열 뒤에 붙는 trailer. CHECKSUM은 key 배열 전체의 checksum_update 결과이다.
+*/
+typedef struct {
+  uint64_t checksum;
+} file_trailer;
+
+#define CHECKSUM_SEED 0xcbf29ce484222325ULL
+#define CHECKSUM_PRIME 0x100000001b3ULL
+
+/**
+ * FNV-1a를 8 bytes 단위로 적용한 checksum. 이어서 호출하면 나누어 넣은 data 전체의 checksum이 된다.
+ * (8 bytes 단위가 이어지도록 마지막 호출 외에는 LEN이 8의 배수여야 한다)
+*/
+static uint64_t checksum_update(uint64_t h, const void *data, size_t len) {
+  const unsigned char *p = (const unsigned char *)data;
+  while(len >= 8) {
+    uint64_t word;
+    memcpy(&word, p, 8);
+    h = (h ^ word) * CHECKSUM_PRIME;
+    p += 8;
+    len -= 8;
+  }
+  while(len > 0) {
+    h = (h ^ *p++) * CHECKSUM_PRIME;
+    len--;
+  }
+  return h;
+}
+
+static int write_all(int fd, const void *data, size_t len) {
+  const char *p = (const char *)data;
+  while(len > 0) {
+    ssize_t written = write(fd, p, len);
+    if(written < 0) {
+      if(errno == EINTR) continue;
+      return -1;
+    }
+    p += written;
+    len -= (size_t)written;
+  }
+  return 0;
+}
+
+/**
+ * 한 번의 write로 내보내는 key 수. 8의 배수이므로 checksum_update를 나누어 호출해도 된다.
+*/
+#define SAVE_BUFFER_KEYS 4096
+
+typedef struct {
+  int fd;
+  uint64_t checksum;
+  size_t written;
+} save_ctx;
+
+static int save_batch(const key_t *keys, const size_t n, void *ctx) {
+  save_ctx *save = (save_ctx *)ctx;
+  save->checksum = checksum_update(save->checksum, keys, n * sizeof(key_t));
+  save->written += n;
+  return write_all(save->fd, keys, n * sizeof(key_t));
+}
+
+/**
+ * T의 key를 오름차순으로 FD에 저장하는 함수. 쓰기에 실패하면 -1을 return.
+ * FD의 현재 위치부터 쓰며, tree는 rbtree_export_each로 한 번만 순회한다.
+*/
+int rbtree_save(const rbtree *t, int fd) {
+  file_header header = {.version = RBTREE_FILE_VERSION, .key_size = sizeof(key_t), .count = rbtree_size(t)};
+  memcpy(header.magic, file_magic, sizeof(file_magic));
+  if(write_all(fd, &header, sizeof(header)) != 0) return -1;
+
+  key_t *buffer = (key_t *)malloc(SAVE_BUFFER_KEYS * sizeof(key_t));
+  if(buffer == NULL) return -1;
+  save_ctx save = {fd, CHECKSUM_SEED, 0};
+  int result = rbtree_export_each(t, buffer, SAVE_BUFFER_KEYS, save_batch, &save);
+  free(buffer);
+  if(result != 0 || save.written != header.count) return -1;
+
+  file_trailer trailer = {save.checksum};
+  return write_all(fd, &trailer, sizeof(trailer));
+}
+
+/**
+ * FD의 file 전체를 읽기 전용으로 mmap하고 header를 검사하는 함수.
+ * file이 이 build의 format이 아니거나 크기가 맞지 않으면 NULL을 return.
+*/
+static rbtree_image *map_file(int fd) {
+  struct stat st;
+  if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(file_header) + sizeof(file_trailer)) return NULL;
+  size_t size = (size_t)st.st_size;
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(map == MAP_FAILED) return NULL;
+
+  const file_header *header = (const file_header *)map;
+  if(memcmp(header->magic, file_magic, sizeof(file_magic)) != 0 ||
+     header->version != RBTREE_FILE_VERSION || header->key_size != sizeof(key_t) ||
+     header->count > (size - sizeof(file_header) - sizeof(file_trailer)) / sizeof(key_t) ||
+     size != sizeof(file_header) + header->count * sizeof(key_t) + sizeof(file_trailer)) {
+    munmap(map, size);
+    return NULL;
+  }
+
+  rbtree_image *image = (rbtree_image *)malloc(sizeof(rbtree_image));
+  if(image == NULL) {
+    munmap(map, size);
+    return NULL;
+  }
+  image->keys = (const key_t *)(header + 1);
+  image->count = header->count;
+  image->map = map;
+  image->map_size = size;
+  return image;
+}
+
+/**
+ * IMAGE의 checksum과 key 순서를 검사하는 함수. 손상되었으면 -1을 return. O(n)
+*/
+int rbtree_image_verify(const rbtree_image *image) {
+  // key 크기에 따라 trailer가 8 bytes 경계에 있지 않을 수 있다
+  file_trailer trailer;
+  memcpy(&trailer, image->keys + image->count, sizeof(trailer));
+  if(checksum_update(CHECKSUM_SEED, image->keys, image->count * sizeof(key_t)) != trailer.checksum) return -1;
+  for(size_t i = 1; i < image->count; i++) {
+    if(RBTREE_KEY_LESS(image->keys[i], image->keys[i - 1])) return -1;
+  }
+  return 0;
+}
+
+/**
+ * rbtree_save로 저장한 FD의 file로 tree를 만드는 함수. O(n)
+ * file이 손상되었거나 메모리가 부족하면 NULL을 return.
+*/
+rbtree *rbtree_load(int fd) {
+  rbtree_image *image = map_file(fd);
+  if(image == NULL) return NULL;
+  madvise(image->map, image->map_size, MADV_SEQUENTIAL);
+  rbtree *t = NULL;
+  if(rbtree_image_verify(image) == 0) {
+    t = rbtree_from_sorted(image->keys, image->count);
+  }
+  rbtree_unmap(image);
+  return t;
+}
+
+/**
+ * rbtree_save로 저장한 FD의 file을 읽기 전용으로 여는 함수.
+ * header만 검사하며, FD는 rbtree_unmap 전에 닫아도 된다.
+*/
+rbtree_image *rbtree_map(int fd) {
+  return map_file(fd);
+}
+
+void rbtree_unmap(rbtree_image *image) {
+  munmap(image->map, image->map_size);
+  free(image);
+}
+
+/**
+ * IMAGE에서 KEY와 같은 key를 이진 탐색으로 찾는 함수. 없으면 NULL을 return.
+ * 같은 key가 여러 개이면 그중 첫 번째를 return한다.
+*/
+const key_t *rbtree_image_find(const rbtree_image *image, const key_t key) {
+  size_t lo = 0, hi = image->count;
+  while(lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if(RBTREE_KEY_LESS(image->keys[mid], key)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if(lo == image->count || RBTREE_KEY_LESS(key, image->keys[lo])) return NULL;
+  return &image->keys[lo];
+}
+
+const key_t *rbtree_image_min(const rbtree_image *image) {
+  return image->count == 0 ? NULL : &image->keys[0];
+}
+
+const key_t *rbtree_image_max(const rbtree_image *image) {
+  return image->count == 0 ? NULL : &image->keys[image->count - 1];
+}
+
+size_t rbtree_image_size(const rbtree_image *image) {
+  return image->count;
+}
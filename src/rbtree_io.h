@@ -0,0 +1,41 @@
+#ifndef _RBTREE_IO_H_
+#define _RBTREE_IO_H_
+
+#include "rbtree.h"
+
+/**
+ * tree를 file로 저장하고 다시 읽는 함수들.
+ *
+ * file은 header, 오름차순으로 정렬된 key 배열, checksum trailer로 이루어진다.
+ * header에는 format version과 key_t의 크기, key 수가 있으며 같은 build(key type, byte order)에서만 읽을 수 있다.
+ * node의 pointer나 layout은 저장하지 않으므로 node layout flag가 다른 build끼리는 주고받을 수 있다.
+ * map mode(RBTREE_VALUE_TYPE)의 value는 저장하지 않는다.
+ *
+ * - rbtree_save: T의 key를 순서대로 FD의 현재 위치부터 쓴다. pipe처럼 seek할 수 없는 fd에도 쓸 수 있다.
+ *   rbtree_load와 rbtree_map은 file의 처음부터 읽는다.
+ * - rbtree_load: FD의 file을 mmap하여 검사한 뒤 rbtree_from_sorted로 O(n)에 tree를 만든다.
+ * - rbtree_map: FD의 file을 읽기 전용으로 mmap하고, 역직렬화 없이 정렬된 key 배열에서 바로 탐색한다.
+ *   header만 검사하므로 file 크기와 관계없이 바로 사용할 수 있다. (필요하면 rbtree_image_verify로 전체를 검사)
+*/
+#define RBTREE_FILE_VERSION 1
+
+typedef struct {
+  const key_t *keys;
+  size_t count;
+  void *map;         // mmap한 file 전체
+  size_t map_size;
+} rbtree_image;
+
+int rbtree_save(const rbtree *, int);
+rbtree *rbtree_load(int);
+
+rbtree_image *rbtree_map(int);
+void rbtree_unmap(rbtree_image *);
+int rbtree_image_verify(const rbtree_image *);
+
+const key_t *rbtree_image_find(const rbtree_image *, const key_t);
+const key_t *rbtree_image_min(const rbtree_image *);
+const key_t *rbtree_image_max(const rbtree_image *);
+size_t rbtree_image_size(const rbtree_image *);
+
+#endif  // _RBTREE_IO_H_
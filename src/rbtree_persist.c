@@ -0,0 +1,636 @@
+#include "rbtree_persist.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * node 수가 2^64보다 작은 rbtree의 높이는 128을 넘지 않는다.
+ * erase fixup의 rotation으로 경로가 한 칸 늘어날 수 있으므로 여유를 둔다.
+*/
+#define PATH_MAX_DEPTH 136
+
+/**
+ * update 하나가 새로 만들 수 있는 node 수의 상한.
+ * 경로의 복사본과, fixup에서 색을 바꾸는 sibling/uncle/nephew의 복사본을 합친 것이다.
+*/
+#define UPDATE_MAX_NODES (3 * PATH_MAX_DEPTH + 1)
+
+#define PNODE_CHUNK 1024
+#define PIN_NONE UINT64_MAX
+
+/**
+ * tree마다 미리 만들어 두는 pin record의 수.
+ * 동시에 잡은 snapshot이 이보다 많으면 넘친 record를 새로 할당하여 list에 넣는다.
+*/
+#define PIN_SLOTS 32
+
+/**
+ * snapshot 하나가 고정한 epoch. tree마다 PIN_SLOTS개의 slot과 넘친 record의 list로 관리하며,
+ * release된 record는 다음 snapshot이 재사용한다. reader끼리 cache line을 나눠 쓰지 않도록 정렬한다.
+*/
+struct pin_record {
+  _Alignas(64) pin_record *next;
+  _Atomic uint64_t epoch;   // PIN_NONE이면 고정한 version이 없다
+  atomic_int used;
+};
+
+/**
+ * 회수를 기다리는 node 또는 version.
+ * TAG version부터는 보이지 않으므로, 모든 snapshot이 TAG 이상의 epoch를 고정하고 있으면 회수할 수 있다.
+*/
+typedef struct {
+  void *ptr;
+  uint64_t tag;
+  int is_version;
+} retired_entry;
+
+typedef struct pnode_chunk {
+  struct pnode_chunk *next;
+  pnode_t nodes[PNODE_CHUNK];
+} pnode_chunk;
+
+struct rbtree_persist {
+  _Atomic(rbtree_version *) current;
+  _Atomic uint64_t epoch;             // 마지막으로 공개한 version
+  _Atomic(pin_record *) pins;         // PIN_SLOTS를 넘쳐 할당한 record
+  pthread_mutex_t write_lock;
+
+  // 아래는 write_lock을 잡은 writer만 사용한다
+  pnode_chunk *chunks;
+  size_t used;                        // head chunk에서 사용한 node 수
+  pnode_t *free_list;                 // left로 연결
+  size_t free_count;
+  retired_entry *retired;             // [retired_head, retired_count) 가 회수 대기 중, TAG 순서
+  size_t retired_head, retired_count, retired_cap;
+
+  pin_record pin_slots[PIN_SLOTS];
+};
+
+static atomic_uint pin_threads;               // 처음 pin하는 thread에 나눠 줄 slot 번호
+static _Thread_local unsigned int pin_hint;   // 이 thread가 마지막으로 쓴 slot + 1 (0이면 아직 없다)
+
+/**
+ * 만들고 있는 version의 상태.
+ * BORN이 GEN인 node는 아직 공개되지 않은 복사본이므로 그대로 고쳐도 된다.
+ * PATH에는 root부터 현재 위치의 부모까지의 node(모두 복사본)가 들어 있다.
+*/
+typedef struct {
+  rbtree_persist *t;
+  uint64_t gen;
+  pnode_t *root;
+  rbtree_version *version;
+  pnode_t *path[PATH_MAX_DEPTH];
+  int depth;
+} update_ctx;
+
+static color_t pcolor(const pnode_t *n) {
+  return n == NULL ? RBTREE_BLACK : n->color;
+}
+
+rbtree_persist *new_rbtree_persist(void) {
+  rbtree_persist *t = (rbtree_persist *)aligned_alloc(64, sizeof(rbtree_persist));
+  if(t == NULL) return NULL;
+  memset(t, 0, sizeof(rbtree_persist));
+  rbtree_version *v = (rbtree_version *)calloc(1, sizeof(rbtree_version));
+  if(v == NULL) {
+    free(t);
+    return NULL;
+  }
+  atomic_init(&t->current, v);
+  atomic_init(&t->epoch, 0);
+  atomic_init(&t->pins, NULL);
+  for(size_t i = 0; i < PIN_SLOTS; i++) {
+    atomic_init(&t->pin_slots[i].epoch, PIN_NONE);
+    atomic_init(&t->pin_slots[i].used, 0);
+  }
+  pthread_mutex_init(&t->write_lock, NULL);
+  return t;
+}
+
+/**
+ * T가 사용한 모든 메모리를 반환하는 함수. release되지 않은 snapshot이 없어야 한다.
+*/
+void delete_rbtree_persist(rbtree_persist *t) {
+  for(size_t i = t->retired_head; i < t->retired_count; i++) {
+    if(t->retired[i].is_version) free(t->retired[i].ptr);
+  }
+  free(t->retired);
+  free(atomic_load(&t->current));
+
+  pnode_chunk *chunk = t->chunks;
+  while(chunk != NULL) {
+    pnode_chunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  pin_record *pin = atomic_load(&t->pins);
+  while(pin != NULL) {
+    pin_record *next = pin->next;
+    free(pin);
+    pin = next;
+  }
+  pthread_mutex_destroy(&t->write_lock);
+  free(t);
+}
+
+/**
+ * T에 node가 N개 이상 남도록 chunk를 준비하는 함수. 실패하면 -1을 return.
+ * 새 chunk를 할당하면 이전 head chunk의 남은 node는 free list로 옮긴다.
+*/
+static int reserve_pnodes(rbtree_persist *t, size_t n) {
+  size_t left = t->chunks != NULL ? PNODE_CHUNK - t->used : 0;
+  if(t->free_count + left >= n) return 0;
+
+  pnode_chunk *chunk = (pnode_chunk *)malloc(sizeof(pnode_chunk));
+  if(chunk == NULL) return -1;
+  while(t->chunks != NULL && t->used < PNODE_CHUNK) {
+    pnode_t *node = &t->chunks->nodes[t->used++];
+    node->left = t->free_list;
+    t->free_list = node;
+    t->free_count++;
+  }
+  chunk->next = t->chunks;
+  t->chunks = chunk;
+  t->used = 0;
+  return 0;
+}
+
+static pnode_t *alloc_pnode(rbtree_persist *t) {
+  if(t->free_list != NULL) {
+    pnode_t *node = t->free_list;
+    t->free_list = node->left;
+    t->free_count--;
+    return node;
+  }
+  return &t->chunks->nodes[t->used++];
+}
+
+static void free_pnode(rbtree_persist *t, pnode_t *node) {
+  node->left = t->free_list;
+  t->free_list = node;
+  t->free_count++;
+}
+
+static int reserve_retired(rbtree_persist *t, size_t n) {
+  if(t->retired_head > 0 && t->retired_head * 2 >= t->retired_count) {
+    t->retired_count -= t->retired_head;
+    memmove(t->retired, t->retired + t->retired_head, t->retired_count * sizeof(retired_entry));
+    t->retired_head = 0;
+  }
+  if(t->retired_count + n <= t->retired_cap) return 0;
+
+  size_t cap = t->retired_cap * 2;
+  if(cap < t->retired_count + n) cap = t->retired_count + n;
+  retired_entry *retired = (retired_entry *)realloc(t->retired, cap * sizeof(retired_entry));
+  if(retired == NULL) return -1;
+  t->retired = retired;
+  t->retired_cap = cap;
+  return 0;
+}
+
+static void retire(rbtree_persist *t, void *ptr, uint64_t tag, int is_version) {
+  t->retired[t->retired_count++] = (retired_entry){ptr, tag, is_version};
+}
+
+/**
+ * 어떤 snapshot에서도 보이지 않게 된 node와 version을 회수하는 함수.
+*/
+static void reclaim(rbtree_persist *t) {
+  uint64_t safe = atomic_load(&t->epoch);
+  for(size_t i = 0; i < PIN_SLOTS; i++) {
+    uint64_t epoch = atomic_load(&t->pin_slots[i].epoch);
+    if(epoch < safe) safe = epoch;
+  }
+  for(pin_record *pin = atomic_load(&t->pins); pin != NULL; pin = pin->next) {
+    uint64_t epoch = atomic_load(&pin->epoch);
+    if(epoch < safe) safe = epoch;
+  }
+  while(t->retired_head < t->retired_count && t->retired[t->retired_head].tag <= safe) {
+    retired_entry *e = &t->retired[t->retired_head++];
+    if(e->is_version) free(e->ptr);
+    else free_pnode(t, (pnode_t *)e->ptr);
+  }
+  if(t->retired_head == t->retired_count) {
+    t->retired_head = t->retired_count = 0;
+  }
+}
+
+/**
+ * 새 version을 만들기 시작하는 함수.
+ * 이후 단계가 실패하지 않도록 필요한 node, 회수 목록, version을 미리 확보한다. 실패하면 -1을 return.
+*/
+static int begin_update(rbtree_persist *t, update_ctx *ctx) {
+  if(reserve_pnodes(t, UPDATE_MAX_NODES) != 0) return -1;
+  if(reserve_retired(t, UPDATE_MAX_NODES + 1) != 0) return -1;
+  ctx->version = (rbtree_version *)malloc(sizeof(rbtree_version));
+  if(ctx->version == NULL) return -1;
+
+  ctx->t = t;
+  ctx->gen = atomic_load_explicit(&t->epoch, memory_order_relaxed) + 1;
+  ctx->root = (pnode_t *)atomic_load_explicit(&t->current, memory_order_relaxed)->root;
+  ctx->depth = 0;
+  return 0;
+}
+
+/**
+ * 만든 version을 공개하고, 이전 version을 회수 목록에 넣는 함수.
+*/
+static void commit_update(update_ctx *ctx, size_t size) {
+  rbtree_persist *t = ctx->t;
+  rbtree_version *old = atomic_load_explicit(&t->current, memory_order_relaxed);
+  *ctx->version = (rbtree_version){ctx->root, size, ctx->gen};
+  atomic_store(&t->current, ctx->version);
+  atomic_store(&t->epoch, ctx->gen);
+  retire(t, old, ctx->gen, 1);
+  reclaim(t);
+}
+
+/**
+ * N을 고칠 수 있는 node로 return하는 함수.
+ * 이미 이번 version의 복사본이면 그대로, 아니면 복사본을 만들고 원래 node는 회수 목록에 넣는다.
+ * 호출한 쪽은 부모의 link를 복사본으로 바꿔야 한다.
+*/
+static pnode_t *own(update_ctx *ctx, pnode_t *n) {
+  if(n->born == ctx->gen) return n;
+  pnode_t *copy = alloc_pnode(ctx->t);
+  *copy = *n;
+  copy->born = ctx->gen;
+  retire(ctx->t, n, ctx->gen, 0);
+  return copy;
+}
+
+/**
+ * PATH[PARENT] (PARENT가 -1이면 root)의 자식 OLD를 NEW로 바꾸는 함수.
+*/
+static void replace_child(update_ctx *ctx, int parent, pnode_t *old, pnode_t *new) {
+  if(parent < 0) {
+    ctx->root = new;
+  } else if(ctx->path[parent]->left == old) {
+    ctx->path[parent]->left = new;
+  } else {
+    ctx->path[parent]->right = new;
+  }
+}
+
+/**
+ * X와 X의 오른쪽 자식을 회전하는 함수. 두 node 모두 복사본이어야 한다.
+*/
+static void rotate_left(update_ctx *ctx, pnode_t *x, int parent) {
+  pnode_t *y = x->right;
+  x->right = y->left;
+  y->left = x;
+  replace_child(ctx, parent, x, y);
+}
+
+static void rotate_right(update_ctx *ctx, pnode_t *x, int parent) {
+  pnode_t *y = x->left;
+  x->left = y->right;
+  y->right = x;
+  replace_child(ctx, parent, x, y);
+}
+
+/**
+ * rbtree_insert_fixup과 같지만, 부모를 PATH에서 찾고 색을 바꾸는 uncle은 복사한다.
+*/
+static void insert_fixup(update_ctx *ctx, pnode_t *x) {
+  int i = ctx->depth - 1;   // x의 부모
+  while(i >= 1 && pcolor(ctx->path[i]) == RBTREE_RED) {
+    pnode_t *p = ctx->path[i];
+    pnode_t *g = ctx->path[i - 1];
+    if(p == g->left) {
+      if(pcolor(g->right) == RBTREE_RED) {
+        pnode_t *uncle = own(ctx, g->right);
+        g->right = uncle;
+        p->color = RBTREE_BLACK;
+        uncle->color = RBTREE_BLACK;
+        g->color = RBTREE_RED;
+        x = g;
+        i -= 2;
+        continue;
+      }
+      if(x == p->right) {
+        rotate_left(ctx, p, i - 1);
+        p = x;
+      }
+      p->color = RBTREE_BLACK;
+      g->color = RBTREE_RED;
+      rotate_right(ctx, g, i - 2);
+    } else {
+      if(pcolor(g->left) == RBTREE_RED) {
+        pnode_t *uncle = own(ctx, g->left);
+        g->left = uncle;
+        p->color = RBTREE_BLACK;
+        uncle->color = RBTREE_BLACK;
+        g->color = RBTREE_RED;
+        x = g;
+        i -= 2;
+        continue;
+      }
+      if(x == p->left) {
+        rotate_right(ctx, p, i - 1);
+        p = x;
+      }
+      p->color = RBTREE_BLACK;
+      g->color = RBTREE_RED;
+      rotate_left(ctx, g, i - 2);
+    }
+    break;
+  }
+  ctx->root->color = RBTREE_BLACK;
+}
+
+/**
+ * T의 새 version에 KEY를 삽입하는 함수. 메모리가 부족하면 -1을 return.
+*/
+int rbtree_persist_insert(rbtree_persist *t, const key_t key) {
+  pthread_mutex_lock(&t->write_lock);
+  update_ctx ctx;
+  if(begin_update(t, &ctx) != 0) {
+    pthread_mutex_unlock(&t->write_lock);
+    return -1;
+  }
+
+  // root에서 삽입 위치까지의 경로를 복사한다
+  pnode_t **link = &ctx.root;
+  while(*link != NULL) {
+    pnode_t *n = own(&ctx, *link);
+    *link = n;
+    ctx.path[ctx.depth++] = n;
+    link = RBTREE_KEY_LESS(key, n->key) ? &n->left : &n->right;
+  }
+  pnode_t *x = alloc_pnode(t);
+  *x = (pnode_t){key, RBTREE_RED, ctx.gen, NULL, NULL};
+  *link = x;
+  insert_fixup(&ctx, x);
+
+  size_t size = atomic_load_explicit(&t->current, memory_order_relaxed)->size;
+  commit_update(&ctx, size + 1);
+  pthread_mutex_unlock(&t->write_lock);
+  return 0;
+}
+
+/**
+ * rbtree_erase_fixup과 같지만, 부모를 PATH[I]에서 찾고 색을 바꾸거나 회전하는 sibling과 nephew는 복사한다.
+ * X는 NULL일 수 있다.
+*/
+static void erase_fixup(update_ctx *ctx, pnode_t *x, int i) {
+  while(i >= 0 && pcolor(x) == RBTREE_BLACK) {
+    pnode_t *p = ctx->path[i];
+    // x가 NULL이어도 sibling은 NULL이 아니므로, 부모의 왼쪽이 x이면 x는 왼쪽 자식이다.
+    if(x == p->left) {
+      pnode_t *w = own(ctx, p->right);
+      p->right = w;
+      if(w->color == RBTREE_RED) {
+        w->color = RBTREE_BLACK;
+        p->color = RBTREE_RED;
+        rotate_left(ctx, p, i - 1);
+        ctx->path[i] = w;       // w가 p의 부모가 되었다
+        ctx->path[++i] = p;
+        w = own(ctx, p->right);
+        p->right = w;
+      }
+      if(pcolor(w->left) == RBTREE_BLACK && pcolor(w->right) == RBTREE_BLACK) {
+        w->color = RBTREE_RED;
+        x = p;
+        i--;
+      } else {
+        if(pcolor(w->right) == RBTREE_BLACK) {
+          pnode_t *wl = own(ctx, w->left);
+          w->left = wl;
+          wl->color = RBTREE_BLACK;
+          w->color = RBTREE_RED;
+          rotate_right(ctx, w, i);
+          w = wl;
+        }
+        pnode_t *wr = own(ctx, w->right);
+        w->right = wr;
+        w->color = p->color;
+        p->color = RBTREE_BLACK;
+        wr->color = RBTREE_BLACK;
+        rotate_left(ctx, p, i - 1);
+        x = ctx->root;
+        i = -1;
+      }
+    } else {
+      pnode_t *w = own(ctx, p->left);
+      p->left = w;
+      if(w->color == RBTREE_RED) {
+        w->color = RBTREE_BLACK;
+        p->color = RBTREE_RED;
+        rotate_right(ctx, p, i - 1);
+        ctx->path[i] = w;
+        ctx->path[++i] = p;
+        w = own(ctx, p->left);
+        p->left = w;
+      }
+      if(pcolor(w->left) == RBTREE_BLACK && pcolor(w->right) == RBTREE_BLACK) {
+        w->color = RBTREE_RED;
+        x = p;
+        i--;
+      } else {
+        if(pcolor(w->left) == RBTREE_BLACK) {
+          pnode_t *wr = own(ctx, w->right);
+          w->right = wr;
+          wr->color = RBTREE_BLACK;
+          w->color = RBTREE_RED;
+          rotate_left(ctx, w, i);
+          w = wr;
+        }
+        pnode_t *wl = own(ctx, w->left);
+        w->left = wl;
+        w->color = p->color;
+        p->color = RBTREE_BLACK;
+        wl->color = RBTREE_BLACK;
+        rotate_right(ctx, p, i - 1);
+        x = ctx->root;
+        i = -1;
+      }
+    }
+  }
+  if(pcolor(x) == RBTREE_RED) {
+    pnode_t *o = own(ctx, x);
+    replace_child(ctx, i, x, o);
+    o->color = RBTREE_BLACK;
+  }
+}
+
+static const pnode_t *find_pnode(const pnode_t *p, const key_t key) {
+  while(p != NULL) {
+    const int cmp = RBTREE_KEY_COMPARE(key, p->key);
+    if(cmp == 0) break;
+    p = cmp < 0 ? p->left : p->right;
+  }
+  return p;
+}
+
+/**
+ * T의 새 version에서 KEY를 갖는 node 하나를 삭제하는 함수. KEY가 없거나 메모리가 부족하면 -1을 return.
+*/
+int rbtree_persist_erase(rbtree_persist *t, const key_t key) {
+  pthread_mutex_lock(&t->write_lock);
+  const rbtree_version *current = atomic_load_explicit(&t->current, memory_order_relaxed);
+  update_ctx ctx;
+  // 경로를 복사하기 전에 KEY가 있는지 확인한다
+  if(find_pnode(current->root, key) == NULL || begin_update(t, &ctx) != 0) {
+    pthread_mutex_unlock(&t->write_lock);
+    return -1;
+  }
+
+  pnode_t **link = &ctx.root;
+  pnode_t *z;
+  for(;;) {
+    z = own(&ctx, *link);
+    *link = z;
+    const int cmp = RBTREE_KEY_COMPARE(key, z->key);
+    if(cmp == 0) break;
+    ctx.path[ctx.depth++] = z;
+    link = cmp < 0 ? &z->left : &z->right;
+  }
+
+  // 자식이 둘이면 오른쪽 subtree의 min node의 key를 옮겨 오고 그 node를 지운다
+  if(z->left != NULL && z->right != NULL) {
+    ctx.path[ctx.depth++] = z;
+    pnode_t *target = z;
+    link = &z->right;
+    for(;;) {
+      z = own(&ctx, *link);
+      *link = z;
+      if(z->left == NULL) break;
+      ctx.path[ctx.depth++] = z;
+      link = &z->left;
+    }
+    target->key = z->key;
+  }
+
+  pnode_t *child = z->left != NULL ? z->left : z->right;
+  replace_child(&ctx, ctx.depth - 1, z, child);
+  color_t removed = z->color;
+  free_pnode(t, z);   // 공개되지 않은 복사본이므로 바로 재사용할 수 있다
+  if(removed == RBTREE_BLACK) {
+    erase_fixup(&ctx, child, ctx.depth - 1);
+  }
+
+  commit_update(&ctx, current->size - 1);
+  pthread_mutex_unlock(&t->write_lock);
+  return 0;
+}
+
+static int try_claim(pin_record *pin) {
+  int unused = 0;
+  return atomic_load_explicit(&pin->used, memory_order_relaxed) == 0
+         && atomic_compare_exchange_strong(&pin->used, &unused, 1);
+}
+
+/**
+ * 사용하지 않는 pin record를 가져오는 함수.
+ * thread마다 다른 slot부터 찾으므로, 잡혀 있는 snapshot이 PIN_SLOTS개보다 적으면 보통 첫 slot에서 끝난다.
+ * slot이 모두 쓰이고 있으면 넘친 record의 list에서 찾고, 없으면 새로 만들어 list에 넣는다.
+*/
+static pin_record *claim_pin(rbtree_persist *t) {
+  if(pin_hint == 0) {
+    pin_hint = atomic_fetch_add_explicit(&pin_threads, 1, memory_order_relaxed) % PIN_SLOTS + 1;
+  }
+  for(unsigned int i = 0; i < PIN_SLOTS; i++) {
+    unsigned int slot = (pin_hint - 1 + i) % PIN_SLOTS;
+    if(try_claim(&t->pin_slots[slot])) {
+      pin_hint = slot + 1;
+      return &t->pin_slots[slot];
+    }
+  }
+  for(pin_record *pin = atomic_load(&t->pins); pin != NULL; pin = pin->next) {
+    if(try_claim(pin)) return pin;
+  }
+
+  pin_record *pin = (pin_record *)aligned_alloc(64, sizeof(pin_record));
+  if(pin == NULL) return NULL;
+  atomic_init(&pin->epoch, PIN_NONE);
+  atomic_init(&pin->used, 1);
+  pin_record *head = atomic_load(&t->pins);
+  do {
+    pin->next = head;
+  } while(!atomic_compare_exchange_weak(&t->pins, &head, pin));
+  return pin;
+}
+
+/**
+ * T의 현재 version을 고정한 snapshot을 return하는 함수. writer를 기다리지 않는다.
+ * 동시에 잡은 snapshot이 PIN_SLOTS개 이하이면 할당 없이 O(1)이고, 넘치면 넘친 record의 list를 훑으며
+ * 처음 넘칠 때는 record를 할당한다.
+ * epoch를 먼저 고정한 뒤 version을 읽으므로, 읽은 version의 node는 고정한 epoch 이후에 회수 목록에 들어간다.
+ * 메모리가 부족하면 VERSION이 NULL인 snapshot을 return한다.
+*/
+rbtree_snapshot rbtree_persist_snapshot(rbtree_persist *t) {
+  rbtree_snapshot s = {t, claim_pin(t), NULL};
+  if(s.pin == NULL) return s;
+  atomic_store(&s.pin->epoch, atomic_load(&t->epoch));
+  s.version = atomic_load(&t->current);
+  return s;
+}
+
+void rbtree_snapshot_release(rbtree_snapshot *s) {
+  if(s->pin != NULL) {
+    atomic_store_explicit(&s->pin->epoch, PIN_NONE, memory_order_release);
+    atomic_store_explicit(&s->pin->used, 0, memory_order_release);
+  }
+  s->pin = NULL;
+  s->version = NULL;
+}
+
+static const pnode_t *snapshot_root(const rbtree_snapshot *s) {
+  return s->version != NULL ? s->version->root : NULL;
+}
+
+/**
+ * S에 KEY가 있으면 1, 없으면 0을 return하는 함수.
+*/
+int rbtree_snapshot_find(const rbtree_snapshot *s, const key_t key) {
+  return find_pnode(snapshot_root(s), key) != NULL;
+}
+
+/**
+ * S의 가장 작은 key를 OUT에 담는 함수. S가 비어 있으면 -1을 return.
+*/
+int rbtree_snapshot_min(const rbtree_snapshot *s, key_t *out) {
+  const pnode_t *p = snapshot_root(s);
+  if(p == NULL) return -1;
+  while(p->left != NULL) p = p->left;
+  *out = p->key;
+  return 0;
+}
+
+/**
+ * S의 가장 큰 key를 OUT에 담는 함수. S가 비어 있으면 -1을 return.
+*/
+int rbtree_snapshot_max(const rbtree_snapshot *s, key_t *out) {
+  const pnode_t *p = snapshot_root(s);
+  if(p == NULL) return -1;
+  while(p->right != NULL) p = p->right;
+  *out = p->key;
+  return 0;
+}
+
+size_t rbtree_snapshot_size(const rbtree_snapshot *s) {
+  return s->version != NULL ? s->version->size : 0;
+}
+
+/**
+ * S의 key를 오름차순으로 최대 N개 ARR에 담는 함수.
+*/
+int rbtree_snapshot_to_array(const rbtree_snapshot *s, key_t *arr, const size_t n) {
+  const pnode_t *stack[PATH_MAX_DEPTH];
+  int depth = 0;
+  size_t i = 0;
+  const pnode_t *p = snapshot_root(s);
+  while(i < n && (p != NULL || depth > 0)) {
+    while(p != NULL) {
+      stack[depth++] = p;
+      p = p->left;
+    }
+    p = stack[--depth];
+    arr[i++] = p->key;
+    p = p->right;
+  }
+  return 0;
+}
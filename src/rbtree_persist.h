@@ -0,0 +1,61 @@
+#ifndef _RBTREE_PERSIST_H_
+#define _RBTREE_PERSIST_H_
+
+#include "rbtree.h"
+
+/**
+ * path copying으로 구현한 persistent rbtree.
+ *
+ * insert/erase는 root에서 바뀌는 node까지의 경로만 복사하여 새 version을 만들고,
+ * 바뀌지 않은 subtree는 이전 version과 공유한다. 한 번 공개된 version의 node는 다시 바뀌지 않는다.
+ *
+ * writer는 mutex로 직렬화된다. reader는 rbtree_persist_snapshot으로 현재 version을 O(1)에 고정하고
+ * lock 없이 읽는다. (tree마다 미리 만든 pin slot을 쓰며, 동시에 잡은 snapshot이 32개를 넘으면 넘친 만큼 할당한다) 새 version에서 빠진 node는 epoch 기반으로 회수한다.
+ * (그 node를 볼 수 있는 snapshot이 모두 release된 뒤 재사용한다)
+ *
+ * path copying에는 parent link를 쓸 수 없으므로 node_t 대신 parent가 없는 pnode_t를 사용한다.
+*/
+typedef struct pnode_t {
+  key_t key;
+  color_t color;
+  uint64_t born;    // 이 node를 만든 version
+  struct pnode_t *left, *right;
+} pnode_t;
+
+/**
+ * 공개된 tree 하나의 version. ROOT 아래의 node는 모두 VERSION 이하에서 만들어졌다.
+*/
+typedef struct {
+  const pnode_t *root;
+  size_t size;
+  uint64_t version;
+} rbtree_version;
+
+typedef struct rbtree_persist rbtree_persist;
+typedef struct pin_record pin_record;
+
+/**
+ * 고정된 version 하나. release하기 전까지 VERSION의 모든 node는 회수되지 않는다.
+*/
+typedef struct {
+  rbtree_persist *tree;
+  pin_record *pin;
+  const rbtree_version *version;
+} rbtree_snapshot;
+
+rbtree_persist *new_rbtree_persist(void);
+void delete_rbtree_persist(rbtree_persist *);
+
+int rbtree_persist_insert(rbtree_persist *, const key_t);
+int rbtree_persist_erase(rbtree_persist *, const key_t);
+
+rbtree_snapshot rbtree_persist_snapshot(rbtree_persist *);
+void rbtree_snapshot_release(rbtree_snapshot *);
+
+int rbtree_snapshot_find(const rbtree_snapshot *, const key_t);
+int rbtree_snapshot_min(const rbtree_snapshot *, key_t *);
+int rbtree_snapshot_max(const rbtree_snapshot *, key_t *);
+size_t rbtree_snapshot_size(const rbtree_snapshot *);
+int rbtree_snapshot_to_array(const rbtree_snapshot *, key_t *, const size_t);
+
+#endif  // _RBTREE_PERSIST_H_
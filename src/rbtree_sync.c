@@ -0,0 +1,222 @@
+#include "rbtree_sync.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+/**
+ * 낙관적 읽기를 포기하고 read lock을 잡기 전까지 재시도하는 횟수.
+*/
+#define SYNC_OPTIMISTIC_RETRIES 8
+
+/**
+ * 낙관적 읽기에서 따라가는 node 수의 상한.
+ * node 수가 2^64보다 작은 rbtree의 높이는 128을 넘지 않으므로, 이보다 길면 수정 중인 tree를 읽은 것이다.
+*/
+#define SYNC_MAX_DEPTH 128
+
+/**
+ * 낙관적 읽기에서 writer가 동시에 바꿀 수 있는 칸(root, min/max, count, link)을 한 번에 읽는 macro.
+ * 찢어진 값을 읽지 않도록 relaxed atomic load를 쓰고, 순서는 sequence counter의 fence가 맞춘다.
+*/
+#define SYNC_LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+struct rbtree_sync {
+  rbtree *tree;
+  atomic_uint seq;          // 홀수이면 writer가 tree를 바꾸는 중
+  pthread_rwlock_t lock;    // writer끼리, 그리고 read lock으로 물러난 reader와의 배제
+};
+
+rbtree_sync *new_rbtree_sync(void) {
+  rbtree_sync *s = (rbtree_sync *)calloc(1, sizeof(rbtree_sync));
+  if(s == NULL) return NULL;
+  s->tree = new_rbtree();
+  if(s->tree == NULL) {
+    free(s);
+    return NULL;
+  }
+  atomic_init(&s->seq, 0);
+  pthread_rwlock_init(&s->lock, NULL);
+  return s;
+}
+
+void delete_rbtree_sync(rbtree_sync *s) {
+  pthread_rwlock_destroy(&s->lock);
+  delete_rbtree(s->tree);
+  free(s);
+}
+
+static void write_begin(rbtree_sync *s) {
+  pthread_rwlock_wrlock(&s->lock);
+  unsigned int seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+  atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+}
+
+static void write_end(rbtree_sync *s) {
+  unsigned int seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+  atomic_store_explicit(&s->seq, seq + 1, memory_order_release);
+  pthread_rwlock_unlock(&s->lock);
+}
+
+/**
+ * S에 KEY를 삽입하는 함수. 메모리가 부족하면 -1을 return.
+*/
+int rbtree_sync_insert(rbtree_sync *s, const key_t key) {
+  write_begin(s);
+  node_t *p = rbtree_insert(s->tree, key);
+  write_end(s);
+  return p != NULL ? 0 : -1;
+}
+
+/**
+ * S에서 KEY를 갖는 node 하나를 삭제하는 함수. KEY가 없으면 -1을 return.
+*/
+int rbtree_sync_erase(rbtree_sync *s, const key_t key) {
+  write_begin(s);
+  int result = rbtree_erase_key(s->tree, key);
+  write_end(s);
+  return result;
+}
+
+/**
+ * reader가 수행하는 읽기 연산.
+ * 수정 중인 tree를 읽을 수 있으므로 SYNC_MAX_DEPTH보다 깊이 내려가면 -1을 return하여 다시 시도하게 한다.
+ * link는 검사한 값과 따라가는 값이 같도록 한 번씩만 읽는다. (NIL의 link는 따라갈 수 없다)
+ * erase된 node도 tree가 삭제되기 전까지는 pool에 남아 있으므로 따라가도 안전하다.
+ * KEY는 찾을 key를 넘기고 찾은 key를 돌려받는 칸이다. find는 읽기만 하고 min/max는 쓰기만 한다.
+*/
+typedef int (*sync_reader)(const rbtree *t, key_t *key);
+
+#ifdef RBTREE_INDEX
+static node_t *sync_left(const node_t *p) { return rbtree_node_arena + SYNC_LOAD(p->left); }
+static node_t *sync_right(const node_t *p) { return rbtree_node_arena + SYNC_LOAD(p->right); }
+#else
+static node_t *sync_left(const node_t *p) { return SYNC_LOAD(p->left); }
+static node_t *sync_right(const node_t *p) { return SYNC_LOAD(p->right); }
+#endif
+
+/**
+ * P의 key를 relaxed atomic load로 읽는 함수. byte string key는 byte 단위로 읽는다.
+*/
+static key_t sync_key(const node_t *p) {
+  key_t key;
+#ifdef RBTREE_KEY_BYTES
+  for(size_t i = 0; i < RBTREE_KEY_BYTES; i++) key.bytes[i] = SYNC_LOAD(p->key.bytes[i]);
+#else
+  __atomic_load(&p->key, &key, __ATOMIC_RELAXED);
+#endif
+  return key;
+}
+
+static int read_find(const rbtree *t, key_t *key) {
+  node_t *p = SYNC_LOAD(t->root);
+  for(int depth = 0; p != t->nil; depth++) {
+    if(depth == SYNC_MAX_DEPTH) return -1;
+    const int cmp = RBTREE_KEY_COMPARE(*key, sync_key(p));
+    if(cmp == 0) return 1;
+    p = cmp < 0 ? sync_left(p) : sync_right(p);
+  }
+  return 0;
+}
+
+/**
+ * min/max는 tree가 cache해 둔 node를 읽으므로 spine을 내려가지 않는다.
+*/
+static int read_min(const rbtree *t, key_t *key) {
+  node_t *p = SYNC_LOAD(t->min);
+  if(p == t->nil) return 0;
+  *key = sync_key(p);
+  return 1;
+}
+
+static int read_max(const rbtree *t, key_t *key) {
+  node_t *p = SYNC_LOAD(t->max);
+  if(p == t->nil) return 0;
+  *key = sync_key(p);
+  return 1;
+}
+
+/**
+ * READER를 수행하는 함수. READER가 1을 return하면 KEY에 찾은 key를 담는다.
+ * writer가 없을 때 시작해서 끝날 때까지 sequence counter가 그대로이면 결과를 사용하고,
+ * SYNC_OPTIMISTIC_RETRIES번 실패하면 read lock을 잡고 수행한다.
+ * 실패한 시도가 쓴 key를 버릴 수 있도록 READER에는 KEY의 복사본을 넘긴다.
+*/
+static int sync_read(rbtree_sync *s, sync_reader reader, key_t *key) {
+  for(int retry = 0; retry < SYNC_OPTIMISTIC_RETRIES; retry++) {
+    unsigned int begin = atomic_load_explicit(&s->seq, memory_order_acquire);
+    if(begin & 1) {
+      sched_yield();  // writer가 끝낼 시간을 준다
+      continue;
+    }
+
+    key_t value = *key;
+    int result = reader(s->tree, &value);
+    atomic_thread_fence(memory_order_acquire);
+    if(result >= 0 && atomic_load_explicit(&s->seq, memory_order_relaxed) == begin) {
+      if(result == 1) *key = value;
+      return result;
+    }
+  }
+
+  pthread_rwlock_rdlock(&s->lock);
+  key_t value = *key;
+  int result = reader(s->tree, &value);
+  pthread_rwlock_unlock(&s->lock);
+  if(result == 1) *key = value;
+  return result;
+}
+
+/**
+ * S에 KEY가 있으면 1, 없으면 0을 return하는 함수.
+*/
+int rbtree_sync_find(rbtree_sync *s, const key_t key) {
+  key_t probe = key;
+  return sync_read(s, read_find, &probe);
+}
+
+// min/max가 넘기는 빈 칸의 초기값 (key_t가 struct여도 0으로 초기화된다)
+static const key_t no_key;
+
+/**
+ * S의 가장 작은 key를 OUT에 담는 함수. S가 비어 있으면 -1을 return.
+*/
+int rbtree_sync_min(rbtree_sync *s, key_t *out) {
+  key_t found = no_key;
+  if(sync_read(s, read_min, &found) != 1) return -1;
+  *out = found;
+  return 0;
+}
+
+/**
+ * S의 가장 큰 key를 OUT에 담는 함수. S가 비어 있으면 -1을 return.
+*/
+int rbtree_sync_max(rbtree_sync *s, key_t *out) {
+  key_t found = no_key;
+  if(sync_read(s, read_max, &found) != 1) return -1;
+  *out = found;
+  return 0;
+}
+
+/**
+ * S에 저장된 key의 수를 return하는 함수.
+*/
+size_t rbtree_sync_size(rbtree_sync *s) {
+  for(int retry = 0; retry < SYNC_OPTIMISTIC_RETRIES; retry++) {
+    unsigned int begin = atomic_load_explicit(&s->seq, memory_order_acquire);
+    if(begin & 1) {
+      sched_yield();
+      continue;
+    }
+    size_t count = SYNC_LOAD(s->tree->count);
+    atomic_thread_fence(memory_order_acquire);
+    if(atomic_load_explicit(&s->seq, memory_order_relaxed) == begin) return count;
+  }
+
+  pthread_rwlock_rdlock(&s->lock);
+  size_t count = rbtree_size(s->tree);
+  pthread_rwlock_unlock(&s->lock);
+  return count;
+}
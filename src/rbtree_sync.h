@@ -0,0 +1,28 @@
+#ifndef _RBTREE_SYNC_H_
+#define _RBTREE_SYNC_H_
+
+#include "rbtree.h"
+
+/**
+ * 여러 thread가 함께 쓰는 rbtree.
+ * 
+ * writer(insert, erase)는 write lock으로 직렬화되고, sequence counter를 홀수로 만든 동안에만 tree를 바꾼다.
+ * reader(find, min, max, size)는 lock 없이 tree를 읽은 뒤 그동안 sequence counter가 바뀌지 않았으면 결과를 사용한다. (seqlock)
+ * 쓰기가 많아 낙관적 읽기가 여러 번 실패하면 read lock을 잡고 읽는다.
+ * 
+ * reader가 node pointer를 들고 있는 동안 다른 thread가 그 node를 erase할 수 있으므로, 결과는 key로 돌려준다.
+*/
+typedef struct rbtree_sync rbtree_sync;
+
+rbtree_sync *new_rbtree_sync(void);
+void delete_rbtree_sync(rbtree_sync *);
+
+int rbtree_sync_insert(rbtree_sync *, const key_t);
+int rbtree_sync_erase(rbtree_sync *, const key_t);
+
+int rbtree_sync_find(rbtree_sync *, const key_t);
+int rbtree_sync_min(rbtree_sync *, key_t *);
+int rbtree_sync_max(rbtree_sync *, key_t *);
+size_t rbtree_sync_size(rbtree_sync *);
+
+#endif  // _RBTREE_SYNC_H_
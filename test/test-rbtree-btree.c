@@ -0,0 +1,170 @@
+#include <assert.h>
+#include <btree.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// returns the number of keys under N, checking key order, node sizes and leaf depth
+static size_t check_bnode(const bnode *n, const size_t height, const bool root,
+                          const key_t *lo, const key_t *hi, const bnode **leaf) {
+  assert(n->count <= BTREE_ORDER);
+  if (!root) {
+    assert(n->count >= BTREE_ORDER / 2);
+  }
+  for (uint32_t i = 0; i < n->count; i++) {
+    assert(i == 0 || n->keys[i - 1] <= n->keys[i]);
+    assert(lo == NULL || *lo <= n->keys[i]);
+    assert(hi == NULL || n->keys[i] <= *hi);
+  }
+  if (height == 0) {
+    // leaves are reached in key order and must be chained the same way
+    if (*leaf != NULL) {
+      assert((*leaf)->next == n);
+    }
+    *leaf = n;
+    return n->count;
+  }
+  assert(root || n->count > 0);
+  size_t total = 0;
+  for (uint32_t i = 0; i <= n->count; i++) {
+    const key_t *clo = i == 0 ? lo : &n->keys[i - 1];
+    const key_t *chi = i == n->count ? hi : &n->keys[i];
+    total += check_bnode(n->children[i], height - 1, false, clo, chi, leaf);
+  }
+  return total;
+}
+
+static void check_btree(const btree *t, const key_t *arr, const size_t n) {
+  const bnode *leaf = NULL;
+  assert(check_bnode(t->root, t->height, true, NULL, NULL, &leaf) == n);
+  assert(leaf->next == NULL);
+  assert(btree_size(t) == n);
+
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  btree_to_array(t, res, n);
+  for (size_t i = 0; i < n; i++) {
+    assert(res[i] == arr[i]);
+  }
+  free(res);
+  if (n == 0) {
+    assert(btree_min(t) == NULL && btree_max(t) == NULL);
+  } else {
+    assert(*btree_min(t) == arr[0]);
+    assert(*btree_max(t) == arr[n - 1]);
+  }
+}
+
+// random inserts and erases with many duplicates should match a sorted reference array
+void test_btree_random(const size_t ops, const key_t range, const unsigned int seed) {
+  srand(seed);
+  btree *t = new_btree();
+  assert(t != NULL);
+  key_t *ref = calloc(ops + 1, sizeof(key_t));
+  size_t n = 0;
+
+  for (size_t op = 0; op < ops; op++) {
+    const key_t key = rand() % range;
+    size_t i = 0;
+    while (i < n && ref[i] < key) {
+      i++;
+    }
+    // grow for the first half, then shrink
+    if (rand() % 4 < (op < ops / 2 ? 1 : 3)) {
+      if (i < n && ref[i] == key) {
+        assert(btree_find(t, key) != NULL && *btree_find(t, key) == key);
+        assert(btree_erase(t, key) == 0);
+        memmove(ref + i, ref + i + 1, (n - i - 1) * sizeof(key_t));
+        n--;
+      } else {
+        assert(btree_find(t, key) == NULL);
+        assert(btree_erase(t, key) == -1);
+      }
+    } else {
+      assert(btree_insert(t, key) == 0);
+      memmove(ref + i + 1, ref + i, (n - i) * sizeof(key_t));
+      ref[i] = key;
+      n++;
+    }
+    if (op % 101 == 0) {
+      check_btree(t, ref, n);
+    }
+  }
+  check_btree(t, ref, n);
+
+  // erase everything that is left
+  for (size_t i = 0; i < n; i++) {
+    assert(btree_erase(t, ref[i]) == 0);
+  }
+  check_btree(t, ref, 0);
+  assert(t->height == 0);
+
+  free(ref);
+  delete_btree(t);
+}
+
+// sorted and reverse sorted inserts split only one side of the tree
+void test_btree_sequential(const size_t n) {
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = (key_t)i;
+  }
+  btree *up = new_btree();
+  btree *down = new_btree();
+  for (size_t i = 0; i < n; i++) {
+    assert(btree_insert(up, (key_t)i) == 0);
+    assert(btree_insert(down, (key_t)(n - 1 - i)) == 0);
+  }
+  check_btree(up, arr, n);
+  check_btree(down, arr, n);
+  for (size_t i = 0; i < n; i++) {
+    assert(btree_find(up, (key_t)i) != NULL);
+    assert(btree_find(down, (key_t)i) != NULL);
+  }
+  assert(btree_find(up, -1) == NULL);
+  assert(btree_find(up, (key_t)n) == NULL);
+
+  // erase the lower half from the front
+  for (size_t i = 0; i < n / 2; i++) {
+    assert(btree_erase(up, (key_t)i) == 0);
+  }
+  check_btree(up, arr + n / 2, n - n / 2);
+
+  free(arr);
+  delete_btree(up);
+  delete_btree(down);
+}
+
+// one key repeated across many leaves should still be found and erased
+void test_btree_duplicates(const size_t n) {
+  btree *t = new_btree();
+  key_t *arr = calloc(n + 2, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    assert(btree_insert(t, 7) == 0);
+    arr[i + 1] = 7;
+  }
+  assert(btree_insert(t, 3) == 0);
+  assert(btree_insert(t, 9) == 0);
+  arr[0] = 3;
+  arr[n + 1] = 9;
+  check_btree(t, arr, n + 2);
+  for (size_t i = 0; i < n; i++) {
+    assert(btree_find(t, 7) != NULL);
+    assert(btree_erase(t, 7) == 0);
+  }
+  assert(btree_find(t, 7) == NULL);
+  arr[1] = 9;
+  check_btree(t, arr, 2);
+  free(arr);
+  delete_btree(t);
+}
+
+int main(void) {
+  test_btree_sequential(1);
+  test_btree_sequential(10000);
+  test_btree_duplicates(1000);
+  test_btree_random(20000, 50, 1);
+  test_btree_random(20000, 5000, 2);
+  test_btree_random(50000, 1000000, 3);
+  printf("Passed all tests!\n");
+}
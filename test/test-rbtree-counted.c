@@ -0,0 +1,263 @@
+#include <assert.h>
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Tests for the counted multiset mode (RBTREE_COUNTED): equal keys share one node.
+
+static int comp(const void *p1, const void *p2) {
+  const key_t *e1 = (const key_t *)p1;
+  const key_t *e2 = (const key_t *)p2;
+  return *e1 < *e2 ? -1 : *e1 > *e2;
+}
+
+static size_t count_nodes(const rbtree *t) {
+  size_t nodes = 0;
+  for (node_t *p = rbtree_min(t); p != t->nil && p != NULL; p = rbtree_next(t, p)) {
+    nodes++;
+  }
+  return nodes;
+}
+
+// the tree should expand to exactly ARR (sorted) and hold DISTINCT nodes
+static void check_tree(const rbtree *t, const key_t *arr, const size_t n, const size_t distinct) {
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  assert(rbtree_size(t) == n);
+  assert(count_nodes(t) == distinct);
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  assert(rbtree_to_array(t, res, n + 1) == 0);
+  assert(memcmp(res, arr, n * sizeof(key_t)) == 0);
+  free(res);
+}
+
+// inserting a key again should bump its node instead of adding one
+void test_insert_copies(void) {
+  rbtree *t = new_rbtree();
+  node_t *p = rbtree_insert(t, 7);
+  assert(p != NULL && p->copies == 1);
+  assert(rbtree_insert(t, 7) == p);
+  assert(rbtree_insert(t, 7) == p);
+  assert(p->copies == 3 && t->root == p);
+  assert(rbtree_insert(t, 3) != p);
+  assert(rbtree_insert_hint(t, p, 7) == p);
+  assert(rbtree_insert_hint(t, NULL, 3) == rbtree_min(t));
+  const key_t arr[] = {3, 3, 7, 7, 7, 7};
+  check_tree(t, arr, 6, 2);
+  assert(rbtree_count_range(t, 3, 8) == 6);
+  assert(rbtree_count_range(t, 4, 8) == 4);
+  delete_rbtree(t);
+}
+
+// erase and pops should take one copy at a time and unlink the node with the last one
+void test_erase_copies(void) {
+  rbtree *t = new_rbtree();
+  for (key_t k = 0; k < 3; k++) {
+    for (int i = 0; i < 3; i++) {
+      rbtree_insert(t, k);
+    }
+  }
+  node_t *mid = rbtree_find(t, 1);
+  assert(rbtree_erase(t, mid) == 0);
+  assert(rbtree_find(t, 1) == mid && mid->copies == 2);
+  assert(rbtree_erase_key(t, 1) == 0);
+  assert(rbtree_erase_key(t, 1) == 0);
+  assert(rbtree_find(t, 1) == NULL);
+  assert(rbtree_erase_key(t, 1) == -1);
+  const key_t arr[] = {0, 0, 0, 2, 2, 2};
+  check_tree(t, arr, 6, 2);
+
+  key_t key;
+  assert(rbtree_pop_min(t, &key) == 0 && key == 0);
+  assert(rbtree_pop_max(t, &key) == 0 && key == 2);
+  check_tree(t, arr + 1, 4, 2);
+  for (int i = 0; i < 2; i++) {
+    assert(rbtree_pop_min(t, &key) == 0 && key == 0);
+  }
+  assert(rbtree_min(t)->key == 2 && rbtree_min(t) == rbtree_max(t));
+  for (int i = 0; i < 2; i++) {
+    assert(rbtree_pop_max(t, &key) == 0 && key == 2);
+  }
+  assert(rbtree_pop_max(t, &key) == -1);
+  check_tree(t, arr, 0, 0);
+  delete_rbtree(t);
+}
+
+// random inserts over a small key range: memory and height follow the distinct keys
+void test_random(const size_t n, const key_t range, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % range;
+    assert(rbtree_insert(t, arr[i]) != NULL);
+  }
+  qsort(arr, n, sizeof(key_t), comp);
+  size_t distinct = 0;
+  for (size_t i = 0; i < n; i++) {
+    distinct += i == 0 || arr[i - 1] != arr[i];
+  }
+  check_tree(t, arr, n, distinct);
+
+  // erase every other key again, in random order
+  for (size_t i = 0; i < n / 2; i++) {
+    const key_t key = arr[rand() % n];
+    node_t *p = rbtree_find(t, key);
+    if (p != NULL) {
+      assert(rbtree_erase(t, p) == 0);
+    }
+  }
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  free(arr);
+  delete_rbtree(t);
+}
+
+// from_sorted and insert_batch should coalesce runs, in the tree and in the batch
+void test_bulk(void) {
+  const key_t sorted[] = {1, 1, 1, 2, 4, 4, 9};
+  rbtree *t = rbtree_from_sorted(sorted, 7);
+  assert(t != NULL);
+  check_tree(t, sorted, 7, 4);
+  node_t *four = rbtree_find(t, 4);
+
+  // a large batch rebuilds the tree and keeps the old nodes
+  key_t batch[64];
+  for (size_t i = 0; i < 64; i++) {
+    batch[i] = (key_t)(i % 8);
+  }
+  assert(rbtree_insert_batch(t, batch, 64) == 0);
+  assert(rbtree_find(t, 4) == four && four->copies == 10);
+  key_t expect[71];
+  memcpy(expect, sorted, sizeof(sorted));
+  memcpy(expect + 7, batch, sizeof(batch));
+  qsort(expect, 71, sizeof(key_t), comp);
+  check_tree(t, expect, 71, 9);
+
+  // a small batch goes through the finger path
+  const key_t few[] = {9, 4, 20};
+  assert(rbtree_insert_batch(t, few, 3) == 0);
+  assert(four->copies == 11);
+  key_t more[74];
+  memcpy(more, expect, sizeof(expect));
+  memcpy(more + 71, few, sizeof(few));
+  qsort(more, 74, sizeof(key_t), comp);
+  check_tree(t, more, 74, 10);
+  delete_rbtree(t);
+
+  t = rbtree_from_sorted(sorted, 0);
+  assert(t != NULL && rbtree_size(t) == 0);
+  delete_rbtree(t);
+}
+
+// export should split a node's copies across calls without losing or repeating any
+void test_export(void) {
+  rbtree *t = new_rbtree();
+  key_t arr[60];
+  size_t n = 0;
+  for (key_t k = 0; k < 10; k++) {
+    for (key_t i = 0; i <= k; i++) {
+      rbtree_insert(t, k);
+      arr[n++] = k;
+    }
+  }
+  const size_t batches[] = {1, 2, 4, 7, 64};
+  for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+    rbtree_export_token token = {0};
+    key_t res[64];
+    size_t total = 0, got;
+    while ((got = rbtree_export(t, &token, res + total, batches[b])) > 0) {
+      total += got;
+    }
+    assert(total == n);
+    assert(memcmp(res, arr, n * sizeof(key_t)) == 0);
+  }
+
+  // stop inside the copies of 9, then drop two of them
+  rbtree_export_token token = {0};
+  key_t res[64];
+  assert(rbtree_export(t, &token, res, n - 5) == n - 5);
+  rbtree_erase_key(t, 9);
+  rbtree_erase_key(t, 9);
+  assert(rbtree_export(t, &token, res, 64) == 3);
+  assert(res[0] == 9 && res[2] == 9);
+  delete_rbtree(t);
+}
+
+// join should merge equal keys at the boundary into one node
+void test_join(void) {
+  rbtree *t1 = new_rbtree();
+  rbtree *t2 = new_rbtree();
+  for (key_t k = 0; k < 100; k++) {
+    rbtree_insert(t1, k);
+    rbtree_insert(t1, 99);
+    rbtree_insert(t2, 99 + k);
+  }
+  assert(rbtree_join(t1, t2) == 0);
+  assert(rbtree_size(t1) == 300 && rbtree_size(t2) == 0);
+  assert(count_nodes(t1) == 199);
+  assert(rbtree_find(t1, 99)->copies == 102);
+  assert(rbtree_validate(t1) == RBTREE_VALID);
+
+  rbtree *right = rbtree_split(t1, 99);
+  assert(rbtree_size(t1) == 99 && rbtree_size(right) == 201);
+  assert(rbtree_validate(right) == RBTREE_VALID);
+  delete_rbtree(right);
+  delete_rbtree(t1);
+  delete_rbtree(t2);
+}
+
+// set operations keep t1's copies and must still know the result size
+void test_set_operations(void) {
+  const key_t a[] = {1, 1, 2, 5, 5, 5};
+  const key_t b[] = {2, 2, 3, 5};
+  const key_t expect_union[] = {1, 1, 2, 3, 5, 5, 5};
+  const key_t expect_intersection[] = {2, 5, 5, 5};
+  const key_t expect_difference[] = {1, 1};
+  for (int op = 0; op < 3; op++) {
+    rbtree *t1 = rbtree_from_sorted(a, 6);
+    rbtree *t2 = rbtree_from_sorted(b, 4);
+    if (op == 0) {
+      rbtree_union(t1, t2);
+      check_tree(t1, expect_union, 7, 4);
+    } else if (op == 1) {
+      rbtree_intersection(t1, t2);
+      check_tree(t1, expect_intersection, 4, 2);
+    } else {
+      rbtree_difference(t1, t2);
+      check_tree(t1, expect_difference, 2, 1);
+    }
+    check_tree(t2, a, 0, 0);
+    delete_rbtree(t2);
+    delete_rbtree(t1);
+  }
+}
+
+// validate should reject a node that holds no key and equal keys in two nodes
+void test_validate(void) {
+  rbtree *t = new_rbtree();
+  for (key_t k = 0; k < 10; k++) {
+    rbtree_insert(t, k);
+  }
+  node_t *p = rbtree_find(t, 4);
+  p->copies = 0;
+  assert(rbtree_validate(t) == RBTREE_BAD_SIZE);
+  p->copies = 1;
+  p->key = 5;
+  assert(rbtree_validate(t) == RBTREE_BAD_ORDER);
+  p->key = 4;
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  delete_rbtree(t);
+}
+
+int main(void) {
+  test_insert_copies();
+  test_erase_copies();
+  test_random(100000, 100, 1);
+  test_random(100000, 100000, 2);
+  test_bulk();
+  test_export();
+  test_join();
+  test_set_operations();
+  test_validate();
+  printf("Passed all tests!\n");
+}
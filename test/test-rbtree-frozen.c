@@ -0,0 +1,94 @@
+#include <assert.h>
+#include <rbtree.h>
+#include <rbtree_frozen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int comp(const void *p1, const void *p2) {
+  const key_t *e1 = (const key_t *)p1;
+  const key_t *e2 = (const key_t *)p2;
+  return *e1 < *e2 ? -1 : *e1 > *e2;
+}
+
+// every query from below the smallest to above the largest key should match the sorted array
+static void check_frozen(const rbtree_frozen *f, const key_t *arr, const size_t n, const key_t range) {
+  assert(rbtree_frozen_size(f) == n);
+  if (n == 0) {
+    assert(rbtree_frozen_min(f) == NULL && rbtree_frozen_max(f) == NULL);
+  } else {
+    assert(*rbtree_frozen_min(f) == arr[0]);
+    assert(*rbtree_frozen_max(f) == arr[n - 1]);
+  }
+
+  size_t i = 0;
+  for (key_t key = -1; key <= range; key++) {
+    while (i < n && arr[i] < key) {
+      i++;
+    }
+    const key_t *lb = rbtree_frozen_lower_bound(f, key);
+    const key_t *found = rbtree_frozen_find(f, key);
+    if (i == n) {
+      assert(lb == NULL && found == NULL);
+      continue;
+    }
+    assert(lb != NULL && *lb == arr[i]);
+    if (arr[i] == key) {
+      // the first of equal keys, which is also what lower_bound gives
+      assert(found == lb);
+    } else {
+      assert(found == NULL);
+    }
+  }
+}
+
+// freezing trees of every small size exercises all shapes of the last level
+void test_freeze_sizes(const size_t max_n) {
+  key_t *arr = calloc(max_n + 1, sizeof(key_t));
+  for (size_t n = 0; n <= max_n; n++) {
+    rbtree *t = new_rbtree();
+    for (size_t i = 0; i < n; i++) {
+      arr[i] = (key_t)(2 * i);  // odd keys are missing
+      rbtree_insert(t, arr[i]);
+    }
+    rbtree_frozen *f = rbtree_freeze(t);
+    assert(f != NULL);
+    check_frozen(f, arr, n, (key_t)(2 * n));
+    delete_rbtree_frozen(f);
+    delete_rbtree(t);
+  }
+  free(arr);
+}
+
+// random keys with duplicates, and the tree should be left unchanged
+void test_freeze_random(const size_t n, const key_t range, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % range;
+    rbtree_insert(t, arr[i]);
+  }
+  qsort(arr, n, sizeof(key_t), comp);
+
+  rbtree_frozen *f = rbtree_freeze(t);
+  assert(f != NULL);
+  check_frozen(f, arr, n, range);
+  assert(rbtree_validate(t) == RBTREE_VALID && rbtree_size(t) == n);
+
+  // the frozen copy does not see later changes
+  rbtree_insert(t, range + 1);
+  assert(rbtree_frozen_find(f, range + 1) == NULL);
+  delete_rbtree(t);
+  check_frozen(f, arr, n, range);
+
+  free(arr);
+  delete_rbtree_frozen(f);
+}
+
+int main(void) {
+  test_freeze_sizes(100);
+  test_freeze_random(1000, 100, 1);
+  test_freeze_random(100000, 1000000, 2);
+  printf("Passed all tests!\n");
+}
@@ -0,0 +1,121 @@
+#include <assert.h>
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Differential fuzzer: random operations are applied to the tree and to a
+// sorted array, and every answer the tree gives is checked against the array.
+//
+// usage: test-rbtree-fuzz [ops] [seed] [range]
+
+// index of the first element of REF not less than KEY
+static size_t ref_lower_bound(const key_t *ref, const size_t n, const key_t key) {
+  size_t lo = 0, hi = n;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (ref[mid] < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static void check_all(const rbtree *t, const key_t *ref, const size_t n, key_t *buf) {
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  assert(rbtree_size(t) == n);
+  memset(buf, 0, (n + 1) * sizeof(key_t));
+  rbtree_to_array(t, buf, n + 1);
+  assert(memcmp(buf, ref, n * sizeof(key_t)) == 0);
+}
+
+static void fuzz(const size_t ops, const unsigned int seed, const key_t range) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  assert(t != NULL);
+  key_t *ref = calloc(ops + 1, sizeof(key_t));
+  key_t *buf = calloc(ops + 1, sizeof(key_t));
+  size_t n = 0;
+
+  for (size_t op = 0; op < ops; op++) {
+    const key_t key = rand() % range;
+    const size_t i = ref_lower_bound(ref, n, key);
+    const int found = i < n && ref[i] == key;
+    // the insert/erase mix drifts so the tree grows and shrinks several times
+    const int grow = (op / 4096) % 2 == 0 ? 6 : 3;
+    node_t *p;
+
+    const int r = rand() % 100;
+    if (r < 10) {
+      p = rbtree_find(t, key);
+      assert(found ? p != NULL && p->key == key : p == NULL);
+    } else if (r < 20) {
+      p = rbtree_lower_bound(t, key);
+      assert(i < n ? p != NULL && p->key == ref[i] : p == NULL);
+    } else if (r < 30) {
+      p = rbtree_min(t);
+      assert(n == 0 || p->key == ref[0]);
+      p = rbtree_max(t);
+      assert(n == 0 || p->key == ref[n - 1]);
+    } else if (r < 35) {
+      key_t popped;
+      if (n == 0) {
+        assert(rbtree_pop_min(t, &popped) == -1 && rbtree_pop_max(t, &popped) == -1);
+      } else if (r % 2) {
+        assert(rbtree_pop_min(t, &popped) == 0 && popped == ref[0]);
+        memmove(ref, ref + 1, (n - 1) * sizeof(key_t));
+        n--;
+      } else {
+        assert(rbtree_pop_max(t, &popped) == 0 && popped == ref[n - 1]);
+        n--;
+      }
+    } else if (r == 35) {
+      check_all(t, ref, n, buf);
+    } else {
+      if (rand() % 7 < grow) {
+        node_t *hint = NULL;
+        if (n > 0 && rand() % 2) {
+          // start from the neighbour of KEY, or sometimes from any node
+          const size_t h = rand() % 4 ? (i < n ? i : n - 1) : (size_t)rand() % n;
+          hint = rbtree_find(t, ref[h]);
+        }
+        assert(rbtree_insert_hint(t, hint, key) != NULL);
+        memmove(ref + i + 1, ref + i, (n - i) * sizeof(key_t));
+        ref[i] = key;
+        n++;
+      } else if (found) {
+        if (rand() % 2) {
+          assert(rbtree_erase_key(t, key) == 0);
+        } else {
+          p = rbtree_find(t, key);
+          assert(p != NULL);
+          assert(rbtree_erase(t, p) == 0);
+        }
+        memmove(ref + i, ref + i + 1, (n - i - 1) * sizeof(key_t));
+        n--;
+      } else {
+        assert(rbtree_erase_key(t, key) == -1);
+      }
+    }
+    // validating is O(n), so do it only every few operations
+    if (op % 64 == 0) {
+      assert(rbtree_validate(t) == RBTREE_VALID);
+    }
+  }
+  check_all(t, ref, n, buf);
+
+  free(ref);
+  free(buf);
+  delete_rbtree(t);
+}
+
+int main(int argc, char *argv[]) {
+  const size_t ops = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+  const unsigned int seed = argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 10) : 1;
+  const key_t range = argc > 3 ? (key_t)strtol(argv[3], NULL, 10) : 1000;
+  printf("fuzz: ops=%zu seed=%u range=%d\n", ops, seed, (int)range);
+  fuzz(ops, seed, range);
+  printf("Passed all tests!\n");
+}
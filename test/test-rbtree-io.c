@@ -0,0 +1,162 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <rbtree_io.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int temp_file(void) {
+  char path[] = "/tmp/test-rbtree-io-XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  unlink(path);
+  return fd;
+}
+
+// saves T into a fresh file and returns its fd
+static int save_to_file(const rbtree *t) {
+  int fd = temp_file();
+  assert(rbtree_save(t, fd) == 0);
+  return fd;
+}
+
+static void check_keys(const rbtree *t, const key_t *arr, const size_t n) {
+  assert(rbtree_size(t) == n);
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  rbtree_to_array(t, res, n);
+  for (size_t i = 0; i < n; i++) {
+    assert(res[i] == arr[i]);
+  }
+  free(res);
+}
+
+static int comp(const void *p1, const void *p2) {
+  const key_t *e1 = (const key_t *)p1;
+  const key_t *e2 = (const key_t *)p2;
+  return (*e1 > *e2) - (*e1 < *e2);
+}
+
+// a saved tree should load back with the same keys, through rbtree_load and rbtree_map
+void test_save_load(const size_t n, const unsigned int seed) {
+  srand(seed);
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  rbtree *t = new_rbtree();
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % (key_t)(n + 1);  // with duplicates
+    rbtree_insert(t, arr[i]);
+  }
+  qsort(arr, n, sizeof(key_t), comp);
+
+  int fd = save_to_file(t);
+  rbtree *loaded = rbtree_load(fd);
+  assert(loaded != NULL);
+  check_keys(loaded, arr, n);
+
+  rbtree_image *image = rbtree_map(fd);
+  assert(image != NULL);
+  close(fd);  // the mapping outlives the fd
+  assert(rbtree_image_verify(image) == 0);
+  assert(rbtree_image_size(image) == n);
+  if (n == 0) {
+    assert(rbtree_image_min(image) == NULL && rbtree_image_max(image) == NULL);
+  } else {
+    assert(*rbtree_image_min(image) == arr[0]);
+    assert(*rbtree_image_max(image) == arr[n - 1]);
+  }
+  for (key_t key = -1; key <= (key_t)(n + 1); key++) {
+    const key_t *found = rbtree_image_find(image, key);
+    node_t *node = rbtree_find(t, key);
+    assert((found == NULL) == (node == NULL));
+    if (found != NULL) {
+      assert(*found == key);
+      // duplicates are served from the first copy
+      assert(found == image->keys || found[-1] < key);
+    }
+  }
+  rbtree_unmap(image);
+
+  delete_rbtree(loaded);
+  delete_rbtree(t);
+  free(arr);
+}
+
+// damaged or foreign files should be rejected
+void test_load_corrupted(void) {
+  rbtree *t = new_rbtree();
+  for (key_t i = 0; i < 1000; i++) {
+    rbtree_insert(t, i * 2);
+  }
+  int fd = save_to_file(t);
+  const off_t size = lseek(fd, 0, SEEK_END);
+  char *bytes = malloc(size);
+  assert(pread(fd, bytes, size, 0) == size);
+  close(fd);
+
+  // flip one bit in the header, in a key, and in the checksum
+  const off_t offsets[] = {0, 8, 16, 32 + 4 * 500, size - 1};
+  for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+    fd = temp_file();
+    bytes[offsets[i]] ^= 1;
+    assert(pwrite(fd, bytes, size, 0) == size);
+    bytes[offsets[i]] ^= 1;
+    assert(rbtree_load(fd) == NULL);
+    rbtree_image *image = rbtree_map(fd);
+    assert(image == NULL || rbtree_image_verify(image) == -1);
+    if (image != NULL) {
+      rbtree_unmap(image);
+    }
+    close(fd);
+  }
+
+  // truncated and empty files
+  const off_t lengths[] = {0, 16, size - 1};
+  for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+    fd = temp_file();
+    assert(pwrite(fd, bytes, lengths[i], 0) == lengths[i]);
+    assert(rbtree_load(fd) == NULL);
+    assert(rbtree_map(fd) == NULL);
+    close(fd);
+  }
+
+  // the intact copy still loads
+  fd = temp_file();
+  assert(pwrite(fd, bytes, size, 0) == size);
+  rbtree *loaded = rbtree_load(fd);
+  assert(loaded != NULL && rbtree_size(loaded) == 1000);
+  close(fd);
+
+  delete_rbtree(loaded);
+  free(bytes);
+  delete_rbtree(t);
+}
+
+// rbtree_save writes sequentially, so it also works on a pipe
+void test_save_pipe(void) {
+  rbtree *t = new_rbtree();
+  for (key_t i = 0; i < 100; i++) {
+    rbtree_insert(t, i);
+  }
+  int fds[2];
+  assert(pipe(fds) == 0);
+  assert(rbtree_save(t, fds[1]) == 0);
+  close(fds[1]);
+  char buf[4096];
+  ssize_t total = 0, got;
+  while ((got = read(fds[0], buf, sizeof(buf))) > 0) {
+    total += got;
+  }
+  close(fds[0]);
+  assert(total == 32 + 100 * (ssize_t)sizeof(key_t) + 8);
+  delete_rbtree(t);
+}
+
+int main(void) {
+  test_save_load(0, 1);
+  test_save_load(1, 2);
+  test_save_load(10000, 3);
+  test_save_load(100000, 4);
+  test_load_corrupted();
+  test_save_pipe();
+  printf("Passed all tests!\n");
+}
@@ -0,0 +1,199 @@
+#include <assert.h>
+#include <rbtree.h>
+#include <rbtree_frozen.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// build with RBTREE_VALUE_TYPE and either RBTREE_KEY_TYPE or RBTREE_KEY_BYTES
+#ifndef RBTREE_VALUE_TYPE
+#error "test-rbtree-map needs RBTREE_VALUE_TYPE"
+#endif
+
+// key for the number I, ordered the same way as I under RBTREE_KEY_LESS
+static key_t make_key(const uint64_t i) {
+#ifdef RBTREE_KEY_BYTES
+  key_t key;
+  memset(key.bytes, 0xab, RBTREE_KEY_BYTES);
+  // big-endian at the front, so memcmp order is numeric order
+  for (int b = 0; b < 8; b++) {
+    key.bytes[b] = (unsigned char)(i >> (56 - 8 * b));
+  }
+  return key;
+#else
+  return (key_t)i;
+#endif
+}
+
+static bool key_equal(const key_t a, const key_t b) {
+  return RBTREE_KEY_COMPARE(a, b) == 0;
+}
+
+// returns the black height, or -1 if the subtree of P is not a valid rbtree
+static int check_node(const rbtree *t, const node_t *p, const key_t *lo, const key_t *hi) {
+  if (p == t->nil) {
+    return 0;
+  }
+  if ((lo != NULL && RBTREE_KEY_LESS(p->key, *lo)) ||
+      (hi != NULL && RBTREE_KEY_LESS(*hi, p->key))) {
+    return -1;
+  }
+  if (rbtree_color(p) == RBTREE_RED &&
+      (rbtree_color(rbtree_left(p)) == RBTREE_RED ||
+       rbtree_color(rbtree_right(p)) == RBTREE_RED)) {
+    return -1;
+  }
+  int l = check_node(t, rbtree_left(p), lo, &p->key);
+  int r = check_node(t, rbtree_right(p), &p->key, hi);
+  if (l < 0 || l != r) {
+    return -1;
+  }
+  return l + (rbtree_color(p) == RBTREE_BLACK ? 1 : 0);
+}
+
+// put should insert new keys and overwrite the value of existing ones
+void test_put_get(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  value_t *ref = calloc(n, sizeof(value_t));
+  bool *present = calloc(n, sizeof(bool));
+  size_t distinct = 0;
+
+  for (size_t i = 0; i < 4 * n; i++) {
+    const uint64_t k = (uint64_t)rand() % n;
+    const value_t v = (value_t)rand();
+    node_t *p = rbtree_put(t, make_key(k * 7919), v);
+    assert(p != NULL);
+    assert(key_equal(p->key, make_key(k * 7919)));
+    assert(p->value == v);
+    if (!present[k]) {
+      present[k] = true;
+      distinct++;
+    }
+    ref[k] = v;
+  }
+  assert(rbtree_size(t) == distinct);
+  assert(check_node(t, t->root, NULL, NULL) >= 0);
+
+  for (uint64_t k = 0; k < n; k++) {
+    value_t *v = rbtree_get(t, make_key(k * 7919));
+    if (present[k]) {
+      assert(v != NULL && *v == ref[k]);
+      // the returned slot is the value stored in the tree
+      *v = ref[k] + 1;
+      assert(*rbtree_get(t, make_key(k * 7919)) == ref[k] + 1);
+    } else {
+      assert(v == NULL);
+    }
+    assert(rbtree_get(t, make_key(k * 7919 + 1)) == NULL);
+  }
+
+  // erase half of the keys, the others keep their values
+  for (uint64_t k = 0; k < n; k += 2) {
+    node_t *p = rbtree_find(t, make_key(k * 7919));
+    if (present[k]) {
+      assert(p != NULL);
+      rbtree_erase(t, p);
+    } else {
+      assert(p == NULL);
+    }
+  }
+  assert(check_node(t, t->root, NULL, NULL) >= 0);
+  for (uint64_t k = 0; k < n; k++) {
+    value_t *v = rbtree_get(t, make_key(k * 7919));
+    if (present[k] && k % 2 == 1) {
+      assert(v != NULL && *v == ref[k] + 1);
+    } else {
+      assert(v == NULL);
+    }
+  }
+
+  free(present);
+  free(ref);
+  delete_rbtree(t);
+}
+
+// key-only operations should follow the key order of RBTREE_KEY_LESS
+void test_key_order(const size_t n) {
+  key_t *keys = calloc(n, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = make_key((uint64_t)i * 3);
+  }
+  // insert in reverse through the batch path, then the rest one by one
+  key_t *rev = calloc(n, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    rev[i] = keys[n - 1 - i];
+  }
+  rbtree *t = new_rbtree();
+  assert(rbtree_insert_batch(t, rev, n / 2) == 0);
+  for (size_t i = n / 2; i < n; i++) {
+    node_t *p = rbtree_insert(t, rev[i]);
+    assert(p != NULL && p->value == 0);
+  }
+  assert(check_node(t, t->root, NULL, NULL) >= 0);
+
+  key_t *res = calloc(n, sizeof(key_t));
+  rbtree_to_array(t, res, n);
+  for (size_t i = 0; i < n; i++) {
+    assert(key_equal(res[i], keys[i]));
+  }
+  assert(key_equal(rbtree_min(t)->key, keys[0]));
+  assert(key_equal(rbtree_max(t)->key, keys[n - 1]));
+
+  for (size_t i = 0; i + 1 < n; i++) {
+    node_t *lb = rbtree_lower_bound(t, make_key((uint64_t)i * 3 + 1));
+    assert(lb != NULL && key_equal(lb->key, keys[i + 1]));
+  }
+  assert(rbtree_count_range(t, keys[1], keys[n - 1]) == n - 2);
+
+  // split and join again around the middle key
+  rbtree *r = rbtree_split(t, keys[n / 2]);
+  assert(r != NULL);
+  assert(rbtree_size(t) == n / 2 && rbtree_size(r) == n - n / 2);
+  assert(key_equal(rbtree_min(r)->key, keys[n / 2]));
+  assert(rbtree_join(t, r) == 0);
+  assert(rbtree_size(t) == n);
+  assert(check_node(t, t->root, NULL, NULL) >= 0);
+
+  free(res);
+  free(rev);
+  free(keys);
+  delete_rbtree(t);
+  delete_rbtree(r);
+}
+
+// a frozen map should give the same values as the tree it was made from
+void test_frozen_get(const size_t n) {
+  rbtree *t = new_rbtree();
+  for (uint64_t k = 0; k < n; k++) {
+    rbtree_put(t, make_key(k * 3), (value_t)(k + 1));
+  }
+  rbtree_frozen *f = rbtree_freeze(t);
+  assert(f != NULL && rbtree_frozen_size(f) == n);
+  for (uint64_t k = 0; k < 3 * n; k++) {
+    const value_t *v = rbtree_frozen_get(f, make_key(k));
+    if (k % 3 == 0) {
+      assert(v != NULL && *v == (value_t)(k / 3 + 1));
+      assert(key_equal(*rbtree_frozen_find(f, make_key(k)), make_key(k)));
+    } else {
+      assert(v == NULL);
+      const key_t *lb = rbtree_frozen_lower_bound(f, make_key(k));
+      assert(k > 3 * (n - 1) ? lb == NULL : key_equal(*lb, make_key(k + 3 - k % 3)));
+    }
+  }
+  assert(key_equal(*rbtree_frozen_min(f), make_key(0)));
+  assert(key_equal(*rbtree_frozen_max(f), make_key(3 * (n - 1))));
+  delete_rbtree_frozen(f);
+  delete_rbtree(t);
+}
+
+int main(void) {
+  test_put_get(10, 1);
+  test_put_get(1000, 2);
+  test_put_get(10000, 3);
+  test_key_order(2);
+  test_key_order(1000);
+  test_frozen_get(1000);
+  printf("Passed all tests!\n");
+}
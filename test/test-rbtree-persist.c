@@ -0,0 +1,224 @@
+#include <assert.h>
+#include <pthread.h>
+#include <rbtree_persist.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// returns the black height, or -1 if P violates the search or color constraints
+static int check_pnode(const pnode_t *p, const key_t *lo, const key_t *hi) {
+  if (p == NULL) {
+    return 0;
+  }
+  if ((lo != NULL && p->key < *lo) || (hi != NULL && p->key > *hi)) {
+    return -1;
+  }
+  if (p->color == RBTREE_RED &&
+      ((p->left != NULL && p->left->color == RBTREE_RED) ||
+       (p->right != NULL && p->right->color == RBTREE_RED))) {
+    return -1;
+  }
+  int l = check_pnode(p->left, lo, &p->key);
+  int r = check_pnode(p->right, &p->key, hi);
+  if (l < 0 || l != r) {
+    return -1;
+  }
+  return l + (p->color == RBTREE_BLACK ? 1 : 0);
+}
+
+// snapshot S should be a valid rbtree holding exactly the sorted keys ARR[0..n)
+static void check_snapshot(const rbtree_snapshot *s, const key_t *arr, const size_t n) {
+  const pnode_t *root = s->version->root;
+  assert(root == NULL || root->color == RBTREE_BLACK);
+  assert(check_pnode(root, NULL, NULL) >= 0);
+  assert(rbtree_snapshot_size(s) == n);
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  rbtree_snapshot_to_array(s, res, n);
+  for (size_t i = 0; i < n; i++) {
+    assert(res[i] == arr[i]);
+  }
+  free(res);
+  key_t key;
+  if (n == 0) {
+    assert(rbtree_snapshot_min(s, &key) == -1);
+    assert(rbtree_snapshot_max(s, &key) == -1);
+  } else {
+    assert(rbtree_snapshot_min(s, &key) == 0 && key == arr[0]);
+    assert(rbtree_snapshot_max(s, &key) == 0 && key == arr[n - 1]);
+  }
+}
+
+#define KEPT_SNAPSHOTS 8
+
+// old snapshots should keep their contents while the tree keeps changing
+void test_persist_snapshots(const size_t ops, const unsigned int seed) {
+  srand(seed);
+  const key_t range = 500;
+  rbtree_persist *t = new_rbtree_persist();
+  assert(t != NULL);
+  key_t *ref = calloc(ops + 1, sizeof(key_t));
+  size_t n = 0;
+
+  rbtree_snapshot kept[KEPT_SNAPSHOTS];
+  key_t *kept_keys[KEPT_SNAPSHOTS];
+  size_t kept_n[KEPT_SNAPSHOTS];
+  for (int i = 0; i < KEPT_SNAPSHOTS; i++) {
+    kept[i] = rbtree_persist_snapshot(t);
+    kept_keys[i] = NULL;
+    kept_n[i] = 0;
+  }
+
+  for (size_t op = 0; op < ops; op++) {
+    key_t key = rand() % range;
+    if (rand() % 3 == 0) {
+      // erase one copy of KEY from the reference
+      size_t i = 0;
+      while (i < n && ref[i] != key) {
+        i++;
+      }
+      if (i == n) {
+        assert(rbtree_persist_erase(t, key) == -1);
+      } else {
+        assert(rbtree_persist_erase(t, key) == 0);
+        memmove(ref + i, ref + i + 1, (n - i - 1) * sizeof(key_t));
+        n--;
+      }
+    } else {
+      assert(rbtree_persist_insert(t, key) == 0);
+      size_t i = n;
+      while (i > 0 && ref[i - 1] > key) {
+        ref[i] = ref[i - 1];
+        i--;
+      }
+      ref[i] = key;
+      n++;
+    }
+
+    if (op % 97 == 0) {
+      rbtree_snapshot s = rbtree_persist_snapshot(t);
+      check_snapshot(&s, ref, n);
+      rbtree_snapshot_release(&s);
+
+      // replace one kept snapshot, then make sure all of them are intact
+      int slot = rand() % KEPT_SNAPSHOTS;
+      check_snapshot(&kept[slot], kept_keys[slot], kept_n[slot]);
+      rbtree_snapshot_release(&kept[slot]);
+      free(kept_keys[slot]);
+      kept[slot] = rbtree_persist_snapshot(t);
+      kept_keys[slot] = calloc(n + 1, sizeof(key_t));
+      memcpy(kept_keys[slot], ref, n * sizeof(key_t));
+      kept_n[slot] = n;
+    }
+  }
+
+  for (int i = 0; i < KEPT_SNAPSHOTS; i++) {
+    check_snapshot(&kept[i], kept_keys[i], kept_n[i]);
+    rbtree_snapshot_release(&kept[i]);
+    free(kept_keys[i]);
+  }
+  free(ref);
+  delete_rbtree_persist(t);
+}
+
+#define WINDOW 300
+#define READERS 3
+
+typedef struct {
+  rbtree_persist *t;
+  volatile bool stop;
+} persist_shared;
+
+// the writer keeps the keys as one consecutive window, so every snapshot must see one
+static void *window_reader(void *arg) {
+  persist_shared *shared = (persist_shared *)arg;
+  key_t *res = calloc(WINDOW + 1, sizeof(key_t));
+  size_t snapshots = 0;
+  while (!shared->stop || snapshots < 100) {
+    rbtree_snapshot s = rbtree_persist_snapshot(shared->t);
+    size_t n = rbtree_snapshot_size(&s);
+    assert(n <= WINDOW + 1);
+    // hold the snapshot for a while so the writer retires many versions meanwhile
+    for (int i = 0; i < 3; i++) {
+      sched_yield();
+    }
+    assert(check_pnode(s.version->root, NULL, NULL) >= 0);
+    rbtree_snapshot_to_array(&s, res, n);
+    for (size_t i = 1; i < n; i++) {
+      assert(res[i] == res[i - 1] + 1);
+    }
+    for (size_t i = 0; i < n; i++) {
+      assert(rbtree_snapshot_find(&s, res[i]));
+    }
+    rbtree_snapshot_release(&s);
+    snapshots++;
+  }
+  free(res);
+  return NULL;
+}
+
+// readers should see consistent versions while a writer updates the tree
+void test_persist_concurrent(const key_t writes) {
+  persist_shared shared = {new_rbtree_persist(), false};
+  assert(shared.t != NULL);
+  pthread_t readers[READERS];
+  for (int i = 0; i < READERS; i++) {
+    assert(pthread_create(&readers[i], NULL, window_reader, &shared) == 0);
+  }
+
+  for (key_t key = 0; key < writes; key++) {
+    assert(rbtree_persist_insert(shared.t, key) == 0);
+    if (key >= WINDOW) {
+      assert(rbtree_persist_erase(shared.t, key - WINDOW) == 0);
+    }
+  }
+  shared.stop = true;
+  for (int i = 0; i < READERS; i++) {
+    pthread_join(readers[i], NULL);
+  }
+
+  rbtree_snapshot s = rbtree_persist_snapshot(shared.t);
+  key_t expected[WINDOW];
+  for (key_t i = 0; i < WINDOW; i++) {
+    expected[i] = writes - WINDOW + i;
+  }
+  check_snapshot(&s, expected, WINDOW);
+  rbtree_snapshot_release(&s);
+  delete_rbtree_persist(shared.t);
+}
+
+// more snapshots than the tree's preallocated pin slots should still keep their versions
+void test_persist_many_pins(void) {
+  const size_t held = 100;
+  rbtree_persist *t = new_rbtree_persist();
+  assert(t != NULL);
+  rbtree_snapshot *s = calloc(held, sizeof(rbtree_snapshot));
+  key_t *keys = calloc(held, sizeof(key_t));
+  for (size_t round = 0; round < 3; round++) {
+    for (size_t i = 0; i < held; i++) {
+      s[i] = rbtree_persist_snapshot(t);
+      assert(s[i].version != NULL);
+      keys[i] = (key_t)i;
+      assert(rbtree_persist_insert(t, (key_t)i) == 0);
+    }
+    for (size_t i = 0; i < held; i++) {
+      check_snapshot(&s[i], keys, i);
+      rbtree_snapshot_release(&s[i]);
+    }
+    for (size_t i = 0; i < held; i++) {
+      assert(rbtree_persist_erase(t, (key_t)i) == 0);
+    }
+  }
+  free(keys);
+  free(s);
+  delete_rbtree_persist(t);
+}
+
+int main(void) {
+  test_persist_snapshots(20000, 1);
+  test_persist_snapshots(20000, 2);
+  test_persist_many_pins();
+  test_persist_concurrent(200000);
+  printf("Passed all tests!\n");
+}
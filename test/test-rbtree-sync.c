@@ -0,0 +1,100 @@
+#include <assert.h>
+#include <pthread.h>
+#include <rbtree_sync.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// single-threaded use should behave like a plain rbtree
+void test_sync_single(void) {
+  rbtree_sync *s = new_rbtree_sync();
+  assert(s != NULL);
+  key_t key;
+  assert(rbtree_sync_min(s, &key) == -1);
+  assert(rbtree_sync_max(s, &key) == -1);
+  assert(rbtree_sync_find(s, 3) == 0);
+
+  const key_t entries[] = {10, 5, -8, 34, -67, 23, -156, 24, 2, 12, -7, 0, 5};
+  const size_t n = sizeof(entries) / sizeof(entries[0]);
+  for (size_t i = 0; i < n; i++) {
+    assert(rbtree_sync_insert(s, entries[i]) == 0);
+  }
+  assert(rbtree_sync_size(s) == n);
+  for (size_t i = 0; i < n; i++) {
+    assert(rbtree_sync_find(s, entries[i]) == 1);
+  }
+  assert(rbtree_sync_min(s, &key) == 0 && key == -156);
+  assert(rbtree_sync_max(s, &key) == 0 && key == 34);
+
+  assert(rbtree_sync_erase(s, 5) == 0);
+  assert(rbtree_sync_find(s, 5) == 1);  // duplicate remains
+  assert(rbtree_sync_erase(s, 5) == 0);
+  assert(rbtree_sync_find(s, 5) == 0);
+  assert(rbtree_sync_erase(s, 5) == -1);
+  assert(rbtree_sync_erase(s, -156) == 0);
+  assert(rbtree_sync_min(s, &key) == 0 && key == -67);
+  assert(rbtree_sync_size(s) == n - 3);
+  delete_rbtree_sync(s);
+}
+
+#define STABLE_KEYS 2000
+#define READERS 4
+
+typedef struct {
+  rbtree_sync *s;
+  volatile bool stop;
+} sync_shared;
+
+// even keys are never erased, so readers must always see them
+static void *stable_reader(void *arg) {
+  sync_shared *shared = (sync_shared *)arg;
+  unsigned int seed = 7;
+  size_t reads = 0;
+  while (!shared->stop || reads < 10000) {
+    key_t key = (key_t)(rand_r(&seed) % STABLE_KEYS) * 2;
+    assert(rbtree_sync_find(shared->s, key) == 1);
+    key_t min, max;
+    assert(rbtree_sync_min(shared->s, &min) == 0 && min <= 0);
+    assert(rbtree_sync_max(shared->s, &max) == 0 && max >= (STABLE_KEYS - 1) * 2);
+    reads++;
+  }
+  return NULL;
+}
+
+// readers should never miss keys while a writer inserts and erases other keys
+void test_sync_concurrent(const size_t writes) {
+  sync_shared shared = {new_rbtree_sync(), false};
+  assert(shared.s != NULL);
+  for (key_t i = 0; i < STABLE_KEYS; i++) {
+    rbtree_sync_insert(shared.s, i * 2);
+  }
+
+  pthread_t readers[READERS];
+  for (int i = 0; i < READERS; i++) {
+    assert(pthread_create(&readers[i], NULL, stable_reader, &shared) == 0);
+  }
+
+  unsigned int seed = 3;
+  for (size_t i = 0; i < writes; i++) {
+    // odd keys, including ones below the minimum and above the maximum stable key
+    key_t key = (key_t)(rand_r(&seed) % (STABLE_KEYS + 200)) * 2 - 199;
+    if (rbtree_sync_erase(shared.s, key) != 0) {
+      assert(rbtree_sync_insert(shared.s, key) == 0);
+    }
+  }
+  shared.stop = true;
+  for (int i = 0; i < READERS; i++) {
+    pthread_join(readers[i], NULL);
+  }
+
+  for (key_t i = 0; i < STABLE_KEYS; i++) {
+    assert(rbtree_sync_find(shared.s, i * 2) == 1);
+  }
+  delete_rbtree_sync(shared.s);
+}
+
+int main(void) {
+  test_sync_single();
+  test_sync_concurrent(200000);
+  printf("Passed all tests!\n");
+}
@@ -3,6 +3,11 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef RBTREE_INDEX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 // new_rbtree should return rbtree struct with null root node
 void test_init(void) {
@@ -26,13 +31,13 @@ void test_insert_single(const key_t key) {
   assert(p->key == key);
   // assert(p->color == RBTREE_BLACK);  // color of root node should be black
 #ifdef SENTINEL
-  assert(p->left == t->nil);
-  assert(p->right == t->nil);
-  assert(p->parent == t->nil);
+  assert(rbtree_left(p) == t->nil);
+  assert(rbtree_right(p) == t->nil);
+  assert(rbtree_parent(p) == t->nil);
 #else
-  assert(p->left == NULL);
-  assert(p->right == NULL);
-  assert(p->parent == NULL);
+  assert(rbtree_left(p) == NULL);
+  assert(rbtree_right(p) == NULL);
+  assert(rbtree_parent(p) == NULL);
 #endif
   delete_rbtree(t);
 }
@@ -141,6 +146,78 @@ void test_to_array(rbtree *t, const key_t *arr, const size_t n) {
   free(res);
 }
 
+// to_array should copy at most n keys in order
+void test_to_array_bounded(void) {
+  rbtree *t = new_rbtree();
+  key_t entries[] = {7, -3, 12, 0, 7, 45, -20, 3};
+  const size_t n = sizeof(entries) / sizeof(entries[0]);
+  insert_arr(t, entries, n);
+  qsort((void *)entries, n, sizeof(key_t), comp);
+
+  const size_t half = n / 2;
+  key_t res[sizeof(entries) / sizeof(entries[0]) + 1];
+  res[half] = 9999;
+  rbtree_to_array(t, res, half);
+  for (int i = 0; i < half; i++) {
+    assert(res[i] == entries[i]);
+  }
+  assert(res[half] == 9999);
+
+  delete_rbtree(t);
+}
+
+// size should follow inserts and erases
+void test_size(void) {
+  rbtree *t = new_rbtree();
+  assert(rbtree_size(t) == 0);
+
+  key_t entries[] = {5, 1, 5, 9, -2, 5};
+  const size_t n = sizeof(entries) / sizeof(entries[0]);
+  insert_arr(t, entries, n);
+  assert(rbtree_size(t) == n);
+
+  rbtree_erase(t, rbtree_find(t, 5));
+  assert(rbtree_size(t) == n - 1);
+  rbtree_erase(t, rbtree_min(t));
+  rbtree_erase(t, rbtree_max(t));
+  assert(rbtree_size(t) == n - 3);
+
+  delete_rbtree(t);
+}
+
+// cursor should visit nodes in key order in both directions
+void test_cursor(void) {
+  rbtree *t = new_rbtree();
+  rbtree_cursor c = rbtree_cursor_first(t);
+  assert(c.node == NULL);
+
+  key_t entries[] = {15, -4, 8, 8, 23, 0, 42, -17, 8, 5};
+  const size_t n = sizeof(entries) / sizeof(entries[0]);
+  insert_arr(t, entries, n);
+  qsort((void *)entries, n, sizeof(key_t), comp);
+
+  size_t i = 0;
+  for (c = rbtree_cursor_first(t); c.node != NULL; rbtree_cursor_next(&c)) {
+    assert(c.node->key == entries[i++]);
+  }
+  assert(i == n);
+
+  for (c = rbtree_cursor_last(t); c.node != NULL; rbtree_cursor_prev(&c)) {
+    assert(c.node->key == entries[--i]);
+  }
+  assert(i == 0);
+
+  // resume from a node returned by find
+  node_t *p = rbtree_find(t, 23);
+  assert(p != NULL);
+  c = rbtree_cursor_at(t, p);
+  assert(rbtree_cursor_next(&c)->key == 42);
+  assert(rbtree_cursor_next(&c) == NULL);
+  assert(rbtree_prev(t, rbtree_min(t)) == NULL);
+
+  delete_rbtree(t);
+}
+
 void test_multi_instance() {
   rbtree *t1 = new_rbtree();
   assert(t1 != NULL);
@@ -191,11 +268,11 @@ static bool search_traverse(const node_t *p, key_t *min, key_t *max,
   key_t l_min, l_max, r_min, r_max;
   l_min = l_max = r_min = r_max = p->key;
 
-  const bool lr = search_traverse(p->left, &l_min, &l_max, nil);
+  const bool lr = search_traverse(rbtree_left(p), &l_min, &l_max, nil);
   if (!lr || l_max > p->key) {
     return false;
   }
-  const bool rr = search_traverse(p->right, &r_min, &r_max, nil);
+  const bool rr = search_traverse(rbtree_right(p), &r_min, &r_max, nil);
   if (!rr || r_min < p->key) {
     return false;
   }
@@ -243,12 +320,12 @@ static bool color_traverse(const node_t *p, const color_t parent_color,
     }
     return true;
   }
-  if (parent_color == RBTREE_RED && p->color == RBTREE_RED) {
+  if (parent_color == RBTREE_RED && rbtree_color(p) == RBTREE_RED) {
     return false;
   }
-  int next_depth = ((p->color == RBTREE_BLACK) ? 1 : 0) + black_depth;
-  return color_traverse(p->left, p->color, next_depth, nil) &&
-         color_traverse(p->right, p->color, next_depth, nil);
+  int next_depth = ((rbtree_color(p) == RBTREE_BLACK) ? 1 : 0) + black_depth;
+  return color_traverse(rbtree_left(p), rbtree_color(p), next_depth, nil) &&
+         color_traverse(rbtree_right(p), rbtree_color(p), next_depth, nil);
 }
 
 void test_color_constraint(const rbtree *t) {
@@ -259,7 +336,7 @@ void test_color_constraint(const rbtree *t) {
   node_t *nil = NULL;
 #endif
   node_t *p = t->root;
-  assert(p == nil || p->color == RBTREE_BLACK);
+  assert(p == nil || rbtree_color(p) == RBTREE_BLACK);
 
   init_color_traverse();
   assert(color_traverse(p, RBTREE_BLACK, 0, nil));
@@ -275,7 +352,69 @@ void test_rb_constraints(const key_t arr[], const size_t n) {
 
   test_color_constraint(t);
   test_search_constraint(t);
+  assert(rbtree_validate(t) == RBTREE_VALID);
+
+  delete_rbtree(t);
+}
+
+// rbtree_validate should find each kind of broken invariant
+void test_validate(void) {
+  rbtree *t = new_rbtree();
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  for (key_t i = 0; i < 100; i++) {
+    rbtree_insert(t, i);
+  }
+  assert(rbtree_validate(t) == RBTREE_VALID);
+
+  // root must be black
+  node_t *root = t->root;
+  rbtree_set_color(root, RBTREE_RED);
+  assert(rbtree_validate(t) == RBTREE_BAD_ROOT);
+  rbtree_set_color(root, RBTREE_BLACK);
+
+  // a red child of a red node
+  node_t *p = rbtree_min(t);
+  while (rbtree_color(p) == RBTREE_BLACK || rbtree_parent(p) == root) {
+    p = rbtree_next(t, p);
+  }
+  node_t *parent = rbtree_parent(p);
+  rbtree_set_color(parent, RBTREE_RED);
+  assert(rbtree_validate(t) == RBTREE_RED_RED);
+  rbtree_set_color(parent, RBTREE_BLACK);
+  assert(rbtree_validate(t) == RBTREE_VALID);
+
+  // a black leaf turned red changes the black height of its paths
+  p = rbtree_min(t);
+  const color_t saved = rbtree_color(p);
+  rbtree_set_color(p, saved == RBTREE_BLACK ? RBTREE_RED : RBTREE_BLACK);
+  assert(rbtree_validate(t) == RBTREE_BAD_BLACK_HEIGHT);
+  rbtree_set_color(p, saved);
+
+  // keys out of order
+  p = rbtree_max(t);
+  p->key = -1;
+  assert(rbtree_validate(t) == RBTREE_BAD_ORDER);
+  p->key = 99;
+
+  // a child whose parent link points elsewhere
+  node_t *left = rbtree_left(root);
+  rbtree_set_parent(left, rbtree_right(root));
+  assert(rbtree_validate(t) == RBTREE_BAD_PARENT);
+  rbtree_set_parent(left, root);
 
+  // the stored size must match the nodes
+  const size_t count = t->count;
+  t->count = count + 1;
+  assert(rbtree_validate(t) == RBTREE_BAD_SIZE);
+  t->count = count;
+
+  // the cached max node must be the last node
+  node_t *max = rbtree_max(t);
+  t->max = rbtree_min(t);
+  assert(rbtree_validate(t) == RBTREE_BAD_CACHE);
+  t->max = max;
+
+  assert(rbtree_validate(t) == RBTREE_VALID);
   delete_rbtree(t);
 }
 
@@ -293,6 +432,107 @@ void test_duplicate_values() {
   test_rb_constraints(entries, n);
 }
 
+// bounds should find the leftmost duplicate and the neighbours of missing keys
+void test_bounds(const key_t *arr, const size_t n) {
+  rbtree *t = new_rbtree();
+  insert_arr(t, arr, n);
+
+  key_t *sorted = calloc(n, sizeof(key_t));
+  memcpy(sorted, arr, n * sizeof(key_t));
+  qsort((void *)sorted, n, sizeof(key_t), comp);
+
+  for (key_t key = sorted[0] - 2; key <= sorted[n - 1] + 2; key++) {
+    size_t lo = 0, hi = 0;
+    while (lo < n && sorted[lo] < key) lo++;
+    hi = lo;
+    while (hi < n && sorted[hi] == key) hi++;
+
+    node_t *lb = rbtree_lower_bound(t, key);
+    node_t *ub = rbtree_upper_bound(t, key);
+    assert(lo == n ? lb == NULL : (lb != NULL && lb->key == sorted[lo]));
+    assert(hi == n ? ub == NULL : (ub != NULL && ub->key == sorted[hi]));
+    if (lo < n) {
+      // lower_bound must be the first of its duplicates
+      node_t *prev = rbtree_prev(t, lb);
+      assert(prev == NULL || prev->key < key);
+    }
+
+    rbtree_range range = rbtree_equal_range(t, key);
+    size_t count = 0;
+    for (node_t *p = range.first; p != range.last; p = rbtree_next(t, p)) {
+      assert(p->key == key);
+      count++;
+    }
+    assert(count == hi - lo);
+    assert(rbtree_count_range(t, key, key + 1) == hi - lo);
+    assert(rbtree_count_range(t, sorted[0], key) == lo);
+  }
+
+  free(sorted);
+  delete_rbtree(t);
+}
+
+void test_bounds_duplicates() {
+  const key_t entries[] = {3, 3, 3, 7, 3, -1, 7, 7, 3, 10, 3, 3, -1, 7, 10, 3, 3, 3, 0, 3};
+  const size_t n = sizeof(entries) / sizeof(entries[0]);
+  test_bounds(entries, n);
+
+  key_t *many = calloc(2000, sizeof(key_t));
+  srand(7);
+  for (int i = 0; i < 2000; i++) {
+    many[i] = rand() % 16;
+  }
+  test_bounds(many, 2000);
+  test_rb_constraints(many, 2000);
+  free(many);
+}
+
+#ifdef RBTREE_ORDER_STATS
+static size_t size_traverse(const node_t *p, node_t *nil) {
+  if (p == nil) {
+    return 0;
+  }
+  size_t size = size_traverse(rbtree_left(p), nil) + size_traverse(rbtree_right(p), nil) + 1;
+  assert(p->size == size);
+  return size;
+}
+
+// select/rank should agree with the sorted keys after inserts and erases
+void test_order_stats(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % (n / 4 + 1);
+    rbtree_insert(t, arr[i]);
+  }
+  // erase every other key
+  size_t m = 0;
+  for (int i = 0; i < n; i++) {
+    if (i % 2 == 0) {
+      rbtree_erase(t, rbtree_find(t, arr[i]));
+    } else {
+      arr[m++] = arr[i];
+    }
+  }
+  qsort((void *)arr, m, sizeof(key_t), comp);
+  assert(size_traverse(t->root, t->nil) == m);
+
+  for (size_t i = 0; i < m; i++) {
+    node_t *p = rbtree_select(t, i);
+    assert(p != NULL && p->key == arr[i]);
+    assert(rbtree_rank(t, arr[i]) <= i);
+    assert(i == 0 || arr[i - 1] == arr[i] || rbtree_rank(t, arr[i]) == i);
+  }
+  assert(rbtree_select(t, m) == NULL);
+  assert(rbtree_rank(t, arr[m - 1] + 1) == m);
+  assert(rbtree_count_range(t, arr[0], arr[m - 1] + 1) == m);
+
+  free(arr);
+  delete_rbtree(t);
+}
+#endif
+
 void test_minmax_suite() {
   key_t entries[] = {10, 5, -8, 34, 67, 0, -23, 156, 24, 2, -12, 26, 35};
   const size_t n = sizeof(entries) / sizeof(entries[0]);
@@ -310,6 +550,245 @@ void test_to_array_suite() {
   delete_rbtree(t);
 }
 
+// from_sorted should build a valid tree holding exactly the given keys
+void test_from_sorted(void) {
+  const size_t max_n = 300;
+  key_t *arr = calloc(max_n, sizeof(key_t));
+  key_t *res = calloc(max_n, sizeof(key_t));
+  for (size_t n = 0; n <= max_n; n++) {
+    for (size_t i = 0; i < n; i++) {
+      arr[i] = (key_t)(i / 3) - 20;  // with duplicates
+    }
+    rbtree *t = rbtree_from_sorted(arr, n);
+    assert(t != NULL);
+    assert(rbtree_size(t) == n);
+    test_color_constraint(t);
+    test_search_constraint(t);
+    rbtree_to_array(t, res, n);
+    for (size_t i = 0; i < n; i++) {
+      assert(res[i] == arr[i]);
+    }
+
+    // the tree should stay usable for normal updates
+    rbtree_insert(t, 7);
+    rbtree_insert(t, -100);
+    if (n > 0) {
+      rbtree_erase(t, rbtree_find(t, arr[n / 2]));
+    }
+    test_color_constraint(t);
+    test_search_constraint(t);
+    delete_rbtree(t);
+  }
+  free(res);
+  free(arr);
+}
+
+// insert_batch should give the same result as inserting keys one by one, with the batch sorted or not
+void test_insert_batch(const size_t tree_n, const size_t batch_n, const int sorted, const unsigned int seed) {
+  srand(seed);
+  const size_t n = tree_n + batch_n;
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % (n + 1) - (key_t)(n / 2);
+  }
+  if (sorted) {
+    qsort((void *)(arr + tree_n), batch_n, sizeof(key_t), comp);
+  }
+
+  rbtree *t = new_rbtree();
+  insert_arr(t, arr, tree_n);
+  node_t *kept = tree_n > 0 ? rbtree_min(t) : NULL;
+  const key_t kept_key = kept != NULL ? kept->key : 0;
+  assert(rbtree_insert_batch(t, arr + tree_n, batch_n) == 0);
+  assert(rbtree_size(t) == n);
+  test_color_constraint(t);
+  test_search_constraint(t);
+#ifdef RBTREE_ORDER_STATS
+  assert(size_traverse(t->root, t->nil) == n);
+#endif
+  // existing nodes stay valid
+  assert(kept == NULL || kept->key == kept_key);
+
+  qsort((void *)arr, n, sizeof(key_t), comp);
+  key_t *res = calloc(n, sizeof(key_t));
+  rbtree_to_array(t, res, n);
+  for (size_t i = 0; i < n; i++) {
+    assert(res[i] == arr[i]);
+  }
+
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+void test_insert_batch_suite() {
+  test_insert_batch(0, 1000, 0, 11);     // empty tree, rebuild
+  test_insert_batch(1000, 1000, 0, 12);  // rebuild by merge
+  test_insert_batch(10000, 1000, 0, 13); // finger inserts
+  test_insert_batch(10000, 50, 0, 13);   // small batch, inserted one by one without sorting
+  test_insert_batch(5000, 1, 0, 14);
+  test_insert_batch(1000, 1000, 1, 15);  // sorted batches are used without a copy
+  test_insert_batch(10000, 1000, 1, 16);
+}
+
+// T should be a valid rbtree holding exactly the sorted keys ARR[0..n)
+static void check_tree_keys(const rbtree *t, const key_t *arr, const size_t n) {
+  // split, join and the set ops refill the min/max cache before returning
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  assert(rbtree_min(t) == t->nil || rbtree_min(t)->key == arr[0]);
+  assert(rbtree_max(t) == t->nil || rbtree_max(t)->key == arr[n - 1]);
+  assert(rbtree_size(t) == n);
+  test_color_constraint(t);
+  test_search_constraint(t);
+#ifdef RBTREE_ORDER_STATS
+  assert(size_traverse(t->root, t->nil) == n);
+#endif
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  rbtree_to_array(t, res, n);
+  for (size_t i = 0; i < n; i++) {
+    assert(res[i] == arr[i]);
+  }
+  free(res);
+}
+
+static bool sorted_contains(const key_t *arr, const size_t n, const key_t key) {
+  return bsearch(&key, arr, n, sizeof(key_t), comp) != NULL;
+}
+
+// join and split should move nodes between trees without losing any
+void test_join_split(const size_t n, const unsigned int seed) {
+  srand(seed);
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % (n / 2 + 1);
+  }
+  rbtree *t = new_rbtree();
+  insert_arr(t, arr, n);
+  qsort((void *)arr, n, sizeof(key_t), comp);
+
+  for (int round = 0; round < 20; round++) {
+    const key_t key = rand() % (n / 2 + 3) - 1;
+    size_t m = 0;
+    while (m < n && arr[m] < key) {
+      m++;
+    }
+    rbtree *right = rbtree_split(t, key);
+    assert(right != NULL);
+    check_tree_keys(t, arr, m);
+    check_tree_keys(right, arr + m, n - m);
+
+    // joining in the wrong order should be refused
+    if (m > 0 && m < n && arr[m - 1] != arr[m]) {
+      assert(rbtree_join(right, t) == -1);
+    }
+    assert(rbtree_join(t, right) == 0);
+    check_tree_keys(t, arr, n);
+    check_tree_keys(right, arr, 0);
+    // right shared t's pool, and is moved to a new one once emptied
+    assert(right->pool != t->pool);
+    delete_rbtree(right);
+  }
+
+  // split trees share nodes but should be usable and deletable independently
+  rbtree *right = rbtree_split(t, arr[n / 2]);
+  rbtree_insert(right, arr[n - 1]);
+  if (rbtree_size(t) > 0) {
+    rbtree_erase(t, rbtree_min(t));
+  }
+  delete_rbtree(t);
+  rbtree_erase(right, rbtree_max(right));
+  check_tree_keys(right, arr + n / 2, n - n / 2);
+  delete_rbtree(right);
+  free(arr);
+}
+
+// union, intersection and difference should agree with sorted arrays
+void test_set_operations(const size_t n1, const size_t n2, const unsigned int seed) {
+  srand(seed);
+  const size_t range = (n1 + n2) / 2 + 1;
+  key_t *a = calloc(n1 + 1, sizeof(key_t));
+  key_t *b = calloc(n2 + 1, sizeof(key_t));
+  key_t *expected = calloc(n1 + n2 + 1, sizeof(key_t));
+  for (size_t i = 0; i < n1; i++) {
+    a[i] = rand() % range;
+  }
+  for (size_t i = 0; i < n2; i++) {
+    b[i] = rand() % range;
+  }
+
+  for (int op = 0; op < 3; op++) {
+    rbtree *t1 = new_rbtree();
+    rbtree *t2 = new_rbtree();
+    insert_arr(t1, a, n1);
+    insert_arr(t2, b, n2);
+    qsort((void *)a, n1, sizeof(key_t), comp);
+    qsort((void *)b, n2, sizeof(key_t), comp);
+
+    size_t m = 0;
+    if (op == 0) {
+      rbtree_union(t1, t2);
+      for (size_t i = 0; i < n1; i++) {
+        expected[m++] = a[i];
+      }
+      for (size_t i = 0; i < n2; i++) {
+        if (!sorted_contains(a, n1, b[i])) {
+          expected[m++] = b[i];
+        }
+      }
+      qsort((void *)expected, m, sizeof(key_t), comp);
+    } else if (op == 1) {
+      rbtree_intersection(t1, t2);
+      for (size_t i = 0; i < n1; i++) {
+        if (sorted_contains(b, n2, a[i])) {
+          expected[m++] = a[i];
+        }
+      }
+    } else {
+      rbtree_difference(t1, t2);
+      for (size_t i = 0; i < n1; i++) {
+        if (!sorted_contains(b, n2, a[i])) {
+          expected[m++] = a[i];
+        }
+      }
+    }
+    check_tree_keys(t1, expected, m);
+    check_tree_keys(t2, expected, 0);
+    // the emptied tree keeps a pool of its own
+    assert(t2->pool != t1->pool);
+
+    // both trees should stay usable after the pools are merged
+    rbtree_insert(t2, 1);
+    rbtree_insert(t1, -1);
+    if (m > 0) {
+      rbtree_erase(t1, rbtree_max(t1));
+    }
+    test_color_constraint(t1);
+    test_search_constraint(t1);
+    delete_rbtree(t2);
+    delete_rbtree(t1);
+  }
+
+  free(expected);
+  free(b);
+  free(a);
+}
+
+void test_set_operations_suite() {
+#ifdef RBTREE_PARALLEL
+  // more workers than cores, so that tasks are actually stolen
+  rbtree_set_parallelism(4);
+  test_set_operations(200000, 200000, 36);
+  test_set_operations(200000, 3000, 37);
+#endif
+  test_join_split(1, 21);
+  test_join_split(1000, 22);
+  test_set_operations(0, 100, 31);
+  test_set_operations(100, 0, 32);
+  test_set_operations(1000, 1000, 33);
+  test_set_operations(10000, 30, 34);
+  test_set_operations(30, 10000, 35);
+}
+
 void test_find_erase(rbtree *t, const key_t *arr, const size_t n) {
   for (int i = 0; i < n; i++) {
     node_t *p = rbtree_insert(t, arr[i]);
@@ -339,6 +818,7 @@ void test_find_erase(rbtree *t, const key_t *arr, const size_t n) {
     q = rbtree_find(t, arr[i]);
     assert(q == NULL);
   }
+  assert(rbtree_validate(t) == RBTREE_VALID);
 }
 
 void test_find_erase_fixed() {
@@ -366,6 +846,403 @@ void test_find_erase_rand(const size_t n, const unsigned int seed) {
   delete_rbtree(t);
 }
 
+static int comp_ptr(const void *p1, const void *p2) {
+  const uintptr_t a = (uintptr_t) * (node_t *const *)p1;
+  const uintptr_t b = (uintptr_t) * (node_t *const *)p2;
+  return (a > b) - (a < b);
+}
+
+// hinted inserts of nearly sorted keys should build the same sorted tree
+void test_insert_hint(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  node_t *hint = NULL;
+  for (size_t i = 0; i < n; i++) {
+    // mostly increasing, sometimes a little behind, sometimes far away
+    const int r = rand() % 10;
+    arr[i] = r < 7 ? (key_t)(i * 4) : r < 9 ? (key_t)(i * 4) - rand() % 64 : rand() % (int)(n * 4 + 1);
+    node_t *p = rbtree_insert_hint(t, hint, arr[i]);
+    assert(p != NULL && p->key == arr[i]);
+    assert(rbtree_max(t)->key >= arr[i]);
+    hint = rand() % 8 == 0 ? rbtree_min(t) : p;
+  }
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  qsort(arr, n, sizeof(key_t), comp);
+  key_t *res = calloc(n, sizeof(key_t));
+  rbtree_to_array(t, res, n);
+  assert(memcmp(res, arr, n * sizeof(key_t)) == 0);
+  free(res);
+
+  // appending keys at or above the max
+  const key_t top = rbtree_max(t)->key;
+  for (size_t i = 0; i < 100; i++) {
+    node_t *p = rbtree_insert(t, top + (key_t)(i / 2));
+    assert(rbtree_max(t) == p);
+  }
+  assert(rbtree_validate(t) == RBTREE_VALID);
+
+  // erasing the max moves the cache to its predecessor
+  for (size_t i = 0; i < 100; i++) {
+    rbtree_erase(t, rbtree_max(t));
+    assert(rbtree_validate(t) == RBTREE_VALID);
+  }
+  assert(rbtree_max(t)->key == top);
+  free(arr);
+  delete_rbtree(t);
+}
+
+// popping from both ends should return the keys in order
+void test_pop(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % (key_t)(n + 1);
+    rbtree_insert(t, arr[i]);
+  }
+  qsort(arr, n, sizeof(key_t), comp);
+
+  size_t lo = 0, hi = n;
+  while (lo < hi) {
+    key_t key;
+    if (rand() % 3 == 0) {
+      assert(rbtree_pop_max(t, &key) == 0);
+      assert(key == arr[--hi]);
+    } else {
+      assert(rbtree_pop_min(t, &key) == 0);
+      assert(key == arr[lo++]);
+    }
+    assert(rbtree_size(t) == hi - lo);
+    if (lo < hi) {
+      assert(rbtree_min(t)->key == arr[lo]);
+      assert(rbtree_max(t)->key == arr[hi - 1]);
+    }
+    if ((hi - lo) % 97 == 0) {
+      assert(rbtree_validate(t) == RBTREE_VALID);
+    }
+  }
+  assert(rbtree_pop_min(t, NULL) == -1);
+  assert(rbtree_pop_max(t, NULL) == -1);
+  assert(rbtree_min(t) == t->nil && rbtree_max(t) == t->nil);
+
+  // the emptied tree keeps working as a priority queue
+  for (key_t i = 0; i < 100; i++) {
+    rbtree_insert(t, 99 - i);
+  }
+  for (key_t i = 0; i < 100; i++) {
+    key_t key;
+    assert(rbtree_pop_min(t, &key) == 0 && key == i);
+    rbtree_insert(t, i + 100);
+  }
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  free(arr);
+  delete_rbtree(t);
+}
+
+// rbtree_erase_key should erase one node per call and report missing keys
+void test_erase_key(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % (key_t)(n / 2 + 1);
+    rbtree_insert(t, arr[i]);
+  }
+  for (size_t i = 0; i < n; i++) {
+    assert(rbtree_erase_key(t, arr[i]) == 0);
+    assert(rbtree_size(t) == n - i - 1);
+  }
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  assert(rbtree_erase_key(t, 0) == -1);
+  assert(t->root == t->nil);
+  free(arr);
+  delete_rbtree(t);
+}
+
+// clear should empty the tree and reuse its nodes for the next fill
+void test_clear(const size_t n) {
+  rbtree *t = new_rbtree();
+  rbtree_clear(t);
+  assert(t->root == t->nil && rbtree_size(t) == 0);
+
+  node_t **old = calloc(n, sizeof(node_t *));
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = (key_t)(n - i);
+    old[i] = rbtree_insert(t, arr[i]);
+  }
+  qsort(old, n, sizeof(node_t *), comp_ptr);
+
+  for (int round = 0; round < 3; round++) {
+    rbtree_clear(t);
+    assert(t->root == t->nil);
+    assert(rbtree_size(t) == 0);
+    assert(rbtree_find(t, arr[0]) == NULL);
+
+    // refilling with as many keys allocates nothing new (N fills whole chunks)
+    for (size_t i = 0; i < n; i++) {
+      node_t *p = rbtree_insert(t, arr[i]);
+      assert(bsearch(&p, old, n, sizeof(node_t *), comp_ptr) != NULL);
+    }
+    test_search_constraint(t);
+    test_color_constraint(t);
+    assert(rbtree_size(t) == n);
+  }
+
+  // with a shared pool, clearing one tree leaves the other intact
+  const key_t mid = (key_t)(n / 2 + 1);
+  rbtree *right = rbtree_split(t, mid);
+  rbtree_clear(t);
+  assert(rbtree_size(t) == 0);
+  assert(rbtree_size(right) == n + 1 - (size_t)mid);
+  for (key_t k = 0; k < mid; k++) {
+    assert(rbtree_insert(t, k) != NULL);
+  }
+  test_search_constraint(t);
+  test_search_constraint(right);
+  assert(rbtree_size(t) == (size_t)mid);
+  assert(rbtree_min(right)->key == mid);
+
+  free(arr);
+  free(old);
+  delete_rbtree(t);
+  delete_rbtree(right);
+}
+
+#ifdef RBTREE_INDEX
+// a large block freed by a deleted tree should go back to the OS and serve later small trees
+void test_arena_reuse(void) {
+  const size_t n = (size_t)1 << 20;
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = (key_t)i;
+  }
+  rbtree *big = rbtree_from_sorted(arr, n);
+  assert(big != NULL);
+  uintptr_t lo = UINTPTR_MAX, hi = 0;
+  for (node_t *p = rbtree_min(big); p != NULL && p != big->nil; p = rbtree_next(big, p)) {
+    lo = (uintptr_t)p < lo ? (uintptr_t)p : lo;
+    hi = (uintptr_t)(p + 1) > hi ? (uintptr_t)(p + 1) : hi;
+  }
+  delete_rbtree(big);
+
+  const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  lo = (lo + page - 1) / page * page;
+  hi = hi / page * page;
+  unsigned char *resident = calloc((hi - lo) / page, 1);
+  assert(mincore((void *)lo, hi - lo, resident) == 0);
+  for (size_t i = 0; i < (hi - lo) / page; i++) {
+    assert(!(resident[i] & 1));
+  }
+
+  rbtree *small[64];
+  for (int i = 0; i < 64; i++) {
+    small[i] = new_rbtree();
+    for (key_t k = 0; k < 100; k++) {
+      node_t *p = rbtree_insert(small[i], k);
+      assert(p != NULL && (uintptr_t)p < hi);
+    }
+  }
+  for (int i = 0; i < 64; i++) {
+    delete_rbtree(small[i]);
+  }
+  free(resident);
+  free(arr);
+}
+#endif
+
+typedef struct {
+  key_t *keys;
+  size_t n;
+  size_t calls;
+  size_t stop_after;
+} export_sink;
+
+static int collect_keys(const key_t *keys, const size_t n, void *ctx) {
+  export_sink *sink = (export_sink *)ctx;
+  memcpy(sink->keys + sink->n, keys, n * sizeof(key_t));
+  sink->n += n;
+  sink->calls++;
+  return sink->calls == sink->stop_after ? 7 : 0;
+}
+
+// exporting in batches of any size should give the same keys as rbtree_to_array
+void test_export(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % (key_t)(n / 4 + 1);  // long runs of duplicates
+    rbtree_insert(t, arr[i]);
+  }
+  qsort(arr, n, sizeof(key_t), comp);
+
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  const size_t batches[] = {1, 2, 3, 7, 64, n + 1};
+  for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+    rbtree_export_token token = {0};
+    size_t total = 0, got;
+    while ((got = rbtree_export(t, &token, res + total, batches[b])) > 0) {
+      assert(got <= batches[b]);
+      total += got;
+    }
+    assert(total == n);
+    for (size_t i = 0; i < n; i++) {
+      assert(res[i] == arr[i]);
+    }
+    // a finished token stays finished
+    assert(rbtree_export(t, &token, res, batches[b]) == 0);
+  }
+
+  // visitor version, also stopping early
+  key_t buf[5];
+  export_sink sink = {res, 0, 0, 0};
+  assert(rbtree_export_each(t, buf, 5, collect_keys, &sink) == 0);
+  assert(sink.n == n && sink.calls == (n + 4) / 5);
+  for (size_t i = 0; i < n; i++) {
+    assert(res[i] == arr[i]);
+  }
+  if (n > 10) {
+    export_sink early = {res, 0, 0, 2};
+    assert(rbtree_export_each(t, buf, 5, collect_keys, &early) == 7);
+    assert(early.n == 10);
+  }
+
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+// changes between export calls should only affect keys after the resume point
+void test_export_resume(void) {
+  rbtree *t = new_rbtree();
+  for (key_t k = 0; k < 100; k++) {
+    rbtree_insert(t, k);
+    rbtree_insert(t, k);
+  }
+  rbtree_export_token token = {0};
+  key_t buf[200];
+  assert(rbtree_export(t, &token, buf, 41) == 41);  // ends inside the pair of 20
+  assert(buf[40] == 20);
+
+  // erase exported keys and one copy of 20, insert before and after the resume point
+  for (key_t k = 0; k < 10; k++) {
+    rbtree_erase(t, rbtree_find(t, k));
+  }
+  rbtree_erase(t, rbtree_find(t, 20));
+  rbtree_insert(t, 5);
+  rbtree_insert(t, 150);
+
+  size_t total = 0, got;
+  while ((got = rbtree_export(t, &token, buf + total, 16)) > 0) {
+    total += got;
+  }
+  // 20 has no copy left beyond the exported one, so the export resumes at 21
+  assert(total == 2 * (100 - 21) + 1);
+  assert(buf[0] == 21 && buf[total - 1] == 150);
+  for (size_t i = 1; i < total; i++) {
+    assert(buf[i - 1] <= buf[i]);
+  }
+  delete_rbtree(t);
+}
+
+// find_many should give the same node as rbtree_find for every key, in any batch size
+void test_find_many(const size_t n, const size_t queries, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, rand() % (key_t)(2 * n + 1));
+  }
+  key_t *keys = calloc(queries + 1, sizeof(key_t));
+  node_t **out = calloc(queries + 1, sizeof(node_t *));
+  for (size_t i = 0; i < queries; i++) {
+    keys[i] = rand() % (key_t)(2 * n + 1);
+  }
+
+  const size_t batches[] = {0, 1, 3, 16, 17, queries};
+  for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+    const size_t m = batches[b] < queries ? batches[b] : queries;
+    memset(out, 0xff, (queries + 1) * sizeof(node_t *));
+    rbtree_find_many(t, keys, m, out);
+    for (size_t i = 0; i < m; i++) {
+      assert(out[i] == rbtree_find(t, keys[i]));
+    }
+    // entries past M are left alone
+    assert(out[m] == (node_t *)(~(uintptr_t)0));
+  }
+
+  free(out);
+  free(keys);
+  delete_rbtree(t);
+}
+
+#ifdef RBTREE_STATS
+static size_t height_traverse(const node_t *p, const node_t *nil) {
+  if (p == nil) {
+    return 0;
+  }
+  size_t l = height_traverse(rbtree_left(p), nil);
+  size_t r = height_traverse(rbtree_right(p), nil);
+  return 1 + (l > r ? l : r);
+}
+
+// stats mode should count rotations, fixup loops and find comparisons, and report the tree shape
+void test_stats(const size_t n, const unsigned int seed) {
+  rbtree *t = new_rbtree();
+  rbtree_statistics st = rbtree_stats(t);
+  assert(st.height == 0 && st.black_height == 0 && st.size == 0);
+  assert(st.counters.left_rotations == 0 && st.counters.finds == 0);
+
+  // 1, 2, 3: the third insert runs one fixup iteration with one left rotation
+  for (key_t k = 1; k <= 3; k++) {
+    rbtree_insert(t, k);
+  }
+  st = rbtree_stats(t);
+  assert(st.counters.left_rotations == 1 && st.counters.right_rotations == 0);
+  assert(st.counters.insert_fixup_iterations == 1);
+  assert(st.height == 2 && st.black_height == 1 && st.size == 3);
+
+  assert(rbtree_find(t, 2) != NULL);  // the root
+  assert(rbtree_find(t, 4) == NULL);  // root, then 3
+  st = rbtree_stats(t);
+  assert(st.counters.finds == 2);
+  assert(st.counters.find_comparisons == 3);
+  assert(st.counters.find_max_comparisons == 2);
+
+  rbtree_stats_reset(t);
+  st = rbtree_stats(t);
+  assert(st.counters.left_rotations == 0 && st.counters.finds == 0 && st.size == 3);
+
+  // random keys: the shape matches a recursive walk and finds never go deeper than the height
+  srand(seed);
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, rand());
+  }
+  for (size_t i = 0; i < n; i++) {
+    rbtree_find(t, rand());
+  }
+  st = rbtree_stats(t);
+  assert(st.height == height_traverse(t->root, t->nil));
+  init_color_traverse();
+  assert(color_traverse(t->root, RBTREE_BLACK, 0, t->nil));
+  assert(st.black_height == (size_t)max_black_depth);
+  assert(st.size == n + 3);
+  assert(st.counters.finds == n);
+  assert(st.counters.find_max_comparisons <= st.height);
+  assert(st.counters.left_rotations + st.counters.right_rotations > 0);
+  assert(st.counters.insert_fixup_iterations > 0);
+
+  while (t->root != t->nil) {
+    rbtree_erase(t, t->root);
+  }
+  st = rbtree_stats(t);
+  assert(st.counters.erase_fixup_iterations > 0);
+  assert(st.height == 0 && st.black_height == 0);
+  delete_rbtree(t);
+}
+#endif
+
 int main(void) {
   test_init();
   test_insert_single(0);
@@ -374,9 +1251,40 @@ int main(void) {
   test_find_erase_fixed();
   test_minmax_suite();
   test_to_array_suite();
+  test_to_array_bounded();
+  test_size();
+  test_cursor();
+  test_bounds_duplicates();
   test_distinct_values();
   test_duplicate_values();
   test_multi_instance();
+  test_validate();
+  test_from_sorted();
+  test_insert_batch_suite();
+  test_set_operations_suite();
+  test_export(0, 1);
+  test_export(1, 2);
+  test_export(1000, 3);
+  test_export_resume();
+  test_insert_hint(1, 1);
+  test_insert_hint(10000, 2);
+  test_pop(1, 1);
+  test_pop(10000, 2);
+  test_erase_key(1, 1);
+  test_erase_key(10000, 2);
+  test_clear(1);
+  test_clear(32 * 511);  // fills chunks of 32, 64, ..., 8192 nodes exactly
+#ifdef RBTREE_INDEX
+  test_arena_reuse();
+#endif
+  test_find_many(0, 10, 1);
+  test_find_many(1000, 5000, 2);
+#ifdef RBTREE_ORDER_STATS
+  test_order_stats(10000, 3);
+#endif
+#ifdef RBTREE_STATS
+  test_stats(10000, 4);
+#endif
   test_find_erase_rand(1000000, 55);
   printf("Passed all tests!\n");
 }
\ No newline at end of file